@@ -2,6 +2,8 @@
 #define HT_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 // Opaque type definition
 typedef struct ht ht;
@@ -10,11 +12,20 @@ typedef struct ht ht;
 
 // Prototypes
 ht* ht_create(const size_t CAPACITY);
+ht* ht_create_sized(const size_t CAPACITY, const size_t VALUE_SIZE);
 void ht_destroy(ht* table);
+int ht_reserve(ht* table, size_t n);
 const char* ht_set(ht** table, const char* key, void* value, size_t value_len);
 const char* ht_delete(ht* table, const char* key);
 void* ht_get(ht* table, const char* key);
 
+// Tables keyed by integers, e.g. packed MAC addresses, store their keys inline and never hash or
+// compare strings. They only work with the _u64 functions.
+ht* ht_create_u64(const size_t CAPACITY, const size_t VALUE_SIZE);
+bool ht_set_u64(ht* table, uint64_t key, const void* value, size_t value_len);
+bool ht_delete_u64(ht* table, uint64_t key);
+void* ht_get_u64(ht* table, uint64_t key);
+
 
 size_t ht_length(ht* table);
 size_t ht_capacity(ht* table);
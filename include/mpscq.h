@@ -0,0 +1,17 @@
+#ifndef MPSCQ_H
+#define MPSCQ_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Opaque type definition
+// Bounded lock-free multi-producer single-consumer queue of pointers
+typedef struct mpscq mpscq;
+
+// Prototypes
+mpscq* mpscq_create(const size_t CAPACITY);
+void mpscq_destroy(mpscq* q);
+bool mpscq_push(mpscq* q, void* item);
+void* mpscq_pop(mpscq* q);
+
+#endif
@@ -17,6 +17,35 @@
  * In terms of time, it has its own capability of tracking if it is within bounds of renewal. 
  * Ideally, all socket functions must be time aware whether the client can renew or has already
  * expired.
+ *
+ * PERSISTENT CONNECTIONS
+ * By default, every socket function opens a new TCP connection for its transaction. A client that
+ * talks to the server repeatedly can instead open an ot_cli_conn once and pass it to the ot_cli_conn_*
+ * variants, which run the TREQ, TREN and CSEND transactions over the same connection. If the server
+ * has closed an idle connection in the meantime, it is reopened transparently.
+ *
+ * PIPELINING
+ * ot_cli_conn_send_batch checks many credentials at once. Their CSENDs are written back-to-back in 
+ * windows of CLI_PIPELINE_DEPTH pkts, and the server answers each window in order with a single send.
+ *
+ * UDP TRANSPORT
+ * A connection opened with ot_cli_conn_open_udp sends every pkt as a datagram tagged with a request id
+ * instead (see ot_packet.h), which saves the TCP handshake when the server runs with udp enabled. A
+ * request that goes unanswered for CLI_UDP_TIMEOUT_MS is sent again, with the timeout doubling on each
+ * of up to CLI_UDP_RETRIES retransmits. Replies carrying another request id are dropped. A batch sends
+ * one datagram per CSEND and only retransmits the ones whose reply is missing.
+ *
+ * UNIX DOMAIN SOCKETS
+ * Clients on the same host as the server can open their connection with ot_cli_conn_open_unix, which
+ * takes the path of the server's unix socket (see unix_path in ot_server.h) in place of its address. 
+ * Pkts then skip the TCP stack but otherwise travel exactly as over a TCP connection.
+ *
+ * SHARED MEMORY RING
+ * ot_cli_conn_open_shm claims a channel of the server's shared memory ring (see shm_path in 
+ * ot_server.h) instead. Requests and replies are copied through slots of the ring, so a client that
+ * keeps the server busy never enters the kernel. A reply that does not arrive within CLI_SHM_TIMEOUT_MS
+ * fails the transaction, and the connection moves on to a fresh channel so that the late reply is never
+ * taken for the one of a later transaction.
  */
 
 #ifndef OT_CLIENT_H_
@@ -24,11 +53,49 @@
 
 // Project Headers
 #include "ot_context.h" //<< for context structures and methods
+#include "shmring.h" //<< for the shared memory transport
 
 // Standard Library Headers
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#define CLI_PIPELINE_DEPTH 32 //<< max CSENDs in flight on a connection during a batch
+#define CLI_UDP_TIMEOUT_MS 250  //<< wait for a UDP reply before the first retransmit
+#define CLI_UDP_RETRIES 4       //<< retransmits of an unanswered UDP request before giving up
+#define CLI_UNIX_PATH_MAX 108   //<< room for a unix socket path, the size of sun_path on Linux
+#define CLI_SHM_TIMEOUT_MS 1000 //<< wait for a reply through the shared memory ring before giving up
+
+// Persistent connection to an Otter server
+typedef struct ot_cli_conn
+{
+  int       sockfd;   //<< -1 while disconnected
+  bool      udp;      //<< pkts travel as datagrams over a connected UDP socket
+  uint32_t  next_id;  //<< request id of the next UDP request
+  char      unix_path[CLI_UNIX_PATH_MAX]; //<< server socket to reconnect to, empty over TCP and UDP
+  shmring*  shm;      //<< shared memory ring of the server, NULL over sockets
+  int       shm_chan; //<< channel claimed on the ring, -1 if none could be claimed again after a failure
+} ot_cli_conn;
+
+// Opens a persistent connection to the server of the client context
+// Returns NULL if the server cannot be reached
+ot_cli_conn* ot_cli_conn_open(const ot_cli_ctx* ctx);
+
+// Opens a UDP "connection" to the server of the client context, used like one opened with 
+// ot_cli_conn_open. Returns NULL if the socket cannot be set up.
+ot_cli_conn* ot_cli_conn_open_udp(const ot_cli_ctx* ctx);
+
+// Opens a persistent connection to a server on the same host through its unix socket at path
+// Returns NULL if the path is too long or the server cannot be reached
+ot_cli_conn* ot_cli_conn_open_unix(const char* path);
+
+// Opens a persistent connection to a server on the same host through its shared memory ring at path
+// Returns NULL if there is no ring at path or all of its channels are taken
+ot_cli_conn* ot_cli_conn_open_shm(const char* path);
+
+// Closes a persistent connection, frees it to memory, and sets the caller's variable to NULL
+void ot_cli_conn_close(ot_cli_conn** conn);
+
 // Authenticates the client with the server
 //
 // Utilizes existing information in the client context to send a TREQ pkt to the server. 
@@ -56,6 +123,20 @@ bool ot_cli_renew(ot_cli_ctx* ctx);
 // If the client is not authenticated, a CINV is also provided with the username being "UNKN"
 bool ot_cli_send(ot_cli_ctx ctx, const char* uname, const char* psk);
 
+// Same as ot_cli_auth, ot_cli_renew and ot_cli_send, but over a persistent connection
+//
+// A NULL conn falls back to a connection per transaction.
+bool ot_cli_conn_auth(ot_cli_conn* conn, ot_cli_ctx* ctx);
+bool ot_cli_conn_renew(ot_cli_conn* conn, ot_cli_ctx* ctx);
+bool ot_cli_conn_send(ot_cli_conn* conn, ot_cli_ctx ctx, const char* uname, const char* psk);
+
+// Sends the n credentials (unames[i], psks[i]) to the server as pipelined CSENDs
+//
+// Sets results[i] to whether the server validated the i-th credentials. Returns false if the server
+// could not be reached or stopped answering, results are then incomplete.
+bool ot_cli_conn_send_batch(ot_cli_conn* conn, ot_cli_ctx ctx, const char** unames, const char** psks,
+                            size_t n, bool* results);
+
 
 
 #endif //OT_CLIENT_H_
@@ -12,6 +12,16 @@
  * The ot_srv_ctx object contains a server metadata object and two hash tables for keeping client contexts 
  * (context table or ctable) and for credentials (otfile table or otable).
  *
+ * The ctable may be shared by several server workers, so it is guarded by a reader-writer lock
+ * (ctable_lock). Client contexts must only be read and written through the ot_srv_*_cli_ctx functions
+ * below, which take the lock and copy contexts in and out of the table. The otable is read-only once
+ * the otfile has been loaded and needs no locking. A ctable that is only ever touched by a single 
+ * thread (e.g. a per-worker shard) can be marked with ctable_private to skip the lock altogether.
+ *
+ * The ctable is keyed by client MACs packed into integers (see ot_mac_pack), so lookups never format,
+ * hash or compare MAC strings. The ot_srv_*_cli_ctx functions taking a MAC string are kept for 
+ * convenience and parse it into a packed MAC.
+ *
  * OTTER SERVER METADATA
  * The ot_srv_ctx_mdata just contains the server IP and MAC address to be used as a reference for subsequent
  * protocol operations.
@@ -38,6 +48,8 @@
 
 // Standard Library Headers
 #include <time.h> //<< for time_t variables
+#include <pthread.h> //<< for the ctable lock
+#include <stdbool.h>
 
 // Client Context Object
 #pragma pack(push, 1)
@@ -67,6 +79,8 @@ typedef struct ot_srv_ctx
   ot_srv_ctx_mdata  sc_mdata;
   ht*               ctable;
   ht*               otable;
+  pthread_rwlock_t  ctable_lock;
+  bool              ctable_private; //<< ctable is owned by a single thread, ctable_lock is skipped
 } ot_srv_ctx;
 
 // Creates a server context metadata object
@@ -81,14 +95,44 @@ ot_cli_ctx_create(ot_pkt_header h, time_t exp_time, time_t renew_time);
 ot_cli_ctx 
 ot_srv_get_cli_ctx(ot_srv_ctx* sc, const char* macstr);
 
+// Finds the client context of a packed MAC and returns it. The state of the context is UNKN if there
+// is none.
+ot_cli_ctx 
+ot_srv_get_cli_ctx_mac(ot_srv_ctx* sc, uint64_t mac);
+
 // Allocates memory for a server context and creates it
 ot_srv_ctx* 
 ot_srv_ctx_create(ot_srv_ctx_mdata sc_metadata);
 
-// Inserts a client context into a server's ctable
+// Inserts a client context into a server's ctable, replacing any existing context for the MAC.
+// Returns macstr on success, otherwise NULL
 const char* 
 ot_srv_set_cli_ctx(ot_srv_ctx* sc, const char* macstr, ot_cli_ctx cc);
 
+// Inserts the client context of a packed MAC, replacing any existing one. Returns false on failure.
+bool 
+ot_srv_set_cli_ctx_mac(ot_srv_ctx* sc, uint64_t mac, ot_cli_ctx cc);
+
+// Inserts a client context into a server's ctable only if the MAC has no context yet. The check and
+// the insert are atomic with respect to other workers.
+// Returns macstr on success, otherwise NULL (also if the MAC already exists)
+const char* 
+ot_srv_add_cli_ctx(ot_srv_ctx* sc, const char* macstr, ot_cli_ctx cc);
+
+// Inserts the client context of a packed MAC only if it has none yet, atomically like 
+// ot_srv_add_cli_ctx. Returns false on failure or if the MAC already exists.
+bool 
+ot_srv_add_cli_ctx_mac(ot_srv_ctx* sc, uint64_t mac, ot_cli_ctx cc);
+
+// Removes a client context from a server's ctable
+// Returns macstr if a context was removed, otherwise NULL
+const char* 
+ot_srv_del_cli_ctx(ot_srv_ctx* sc, const char* macstr);
+
+// Removes the client context of a packed MAC. Returns false if there was none.
+bool 
+ot_srv_del_cli_ctx_mac(ot_srv_ctx* sc, uint64_t mac);
+
 // Frees a server context and its ctable and otable to memory, and sets the caller's server context variable
 // to NULL
 void 
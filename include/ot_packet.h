@@ -20,11 +20,51 @@
  * the ot_pkt_msgtype_t enum or just msgtype for short. The msgtype is what defines the value stored in the
  * payload alongside its corresponding size (vlen).
  *
+ * INLINE PAYLOADS
+ * An ot_pkt stores up to OT_PKT_MAX_PAYLOADS payload nodes and their values inside itself. ot_pkt_put 
+ * fills the next free node in O(1) and links it into the payload list, so walking the list of a pkt 
+ * built this way (or deserialized) is a linear walk over one block of memory. Nodes from ot_payload_create
+ * can still be attached with ot_payload_append and come after the inline ones. Since the list points 
+ * into the pkt itself, an ot_pkt must not be copied by value.
+ *
  * PAYLOAD MSGTYPES AND CLIENT STATES
  * Otter packets are normally classified by the state (ot_cli_state_t) that the sender conveys to the receiver 
  * via the payload with msgtype PL_STATE. Recall that in the protocol, the client has to tether to the server. 
  * Packets that facilitate the tether process are the TREQ, TACK, TREN, TPRV, and TINV packets. On the other 
  * hand, the packets that deal with credentials are the CPULL, CPUSH, and CINV packets.
+ *
+ * WIRE FORMAT
+ * On the wire, every pkt travels in a frame: a short prefix (ot_pkt_frame) carrying the "OT" magic, the
+ * wire version and the total length of the frame, followed by the serialized header and payloads. A
+ * receiver reads exactly as many bytes as the prefix announces, so frames can travel back-to-back on one
+ * connection. ot_pkt_frame_len tells where the first frame of a byte stream ends, and recognizes pkts of
+ * peers that predate framing or speak another wire version.
+ *
+ * UDP DATAGRAMS
+ * Over UDP, a datagram carries exactly one frame behind an OT_UDP_ID_SIZE-byte request id chosen by the
+ * client. The server echoes the id in front of its reply, so the client can match replies to requests 
+ * and tell a late reply to an earlier attempt from the one it is waiting for.
+ *
+ * STREAM PARSING
+ * An ot_pkt_parser splits a byte stream that arrives in arbitrary chunks into frames. Chunks are read
+ * straight into the room the parser hands out, and complete frames are yielded in place for
+ * ot_pkt_deserialize. The bytes of a partial frame are only moved when the frame could not be completed
+ * in the space left at the end of the buffer.
+ *
+ * PAYLOAD VIEWS
+ * Handlers that only read a received pkt can parse it into an ot_pkt_view instead of an ot_pkt. The view
+ * copies the header and keeps a (type, vlen, value) entry per msgtype whose value points into the frame
+ * itself, so no payload is allocated or copied. A view is only valid while the bytes of its frame are.
+ *
+ * Entries are indexed by msgtype and flagged in a presence bitmask, so a handler checks that all the
+ * payloads it needs are there with a single comparison against an OT_PL_BIT mask. A payload shorter 
+ * than its msgtype (e.g. a 2-byte PL_SRV_IP) is not marked present.
+ *
+ * PACKET SCHEMA
+ * OT_PL_SCHEMA lists every payload msgtype with the size of its value, and OT_PKT_SCHEMA lists the 
+ * payloads that a pkt of each state must and may carry. The ot_pkt_fields struct and the ot_pkt_encode,
+ * ot_pkt_decode and ot_pkt_validate functions are generated from these tables, so a new field or state
+ * only needs a new row.
  */
 
 #ifndef OT_PACKET_H_
@@ -38,6 +78,30 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/uio.h> //<< for struct iovec
+
+#define OT_WIRE_MAGIC_0 'O'
+#define OT_WIRE_MAGIC_1 'T'
+#define OT_WIRE_VERSION 1
+
+#define OT_UDP_ID_SIZE 4  //<< bytes of the request id in front of the frame of a UDP datagram
+
+// Errors of ot_pkt_frame_len
+#define OT_FRAME_ELEGACY  -1  //<< unframed pkt from a peer that predates the framed wire format
+#define OT_FRAME_EVERSION -2  //<< frame of a wire version this build does not speak
+#define OT_FRAME_EINVAL   -3  //<< frame length too short to hold a pkt header
+#define OT_FRAME_ETOOBIG  -4  //<< frame longer than the buffer of the stream parser
+
+// Otter Frame Prefix
+#pragma pack(push, 1)
+typedef struct ot_pkt_frame
+{
+  uint8_t   magic[2];   //<< OT_WIRE_MAGIC_0, OT_WIRE_MAGIC_1
+  uint8_t   version;    //<< OT_WIRE_VERSION
+  uint8_t   flags;      //<< reserved, 0
+  uint16_t  len;        //<< length of the whole frame including this prefix, in network order
+} ot_pkt_frame;
+#pragma pack(pop)
 
 // Otter Packet Header
 #pragma pack(push, 1)
@@ -52,6 +116,18 @@ typedef struct ot_pkt_header
 } ot_pkt_header;
 #pragma pack(pop)
 
+// Otter Stream Parser
+//
+// Bytes in [head, tail) of the caller-owned buffer have been fed but not yet popped as frames.
+typedef struct ot_pkt_parser
+{
+  uint8_t*  buf;
+  size_t    cap;
+  size_t    head;   //<< start of the frame in progress
+  size_t    tail;   //<< end of the bytes fed so far
+  size_t    need;   //<< length of the frame in progress once its prefix is in, 0 before
+} ot_pkt_parser;
+
 // Otter Payload Node
 typedef struct ot_payload
 {
@@ -61,13 +137,30 @@ typedef struct ot_payload
   void*                       value;
 } ot_payload;
 
+#define OT_PKT_MAX_PAYLOADS 16                            //<< payload nodes an ot_pkt holds inline
+#define OT_PKT_VALUE_ALIGN  8                             //<< inline values start at multiples of this
+#define OT_PKT_VALUES_SIZE  (OT_PKT_MAX_PAYLOADS * OT_PKT_VALUE_ALIGN)  //<< inline value bytes
+
 // Otter Packet Object
 typedef struct ot_pkt 
 {
   ot_pkt_header header;
-  ot_payload *payload; 
+  ot_payload *payload;                        //<< inline payloads first, then any appended nodes
+  uint8_t     npl;                            //<< inline payload nodes in use
+  uint16_t    vused;                          //<< inline value bytes in use
+  ot_payload  pl[OT_PKT_MAX_PAYLOADS];
+  uint8_t     values[OT_PKT_VALUES_SIZE];     //<< follows the nodes, so it is pointer-aligned
 } ot_pkt;
 
+// Otter Payload View
+// The value points into the frame the view was parsed from and may be unaligned
+typedef struct ot_payload_view
+{
+  uint8_t         type;
+  uint8_t         vlen;
+  const uint8_t*  value;
+} ot_payload_view;
+
 // Payload Message Type (msgtype) 
 typedef enum {
   PL_STATE,     //<< ot_cli_state_t
@@ -83,6 +176,16 @@ typedef enum {
   PL_UNKN,      //<< indicating a parse error during serialization/deserialization
 } ot_pkt_msgtype_t;
 
+#define OT_PL_BIT(msgtype) (1u << (msgtype))  //<< presence bit of a msgtype in an ot_pkt_view
+
+// Otter Packet View
+typedef struct ot_pkt_view
+{
+  ot_pkt_header   header;
+  uint32_t        present;              //<< OT_PL_BIT of every msgtype found in the frame
+  ot_payload_view payloads[PL_UNKN];    //<< indexed by msgtype, valid only if present
+} ot_pkt_view;
+
 // Client States
 typedef enum 
 {
@@ -99,6 +202,75 @@ typedef enum
   UNKN          //<< Parse error type
 } ot_cli_state_t;
 
+// Payload Schema
+//
+// X(msgtype, member, type, dims): the ot_pkt_fields member holding the value of each msgtype. The size
+// of the member is the size of the value on the wire.
+#define OT_PL_SCHEMA(X)                           \
+  X(PL_STATE,   state,      uint8_t,  )           \
+  X(PL_SRV_IP,  srv_ip,     uint32_t, )           \
+  X(PL_SRV_MAC, srv_mac,    uint8_t,  [6])        \
+  X(PL_CLI_IP,  cli_ip,     uint32_t, )           \
+  X(PL_CLI_MAC, cli_mac,    uint8_t,  [6])        \
+  X(PL_ETIME,   exp_time,   uint32_t, )           \
+  X(PL_RTIME,   renew_time, uint32_t, )           \
+  X(PL_HASH,    hash,       uint64_t, )
+
+#define OT_PL_IPS     (OT_PL_BIT(PL_STATE) | OT_PL_BIT(PL_SRV_IP) | OT_PL_BIT(PL_CLI_IP))
+#define OT_PL_TIMES   (OT_PL_BIT(PL_ETIME) | OT_PL_BIT(PL_RTIME))
+
+// Packet Schema
+//
+// X(state, required, optional): the payloads a pkt of each state must and may carry, as masks of 
+// OT_PL_BITs
+#define OT_PKT_SCHEMA(X)                                                                            \
+  X(TREQ,   OT_PL_IPS | OT_PL_BIT(PL_CLI_MAC),                            0)                        \
+  X(TACK,   OT_PL_IPS | OT_PL_BIT(PL_SRV_MAC) | OT_PL_TIMES,              0)                        \
+  X(TREN,   OT_PL_IPS | OT_PL_BIT(PL_CLI_MAC),                            0)                        \
+  X(TPRV,   OT_PL_IPS | OT_PL_TIMES,                                      0)                        \
+  X(TINV,   OT_PL_IPS,                                                    0)                        \
+  X(CSEND,  OT_PL_IPS | OT_PL_BIT(PL_HASH),                               0)                        \
+  X(CVAL,   OT_PL_IPS | OT_PL_BIT(PL_HASH),                               0)                        \
+  X(CINV,   OT_PL_IPS,                                                    OT_PL_BIT(PL_HASH))
+
+// Otter Packet Fields
+//
+// The header and payload values of a pkt, one member per msgtype
+typedef struct ot_pkt_fields
+{
+  ot_pkt_header   header;
+  uint32_t        present;    //<< OT_PL_BIT of every payload that is set
+#define X(msgtype, member, type, dims) type member dims;
+  OT_PL_SCHEMA(X)
+#undef X
+} ot_pkt_fields;
+
+// Returns the payloads that a pkt of a state must carry
+static inline uint32_t 
+ot_pkt_required(ot_cli_state_t state)
+{
+  switch (state)
+  {
+#define X(st, required, optional) case st: return (required);
+    OT_PKT_SCHEMA(X)
+#undef X
+    default: return 0;
+  }
+}
+
+// Returns the payloads that a pkt of a state may carry on top of the required ones
+static inline uint32_t 
+ot_pkt_optional(ot_cli_state_t state)
+{
+  switch (state)
+  {
+#define X(st, required, optional) case st: return (optional);
+    OT_PKT_SCHEMA(X)
+#undef X
+    default: return 0;
+  }
+}
+
 // Creates a Otter packet header
 ot_pkt_header 
 ot_pkt_header_create(uint32_t srv_ip, uint32_t cli_ip, 
@@ -113,18 +285,111 @@ ot_pkt_create();
 ot_payload* 
 ot_payload_create(uint8_t t, void* v, uint8_t vl);
 
+// Stores a payload in the inline storage of a pkt and links it after the other inline payloads in O(1). 
+// Returns the payload node, or NULL if the inline storage is full.
+ot_payload* 
+ot_pkt_put(ot_pkt* pkt, uint8_t t, const void* v, uint8_t vl);
+
 // Appends a payload node to the end of a payload list
 ot_payload* 
 ot_payload_append(ot_payload* head, ot_payload* add);
 
-// Serializes an ot_pkt structure to a byte buffer and returns bytes serialized
+// Serializes an ot_pkt structure into a frame in a byte buffer and returns the length of the frame
 ssize_t 
 ot_pkt_serialize(struct ot_pkt* pkt, uint8_t* buf, size_t buflen);
 
-// Deserializes/unpacks an ot_pkt structure from a byte buffer and returns bytes deserialized
+#define OT_PKT_MAX_IOV (2 + 2 * OT_PKT_MAX_PAYLOADS) //<< iovecs of a pkt with inline payloads only
+
+// Serializes an ot_pkt into an iovec list for writev/sendmsg without copying its header or payload values.
+// The frame prefix and the (type, vlen) of each payload are written to heads, which needs room for 
+// sizeof(ot_pkt_frame) + 2 bytes per payload. The iovecs point into the pkt and heads and stay valid for
+// as long as both do.
+//
+// Returns the number of iovecs used and sets len to the length of the frame, or -1 if the pkt does not
+// fit in heads or iovcnt.
+int 
+ot_pkt_serialize_iov(const ot_pkt* pkt, uint8_t* heads, size_t headslen, struct iovec* iov, int iovcnt, 
+                     size_t* len);
+
+// Deserializes/unpacks an ot_pkt structure from the frame at the start of a byte buffer and returns the
+// length of the frame. Bytes after the frame are left untouched.
 ssize_t 
 ot_pkt_deserialize(struct ot_pkt* pkt, uint8_t* buf, size_t buflen);
 
+// Parses the frame at the start of a byte buffer into a view without allocating and returns the length 
+// of the frame, or -1 if the frame is malformed. Payloads of unknown msgtypes are skipped and a repeated
+// msgtype resolves to its last payload.
+ssize_t 
+ot_pkt_view_parse(ot_pkt_view* v, const uint8_t* buf, size_t buflen);
+
+// Returns true if a view holds the payloads of every msgtype in a mask of OT_PL_BITs
+static inline bool 
+ot_pkt_view_has(const ot_pkt_view* v, uint32_t mask) { return (v->present & mask) == mask; }
+
+// Returns the payload of a msgtype in a view, or NULL if there is none
+const ot_payload_view* 
+ot_pkt_view_get(const ot_pkt_view* v, ot_pkt_msgtype_t type);
+
+// Loads the value of a payload into an integer of the given width. Returns false if the payload is 
+// missing.
+bool 
+ot_pkt_view_u8(const ot_pkt_view* v, ot_pkt_msgtype_t type, uint8_t* out);
+
+bool 
+ot_pkt_view_u32(const ot_pkt_view* v, ot_pkt_msgtype_t type, uint32_t* out);
+
+bool 
+ot_pkt_view_u64(const ot_pkt_view* v, ot_pkt_msgtype_t type, uint64_t* out);
+
+// Encodes the fields of a pkt into a frame in a byte buffer and returns the length of the frame, or -1 if 
+// it does not fit. The payloads required by the state are always written, the optional ones only if 
+// they are present.
+ssize_t 
+ot_pkt_encode(const ot_pkt_fields* f, uint8_t* buf, size_t buflen);
+
+// Decodes the frame at the start of a byte buffer into the fields of a pkt and returns the length of the
+// frame, or -1 if the frame is malformed. Only the fields of the payloads found are set in present.
+ssize_t 
+ot_pkt_decode(ot_pkt_fields* f, const uint8_t* buf, size_t buflen);
+
+// Returns true if the fields hold a known state and every payload that state requires
+bool 
+ot_pkt_validate(const ot_pkt_fields* f);
+
+// Finds the end of the first frame in a byte stream
+//
+// Returns the length of the frame, or 0 if more bytes are needed to tell. Returns one of the negative 
+// OT_FRAME_E* errors if the stream does not start with a frame this build can read.
+ssize_t 
+ot_pkt_frame_len(const uint8_t* buf, size_t buflen);
+
+// Sets up a stream parser over a caller-owned buffer of cap bytes
+void 
+ot_pkt_parser_init(ot_pkt_parser* p, uint8_t* buf, size_t cap);
+
+// Returns where the next chunk of the stream goes and sets room to the bytes that fit there
+uint8_t* 
+ot_pkt_parser_room(ot_pkt_parser* p, size_t* room);
+
+// Accounts for n bytes of the stream written at the room of the parser
+void 
+ot_pkt_parser_feed(ot_pkt_parser* p, size_t n);
+
+// Returns the number of bytes fed to the parser that have not been popped yet
+size_t 
+ot_pkt_parser_buffered(const ot_pkt_parser* p);
+
+// Looks at the next frame of the stream without consuming it
+//
+// Returns 1 and sets frame/len if a complete frame is buffered, 0 if more bytes are needed, or one of
+// the negative OT_FRAME_E* errors if the stream cannot be split into frames.
+int 
+ot_pkt_parser_peek(ot_pkt_parser* p, uint8_t** frame, size_t* len);
+
+// Consumes the frame returned by the last successful ot_pkt_parser_peek
+void 
+ot_pkt_parser_pop(ot_pkt_parser* p);
+
 // Frees an ot_pkt to memory and sets the pointer to NULL on the caller's side
 void 
 ot_pkt_destroy(ot_pkt** o);
@@ -135,7 +400,17 @@ macstr_to_bytes(const char* macstr, uint8_t* macbytes);
 
 // Converts a MAC byte buffer to a string
 void 
-bytes_to_macstr(uint8_t* macbytes, char* macstr);
+bytes_to_macstr(const uint8_t* macbytes, char* macstr);
+
+// Packs a MAC byte buffer into the low 48 bits of an integer, first byte most significant, so that
+// e.g. 00:00:00:ab:ab:ff packs to 0x000000ababff
+static inline uint64_t 
+ot_mac_pack(const uint8_t* macbytes)
+{
+  uint64_t ret = 0;
+  for (int i = 0; i < 6; ++i) ret = (ret << 8) | macbytes[i];
+  return ret;
+}
 
 // Converts a msgtype to a string
 void 
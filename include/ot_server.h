@@ -6,7 +6,68 @@
  * Contains public API for Otter server
  *
  * The API simply consists of an ot_srv_run entrypoint that utilizes the server IP and MAC, and path to
- * the desired otfile.
+ * the desired otfile. ot_srv_run_cfg is the same entrypoint but takes a server configuration 
+ * (ot_srv_cfg) for tuning the runtime, e.g. the number of worker threads.
+ *
+ * SERVER WORKERS
+ * Each worker thread owns a SO_REUSEPORT listening socket on DEF_PORT and its own epoll event loop, so
+ * the kernel spreads inbound connections across the workers. All workers share one server context, 
+ * which means a TREQ handled by one worker is visible to a TREN or CSEND landing on another.
+ *
+ * SHARDED WORKERS
+ * In sharded mode the workers share nothing but the read-only otable. Every worker owns a private
+ * ctable shard holding the client MACs that hash to it, so the ctable is never locked. Connections
+ * that land on the wrong worker have their pkt forwarded to the owning worker over a lock-free queue,
+ * and the reply travels back the same way.
+ *
+ * PERSISTENT CONNECTIONS
+ * Connections are kept alive after a reply, so a client can run its TREQ, CSENDs and TRENs over a
+ * single connection. A connection is closed by the server once it has been idle for idle_timeout
+ * seconds, or right after its first reply if idle_timeout is 0.
+ *
+ * PIPELINING
+ * A client may send several pkts back-to-back without waiting for their replies. The server splits
+ * them from the byte stream by their frame lengths, handles them in order and answers in the same
+ * order, writing the replies of everything it has read so far with a single send. Peers that do not
+ * frame their pkts (pre-v1) or speak another wire version are logged and disconnected.
+ *
+ * UDP TRANSPORT
+ * With udp enabled, every worker also binds a SO_REUSEPORT UDP socket to DEF_PORT, next to its TCP 
+ * listener. A datagram holds a single pkt behind a request id (see ot_packet.h) and is answered with a 
+ * single datagram echoing the id, with no connection to set up or tear down. Clients retransmit
+ * requests that go unanswered, so each worker remembers its replies for SRV_UDP_CACHE_TTL_MS and answers
+ * a retransmitted request with the reply it already sent instead of handling it twice. A retransmit of
+ * a request that is still with the worker owning its ctable shard is dropped.
+ * Workers drain their socket SRV_UDP_BATCH datagrams per recvmmsg and answer each batch with a 
+ * single sendmmsg.
+ *
+ * UNIX DOMAIN SOCKET
+ * With a unix_path set, the server also listens on an AF_UNIX stream socket at that path, so clients on
+ * the same host can skip the TCP stack. The socket is shared by all workers and carries the same framed 
+ * byte stream as a TCP connection, so everything above (keep-alive, pipelining) applies to it as well.
+ * A stale socket left at the path by an earlier run is replaced, and the path is removed on shutdown.
+ *
+ * SHARED MEMORY RING
+ * With a shm_path set, the server also creates a shared memory region (see shmring.h) at that path,
+ * e.g. under /dev/shm, with SRV_SHM_CHANNELS request/response channels for local client processes.
+ * An extra worker polls the channels and answers each request in place, so a busy client authenticates
+ * without any syscall. The worker and its clients only sleep on (and wake each other through) futexes
+ * once they have gone idle. In sharded mode, requests are forwarded to the worker owning their shard.
+ * A region left at the path by an earlier run is replaced, anything else there keeps the server from
+ * starting. The region is created with mode 0600, so only clients running as the server's user attach.
+ *
+ * REQUEST HANDLER
+ * The protocol itself lives in ot_srv_handle, which takes one framed pkt and writes its reply without
+ * touching a socket, a clock or stdout. Every transport above is a thin wrapper around it, and it can
+ * be driven directly from tests, fuzzers, benchmarks or an embedding process.
+ *
+ * IO_URING BACKEND
+ * Workers can serve through io_uring instead of epoll: a multishot accept feeds new connections, and
+ * receives land in a ring of provided buffers. With keep-alive, the replies of a connection go out as
+ * a plain send whose completion re-arms the receive for its next pkts, and the connection is closed
+ * once it idles out, hangs up or leaves a pkt unanswered. With an idle_timeout of 0, every reply is a
+ * send linked to the close of the socket instead. Workers fall back to epoll when the kernel does not
+ * support io_uring.
  *
  * Also found here are the variables for configuring the Otter server
  */
@@ -14,16 +75,62 @@
 #define OT_SERVER_H_
 
 #include <stdint.h> //<< for uint32_t, uint8_t
+#include <stdbool.h>
+#include <sys/types.h> //<< for ssize_t
+#include <time.h>
+
+#include "ot_context.h"
 
 #define DEF_PORT 7192
 #define DEF_EXP_TIME 86400  //<< default expiry is 1 day
 
 #define SRV_PORT 7192
 #define MAX_RECV_SIZE 2048
+#define SRV_MAX_REPLY_SIZE 128  //<< room a reply needs in the tx buffer of a connection
+
+#define SRV_BACKLOG 4096      //<< pending connection queue length of the listening socket
+#define SRV_MAX_EVENTS 256    //<< max readiness events handled per epoll_wait call
+#define SRV_MAX_WORKERS 256   //<< upper bound for the number of server workers
+#define SRV_INBOX_SIZE 4096   //<< capacity of the inter-worker queue of a sharded worker
+#define SRV_URING_ENTRIES 1024  //<< submission queue size of an io_uring worker
+#define SRV_URING_BUFS 512      //<< number of provided receive buffers of an io_uring worker
+#define SRV_UDP_CACHE_SIZE 256  //<< initial room for replies to retransmitted UDP requests, a power of two
+#define SRV_UDP_CACHE_TTL_MS 8000 //<< keep UDP replies past the last retransmit of a client (after 7.75s)
+#define SRV_UDP_BATCH 32        //<< datagrams received and answered per recvmmsg/sendmmsg call
+#define SRV_SHM_CHANNELS 64     //<< client processes the shared memory ring can serve at once
+
+#define DEF_WORKERS 1         //<< default number of server workers
+#define DEF_IDLE_TIMEOUT 30   //<< default seconds before an idle keep-alive connection is closed
 
-// Runs the server loop
+// Server Configuration Object
+typedef struct ot_srv_cfg
+{
+  int   nworkers; //<< number of worker threads, 0 spawns one per online CPU
+  bool  sharded;  //<< shared-nothing mode, each worker owns a ctable shard
+  bool  uring;    //<< serve through io_uring, falls back to epoll if the kernel lacks support
+  int   idle_timeout; //<< seconds a keep-alive connection may sit idle, 0 closes after one reply
+  bool  udp;      //<< also serve datagrams on a UDP socket bound to the same port
+  const char* unix_path;  //<< also listen on an AF_UNIX stream socket at this path, NULL to disable
+  const char* shm_path;   //<< also serve a shared memory ring created at this path, NULL to disable
+  size_t ctable_reserve;  //<< clients the ctable is presized for, split across shards, 0 to grow on demand
+} ot_srv_cfg;
+
+// Creates a server configuration with default values
+ot_srv_cfg ot_srv_cfg_default(void);
+
+// Runs the server loop with the default configuration
 void ot_srv_run(uint32_t SRV_IP, uint8_t* SRV_MAC, const char* PATH); 
 
+// Runs the server loop with the provided configuration
+void ot_srv_run_cfg(uint32_t SRV_IP, uint8_t* SRV_MAC, const char* PATH, ot_srv_cfg cfg);
+
+// Handles a single framed pkt at in against the server context sc at time now
+//
+// Writes the reply pkt to out and returns its length, 0 if the pkt goes unanswered or its reply does
+// not fit outcap, or -1 on invalid arguments. Performs no I/O.
+ssize_t ot_srv_handle(ot_srv_ctx* sc, const uint8_t* in, size_t inlen, uint8_t* out, size_t outcap,
+                      time_t now);
+
 #endif //OT_SERVER_H_
 
 
@@ -0,0 +1,39 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define SHMRING_DEPTH 64        //<< requests a channel can have outstanding, a power of two
+#define SHMRING_SLOT_SIZE 256   //<< bytes per slot, including its length prefix
+#define SHMRING_SPIN 4096       //<< polls of a ring before its reader goes to sleep on a futex
+
+// Opaque type definition
+// Shared memory region of request/response channels between one server and local client processes
+//
+// Every channel pairs a request ring written by the client that claimed it with a response ring
+// written by the server. Both sides poll while busy and only sleep on a futex (and only get woken
+// with one) once they have gone idle, so a busy channel costs no syscalls at all.
+typedef struct shmring shmring;
+
+// Prototypes
+shmring* shmring_create(const char* PATH, const unsigned NCHAN);
+shmring* shmring_attach(const char* PATH);
+void shmring_destroy(shmring* r);
+unsigned shmring_nchan(const shmring* r);
+
+// Client side
+int shmring_claim(shmring* r, int timeout_ms);
+void shmring_release(shmring* r, int ch);
+bool shmring_send(shmring* r, int ch, const void* buf, size_t len);
+ssize_t shmring_recv(shmring* r, int ch, void* buf, size_t buflen, int timeout_ms);
+
+// Server side
+const uint8_t* shmring_peek(shmring* r, int ch, size_t* len);
+void shmring_pop(shmring* r, int ch);
+void shmring_reply(shmring* r, int ch, const void* buf, size_t len);
+void shmring_wait(shmring* r, int timeout_ms);
+
+#endif
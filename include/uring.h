@@ -0,0 +1,39 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Opaque type definition
+// Minimal io_uring instance with a ring of provided receive buffers, driven through raw syscalls
+typedef struct uring uring;
+
+// Completion of a submitted operation
+typedef struct uring_cqe {
+    uint64_t user_data;
+    int32_t res;        //<< result of the operation, negative errno on failure
+    int bid;            //<< provided buffer holding received bytes, -1 if none was consumed
+    bool more;          //<< a multishot operation stays armed and will complete again
+    bool nonempty;      //<< the socket still had bytes queued after a receive
+} uring_cqe;
+
+// Prototypes
+uring* uring_create(const unsigned ENTRIES, const unsigned NBUFS, const size_t BUF_SIZE);
+void uring_destroy(uring* u);
+
+bool uring_prep_accept_multishot(uring* u, int fd, uint64_t user_data);
+bool uring_prep_poll_multishot(uring* u, int fd, uint64_t user_data);
+bool uring_prep_recv(uring* u, int fd, size_t len, uint64_t user_data);
+bool uring_prep_send(uring* u, int fd, const void* buf, size_t len, uint64_t user_data);
+bool uring_prep_send_close(uring* u, int fd, const void* buf, size_t len, uint64_t send_data, 
+                           uint64_t close_data);
+bool uring_prep_close(uring* u, int fd, uint64_t user_data);
+
+int uring_submit_and_wait(uring* u, int timeout_ms);
+bool uring_next(uring* u, uring_cqe* cqe);
+
+uint8_t* uring_buf(uring* u, int bid);
+void uring_buf_recycle(uring* u, int bid);
+
+#endif
@@ -4,7 +4,7 @@
 SRV_BIN="./bin/ot_srv"
 BLD_SH="./build.sh"
 LOG_FILE="test_run.log"
-TEST_FILES=("./bin/test_pkt" "./bin/test_srv" "./bin/test_srv_runtime")
+TEST_FILES=("./bin/test_pkt" "./bin/test_ht" "./bin/test_srv" "./bin/test_srv_runtime")
 
 # Clear out any old log file from previous runs
 > "$LOG_FILE"
@@ -4,29 +4,87 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Control bytes, one per slot. A full slot holds the low 7 bits of the hash of its key (H2), so the
+// high bit tells free slots apart from full ones.
+#define HT_CTRL_EMPTY   0x80
+#define HT_CTRL_DELETED 0xfe    //<< tombstone, keeps probe sequences that went past it intact
+
+#define HT_GROUP 16             //<< slots matched at once, one SSE2 register of control bytes
+#define HT_MIGRATE_STEP 64      //<< slots moved per ht_set/ht_delete while a resize is under way
+#define HT_SLAB_CELLS 256       //<< values per slab chunk of a table with a fixed value size
+#define HT_SLAB_HDR 16          //<< bytes in front of the cells of a chunk, keeps the cells aligned
 
 /*******************************************
 * Internal Structures
 *******************************************/
 
+// Keys are strings owned by the table, or integers stored inline in tables made by ht_create_u64
+typedef union {
+    char* str;
+    uint64_t u64;
+} ht_key;
+
 typedef struct {
-    char* key;
+    ht_key key;
     void* value;
-    size_t vlen; 
+    uint32_t hash;          //<< full hash of the key, so probes and rebuilds never rehash key bytes
 } ht_entry;
 
+// Control and entry arrays of a table
+typedef struct {
+    uint8_t* ctrl;
+    ht_entry* entries;
+    size_t capacity;        //<< slots, a power of two and a multiple of HT_GROUP
+} ht_slots;
+
+// Cells holding the values of a table with a fixed value size
+//
+// Cells are carved out of chunks of HT_SLAB_CELLS and never move, and freed cells are kept on a free
+// list that runs through the cells themselves.
+typedef struct {
+    void* free;
+    uint8_t* chunks;        //<< newest chunk, each chunk starts with a pointer to the one before it
+    size_t used;            //<< cells of the newest chunk handed out so far
+    size_t cell;            //<< bytes per cell
+} ht_slab;
+
+// Open addressing table probed a group of HT_GROUP slots at a time
+//
+// A lookup compares the H2 of its key against all control bytes of a group in one go and only looks
+// at the keys of the slots that match, so most probes never leave the control array. The groups of a
+// probe sequence are visited in triangular order starting at the group picked by the rest of the
+// hash (H1), and a lookup ends at the first group with an empty slot.
+//
+// Resizes are incremental. The arrays being replaced are kept as old next to the new ones in cur, and
+// every ht_set and ht_delete moves the next HT_MIGRATE_STEP slots of old over until it is empty. In
+// the meantime lookups that miss cur go on to old, and new entries only ever go to cur.
+//
+// Values are copied into a heap allocation of their own, or into a slab cell if the table was created
+// with a fixed value size. Either way a value stays put until its entry is deleted, so the pointers
+// returned by ht_get survive resizes.
 struct ht {
     size_t size;
-    size_t capacity;
-    ht_entry* entries;
+    size_t growth_left;     //<< empty slots of cur that can still be filled before the next resize
+    ht_slots cur;
+    ht_slots old;           //<< arrays still being migrated, ctrl is NULL if there is no resize going on
+    size_t migrated;        //<< slots of old that have been moved to cur
+    bool u64_keys;
+    size_t value_size;      //<< fixed size of the values, 0 if they vary and are allocated one by one
+    ht_slab slab;
 };
 
 /*******************************************
 * Internal use functions
 *******************************************/
 
-// FNV-1a Hash Algorithm 
-static uint32_t hash(const char* key, size_t len) 
+// FNV-1a Hash Algorithm
+static uint32_t hash(const char* key, size_t len)
 {
     uint32_t hash = 2166136261u;
     for (size_t i = 0; i < len; i++) {
@@ -36,59 +94,364 @@ static uint32_t hash(const char* key, size_t len)
     return hash;
 }
 
+// Integer keys are mixed with the finalizer of MurmurHash3, so that keys differing in a few bits (e.g.
+// MACs of one vendor) still spread over all groups
+static uint32_t hash_u64(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t)(key ^ (key >> 32));
+}
+
+static inline uint32_t hash_h1(uint32_t h) { return h >> 7; }
+static inline uint8_t hash_h2(uint32_t h) { return (uint8_t)(h & 0x7f); }
+
 static void warn_collision(const char* key)
 {
     printf("warn_collision: collision with key `%s`\n", key);
     return;
 }
 
-// Internal function for setting an entry (Used by ht_set and ht_extend)
-static const char* ht_set_entry(ht_entry* entries, size_t capacity, const char* key, void* value, size_t value_len, size_t* plength)
+// Returns a mask with bit i set for every control byte of a group equal to c
+static inline uint32_t group_match(const uint8_t* group, uint8_t c)
 {
-    uint32_t computed_hash = hash(key, strlen(key));
-    size_t idx = computed_hash % capacity;
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < HT_GROUP; ++i) mask |= (uint32_t)(group[i] == c) << i;
+    return mask;
+#endif
+}
 
-    while (entries[idx].key != NULL)
-    {
-        if (strcmp(entries[idx].key, key) == 0)
-        {
-            warn_collision(key);
-            
-            // Allocate new memory first
-            void* new_val = malloc(value_len);
-            if (!new_val) return NULL;
-            memcpy(new_val, value, value_len);
-
-            // Free old memory
-            free(entries[idx].value);
-
-            // Update entry
-            entries[idx].value = new_val;
-            entries[idx].vlen = value_len; // Update stored length
-            return entries[idx].key;
+// Returns a mask with bit i set for every empty or deleted slot of a group
+static inline uint32_t group_match_free(const uint8_t* group)
+{
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < HT_GROUP; ++i) mask |= (uint32_t)(group[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+// Tables are filled up to 7/8 of their slots
+static size_t max_load(size_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+static size_t round_capacity(size_t capacity)
+{
+    size_t ret = HT_GROUP;
+    while (ret < capacity) ret *= 2;
+    return ret;
+}
+
+static void* slab_alloc(ht_slab* slab)
+{
+    void* ret = slab->free;
+    if (ret != NULL) {
+        slab->free = *(void**)ret;
+        return ret;
+    }
+
+    if (slab->chunks == NULL || slab->used == HT_SLAB_CELLS) {
+        uint8_t* chunk = malloc(HT_SLAB_HDR + HT_SLAB_CELLS * slab->cell);
+        if (!chunk) return NULL;
+
+        *(uint8_t**)chunk = slab->chunks;
+        slab->chunks = chunk;
+        slab->used = 0;
+    }
+
+    return slab->chunks + HT_SLAB_HDR + slab->used++ * slab->cell;
+}
+
+static void slab_free(ht_slab* slab, void* cell)
+{
+    *(void**)cell = slab->free;
+    slab->free = cell;
+}
+
+static void slab_destroy(ht_slab* slab)
+{
+    uint8_t* chunk = slab->chunks;
+    while (chunk != NULL) {
+        uint8_t* prev = *(uint8_t**)chunk;
+        free(chunk);
+        chunk = prev;
+    }
+}
+
+// Copies a value into storage owned by the table, returns NULL if out of memory
+static void* value_alloc(ht* table, const void* value, size_t value_len)
+{
+    void* ret = (table->value_size != 0) ? slab_alloc(&table->slab) : malloc(value_len);
+    if (ret) memcpy(ret, value, value_len);
+    return ret;
+}
+
+static void value_free(ht* table, void* value)
+{
+    if (table->value_size != 0) slab_free(&table->slab, value);
+    else free(value);
+}
+
+// Returns the slot holding key, or capacity if there is none
+static size_t slots_find(const ht_slots* slots, bool u64_keys, ht_key key, uint32_t h)
+{
+    size_t gmask = slots->capacity / HT_GROUP - 1;
+    size_t g = hash_h1(h) & gmask;
+
+    for (size_t step = 1; ; ++step) {
+        const uint8_t* group = &slots->ctrl[g * HT_GROUP];
+
+        for (uint32_t m = group_match(group, hash_h2(h)); m != 0; m &= m - 1) {
+            size_t idx = g * HT_GROUP + (size_t)__builtin_ctz(m);
+            const ht_entry* e = &slots->entries[idx];
+            if (e->hash != h) continue;
+            if (u64_keys ? e->key.u64 == key.u64 : strcmp(e->key.str, key.str) == 0) return idx;
         }
-        idx++;
-        if (idx >= capacity)
+        if (group_match(group, HT_CTRL_EMPTY) != 0) return slots->capacity;
+
+        g = (g + step) & gmask;
+    }
+}
+
+// Returns the first empty or deleted slot on the probe sequence of a hash. The arrays always have one.
+static size_t slots_find_free(const ht_slots* slots, uint32_t h)
+{
+    size_t gmask = slots->capacity / HT_GROUP - 1;
+    size_t g = hash_h1(h) & gmask;
+
+    for (size_t step = 1; ; ++step) {
+        uint32_t m = group_match_free(&slots->ctrl[g * HT_GROUP]);
+        if (m != 0) return g * HT_GROUP + (size_t)__builtin_ctz(m);
+
+        g = (g + step) & gmask;
+    }
+}
+
+// Frees the entry of a slot and marks the slot free. Returns true if the slot went back to empty.
+static bool slots_erase(ht* table, ht_slots* slots, size_t idx)
+{
+    ht_entry* e = &slots->entries[idx];
+    if (!table->u64_keys) free(e->key.str);
+    value_free(table, e->value);
+    e->key.u64 = 0;
+    e->value = NULL;
+
+    // A group that still has an empty slot never overflowed, so no probe sequence runs past it and
+    // the slot can go back to empty. Otherwise it has to stay a tombstone.
+    if (group_match(&slots->ctrl[idx - idx % HT_GROUP], HT_CTRL_EMPTY) != 0) {
+        slots->ctrl[idx] = HT_CTRL_EMPTY;
+        return true;
+    }
+
+    slots->ctrl[idx] = HT_CTRL_DELETED;
+    return false;
+}
+
+static int slots_alloc(ht_slots* slots, size_t capacity)
+{
+    slots->ctrl = malloc(capacity);
+    slots->entries = malloc(capacity * sizeof(ht_entry));
+    if (!slots->ctrl || !slots->entries) {
+        free(slots->ctrl);
+        free(slots->entries);
+        slots->ctrl = NULL;
+        return -1;
+    }
+
+    memset(slots->ctrl, HT_CTRL_EMPTY, capacity);
+    slots->capacity = capacity;
+
+    return 0;
+}
+
+// Moves up to n slots of old over to cur and drops old once all of them are
+//
+// Only the entry structs are moved, the keys and values stay where they are on the heap and the keys
+// are placed by their cached hashes. The slots they land on were accounted for in growth_left when
+// the resize started.
+static void ht_migrate(ht* table, size_t n)
+{
+    ht_slots* old = &table->old;
+    if (old->ctrl == NULL) return;
+
+    size_t end = (n < old->capacity - table->migrated) ? table->migrated + n : old->capacity;
+    for (size_t i = table->migrated; i < end; ++i) {
+        if (old->ctrl[i] & 0x80) continue;
+
+        uint32_t h = old->entries[i].hash;
+        size_t idx = slots_find_free(&table->cur, h);
+        table->cur.ctrl[idx] = hash_h2(h);
+        table->cur.entries[idx] = old->entries[i];
+        old->ctrl[i] = HT_CTRL_DELETED;
+    }
+    table->migrated = end;
+
+    if (table->migrated == old->capacity) {
+        free(old->ctrl);
+        free(old->entries);
+        old->ctrl = NULL;
+        old->entries = NULL;
+    }
+}
+
+// Starts moving the table to fresh arrays of a capacity, which also drops all tombstones
+static int ht_resize(ht* table, size_t capacity)
+{
+    // A resize still under way is finished first
+    ht_migrate(table, SIZE_MAX);
+
+    ht_slots fresh;
+    if (slots_alloc(&fresh, capacity) < 0) return -1;
+
+    table->old = table->cur;
+    table->cur = fresh;
+    table->migrated = 0;
+    table->growth_left = max_load(capacity) - table->size;
+
+    return 0;
+}
+
+// Finds the slot holding a key in cur or, while a resize is under way, in old. Returns its index in
+// the arrays set to slots, or SIZE_MAX if there is none.
+static size_t ht_lookup(ht* table, ht_key key, uint32_t h, ht_slots** slots)
+{
+    *slots = &table->cur;
+    size_t idx = slots_find(&table->cur, table->u64_keys, key, h);
+    if (idx != table->cur.capacity) return idx;
+    if (table->old.ctrl == NULL) return SIZE_MAX;
+
+    *slots = &table->old;
+    idx = slots_find(&table->old, table->u64_keys, key, h);
+    return (idx != table->old.capacity) ? idx : SIZE_MAX;
+}
+
+// Adds an entry for a key that is not in the table yet, taking ownership of the key and the value
+//
+// Returns the entry, or NULL if the table had to be resized and is out of memory.
+static ht_entry* ht_insert(ht* table, ht_key key, uint32_t h, void* value)
+{
+    ht_slots* slots = &table->cur;
+    size_t idx = slots_find_free(slots, h);
+    if (table->growth_left == 0 && slots->ctrl[idx] == HT_CTRL_EMPTY)
+    {
+        // Out of empty slots: double the table if it is more than half full, otherwise the slots went
+        // to tombstones and a resize to the same capacity reclaims them
+        size_t capacity = slots->capacity;
+        if (table->size >= max_load(capacity) / 2) capacity *= 2;
+
+        if (ht_resize(table, capacity) < 0) return NULL;
+        idx = slots_find_free(slots, h);
+    }
+
+    if (slots->ctrl[idx] == HT_CTRL_EMPTY) table->growth_left--;
+    slots->ctrl[idx] = hash_h2(h);
+
+    ht_entry* e = &slots->entries[idx];
+    e->key = key;
+    e->value = value;
+    e->hash = h;
+    table->size++;
+
+    return e;
+}
+
+// Stores a copy of a value under a key and sets found if the key was in the table already
+//
+// Keys that have not been migrated yet are updated where they are. In tables with a fixed value size
+// an existing value is overwritten in its cell, otherwise it is replaced by a new copy. Returns the
+// entry, or NULL if out of memory or the value is not of the fixed size.
+static ht_entry* ht_put(ht* table, ht_key key, uint32_t h, const void* value, size_t value_len, bool* found)
+{
+    if (table->value_size != 0 && value_len != table->value_size) return NULL;
+
+    ht_migrate(table, HT_MIGRATE_STEP);
+
+    ht_slots* slots;
+    size_t idx = ht_lookup(table, key, h, &slots);
+    *found = (idx != SIZE_MAX);
+    if (*found)
+    {
+        ht_entry* e = &slots->entries[idx];
+        if (table->value_size != 0)
         {
-            idx = 0;
+            memcpy(e->value, value, value_len);
+            return e;
         }
+
+        // Allocate the new copy first so that the old value survives a failure
+        void* new_val = value_alloc(table, value, value_len);
+        if (!new_val) return NULL;
+        free(e->value);
+        e->value = new_val;
+        return e;
     }
 
     // New Entry Logic
-    if (plength != NULL) 
+    void* value_cpy = value_alloc(table, value, value_len);
+    if (!value_cpy) return NULL;
+
+    if (!table->u64_keys && (key.str = strdup(key.str)) == NULL)
     {
-        (*plength)++;
+        value_free(table, value_cpy);
+        return NULL;
     }
 
-    void* value_cpy = malloc(value_len);
-    if (!value_cpy) return NULL;
-    memcpy(value_cpy, value, value_len);
+    ht_entry* e = ht_insert(table, key, h, value_cpy);
+    if (e == NULL)
+    {
+        if (!table->u64_keys) free(key.str);
+        value_free(table, value_cpy);
+    }
+
+    return e;
+}
+
+// Removes the entry of a key, if there is one
+static bool ht_remove(ht* table, ht_key key, uint32_t h)
+{
+    ht_migrate(table, HT_MIGRATE_STEP);
+
+    ht_slots* slots;
+    size_t idx = ht_lookup(table, key, h, &slots);
+    if (idx == SIZE_MAX) return false;
+
+    // Empty slots of old are never filled again, so only those of cur count towards growth_left
+    if (slots_erase(table, slots, idx) && slots == &table->cur) table->growth_left++;
+    table->size--;
+
+    return true;
+}
+
+static ht* ht_create_keyed(size_t capacity, bool u64_keys, size_t value_size)
+{
+    ht* ret = calloc(1, sizeof(ht));
+    if (!ret) return NULL;
+
+    capacity = round_capacity(capacity);
+    if (slots_alloc(&ret->cur, capacity) < 0) {
+        free(ret);
+        return NULL;
+    }
+    ret->growth_left = max_load(capacity);
+    ret->u64_keys = u64_keys;
+    ret->value_size = value_size;
 
-    entries[idx].key = strdup(key);
-    entries[idx].value = value_cpy;
-    entries[idx].vlen = value_len; // Save length
+    // Cells hold the free list pointer while unused and keep the values 8-byte aligned
+    size_t cell = (value_size + 7) & ~(size_t)7;
+    ret->slab.cell = (cell < sizeof(void*)) ? sizeof(void*) : cell;
 
-    return entries[idx].key;
+    return ret;
 }
 
 /*******************************************
@@ -98,151 +461,137 @@ static const char* ht_set_entry(ht_entry* entries, size_t capacity, const char*
 // Creates an instance of a hash table
 ht* ht_create(const size_t CAPACITY)
 {
-    ht* ret = malloc(sizeof(ht));
-    if (!ret) return NULL;
-
-    ret->size = 0;
-    ret->capacity = CAPACITY;
-    ret->entries = calloc(CAPACITY, sizeof(ht_entry));
+    return ht_create_keyed(CAPACITY, false, 0);
+}
 
-    if (!ret->entries) {
-        free(ret);
-        return NULL;
-    }
+// Creates an instance of a hash table whose values all have VALUE_SIZE bytes. The values are stored
+// in slab cells instead of allocations of their own, and ht_set rejects values of any other size.
+ht* ht_create_sized(const size_t CAPACITY, const size_t VALUE_SIZE)
+{
+    return ht_create_keyed(CAPACITY, false, VALUE_SIZE);
+}
 
-    return ret;
+// Creates an instance of a hash table keyed by integers, for use with the ht_*_u64 functions. A 
+// VALUE_SIZE other than 0 fixes the size of the values like ht_create_sized.
+ht* ht_create_u64(const size_t CAPACITY, const size_t VALUE_SIZE)
+{
+    return ht_create_keyed(CAPACITY, true, VALUE_SIZE);
 }
 
 // Frees a table to memory
-void ht_destroy(ht* table) 
+void ht_destroy(ht* table)
 {
     if (table == NULL) return;
 
-    for (size_t i = 0; i < table->capacity; ++i)
+    ht_slots* all[2] = { &table->cur, &table->old };
+    for (int s = 0; s < 2; ++s)
     {
-        if (table->entries[i].key != NULL)
+        ht_slots* slots = all[s];
+        if (slots->ctrl == NULL) continue;
+
+        for (size_t i = 0; i < slots->capacity; ++i)
         {
-            free(table->entries[i].key);
-            free(table->entries[i].value); // Free the value too!
+            if ((slots->ctrl[i] & 0x80) == 0)
+            {
+                if (!table->u64_keys) free(slots->entries[i].key.str);
+                if (table->value_size == 0) free(slots->entries[i].value); // Free the value too!
+            }
         }
+
+        free(slots->ctrl);
+        free(slots->entries);
     }
 
-    free(table->entries);
+    slab_destroy(&table->slab);
     free(table);
 }
 
-// Extends a hashmap to double its size (Pointer Move Implementation)
-void ht_extend(ht** table)
+// Presizes a table to hold n entries without resizing, e.g. at startup. The entries are moved over
+// right away, so there is no resize left under way afterwards. Returns 0, or -1 if out of memory.
+int ht_reserve(ht* table, size_t n)
 {
-    ht* old = *table;
+    if (table == NULL) return -1;
 
-    // 1. Allocate new table shell
-    ht* new_table = malloc(sizeof(ht));
-    if (!new_table) return; // Note: Caller should technically handle this failure
-
-    new_table->capacity = old->capacity * 2;
-    new_table->size = old->size; // Size remains the same
-    new_table->entries = calloc(new_table->capacity, sizeof(ht_entry));
-
-    if (!new_table->entries) {
-        free(new_table);
-        return;
-    }
-
-    // 2. MOVE pointers from old to new (Rehashing)
-    for (size_t i = 0; i < old->capacity; ++i)
-    {
-        if (old->entries[i].key == NULL) continue;
-
-        // Recalculate hash for the NEW capacity
-        uint32_t computed_hash = hash(old->entries[i].key, strlen(old->entries[i].key));
-        size_t idx = computed_hash % new_table->capacity;
-
-        // Linear probing for collisions in the NEW table
-        while (new_table->entries[idx].key != NULL) {
-            idx++;
-            if (idx >= new_table->capacity) idx = 0;
-        }
-
-        // 3. COPY THE STRUCT, NOT THE DATA
-        // We simply copy the pointers. The actual data on the heap stays where it is.
-        new_table->entries[idx] = old->entries[i]; 
-    }
+    size_t capacity = table->cur.capacity;
+    while (max_load(capacity) < n) capacity *= 2;
 
-    // 4. Free ONLY the old array wrapper, NOT the keys/values
-    free(old->entries); 
-    free(old);
+    if (capacity != table->cur.capacity && ht_resize(table, capacity) < 0) return -1;
+    ht_migrate(table, SIZE_MAX);
 
-    *table = new_table;
+    return 0;
 }
 
 // Public function for setting entries in a hash table
-const char* ht_set(ht** ptable, const char* key, void* value, size_t value_len) 
+const char* ht_set(ht** ptable, const char* key, void* value, size_t value_len)
 {
     if (ptable == NULL || *ptable == NULL || key == NULL || value == NULL) return NULL;
 
     ht* table = *ptable;
+    if (table->u64_keys) return NULL;
 
-    // Resize if load factor >= 0.5
-    if (table->size >= table->capacity / 2) 
-    {
-        ht_extend(ptable);
-        table = *ptable; // Update local pointer
-    }
+    ht_key k = { .str = (char*)key };
+    bool found;
+    ht_entry* e = ht_put(table, k, hash(key, strlen(key)), value, value_len, &found);
+    if (e == NULL) return NULL;
+    if (found) warn_collision(key);
 
-    return ht_set_entry(table->entries, table->capacity, key, value, value_len, &table->size);
+    return e->key.str;
 }
 
-// Gets a value with a matching key if present
-void* ht_get(ht* table, const char* key)
+// Sets the entry of an integer key, replacing the value of an existing one. Returns false if out of
+// memory or the value is not of the fixed size of the table.
+bool ht_set_u64(ht* table, uint64_t key, const void* value, size_t value_len)
 {
-    if (table == NULL || key == NULL) return NULL;
+    if (table == NULL || !table->u64_keys || value == NULL) return false;
 
-    uint32_t computed_hash = hash(key, strlen(key));
-    size_t idx = computed_hash % table->capacity;
+    ht_key k = { .u64 = key };
+    bool found;
+    return ht_put(table, k, hash_u64(key), value, value_len, &found) != NULL;
+}
 
-    while (table->entries[idx].key != NULL)
-    {
-        if (strcmp(table->entries[idx].key, key) == 0) // Found
-        {
-            return table->entries[idx].value;
-        }
-        idx++;
-        if (idx >= table->capacity) 
-        {
-            idx = 0;
-        }
-    }
+// Gets a value with a matching key if present. The pointer stays valid until the entry is deleted.
+//
+// Lookups never migrate, so concurrent readers of a table are safe as long as nobody writes to it.
+void* ht_get(ht* table, const char* key)
+{
+    if (table == NULL || key == NULL || table->u64_keys) return NULL;
+
+    ht_key k = { .str = (char*)key };
+    ht_slots* slots;
+    size_t idx = ht_lookup(table, k, hash(key, strlen(key)), &slots);
 
-    return NULL;
+    return (idx != SIZE_MAX) ? slots->entries[idx].value : NULL;
 }
 
-// Deletes the entry indexed by the key 
-const char* ht_delete(ht* table, const char* key)
+// Gets the value of an integer key if present
+void* ht_get_u64(ht* table, uint64_t key)
 {
-  if (table == NULL || key == NULL) return NULL;
-  
-  int idx = hash(key, strlen(key)) % table->capacity;
+    if (table == NULL || !table->u64_keys) return NULL;
+
+    ht_key k = { .u64 = key };
+    ht_slots* slots;
+    size_t idx = ht_lookup(table, k, hash_u64(key), &slots);
 
-  // If key doesn't exist in the first place, return NULL
-  if (table->entries[idx].key == NULL) return NULL;
+    return (idx != SIZE_MAX) ? slots->entries[idx].value : NULL;
+}
 
-  free(table->entries[idx].key); //<< otherwise, free the key
-  table->entries[idx].key = NULL;
+// Deletes the entry indexed by the key
+const char* ht_delete(ht* table, const char* key)
+{
+    if (table == NULL || key == NULL || table->u64_keys) return NULL;
 
-  // Free if the entry value is not null
-  if (table->entries[idx].value != NULL) 
-  {
-    free(table->entries[idx].value);
-    table->entries[idx].value = NULL;
-  }
-  
-  // Set the entry vlen to 0
-  table->entries[idx].vlen = 0;
+    // If key doesn't exist in the first place, return NULL
+    ht_key k = { .str = (char*)key };
+    return ht_remove(table, k, hash(key, strlen(key))) ? key : NULL;
+}
 
-  table->size--;
+// Deletes the entry of an integer key. Returns false if there was none.
+bool ht_delete_u64(ht* table, uint64_t key)
+{
+    if (table == NULL || !table->u64_keys) return false;
 
-  return key;
+    ht_key k = { .u64 = key };
+    return ht_remove(table, k, hash_u64(key));
 }
 
 size_t ht_length(ht* table) {
@@ -250,5 +599,5 @@ size_t ht_length(ht* table) {
 }
 
 size_t ht_capacity(ht* table) {
-    return table ? table->capacity : 0;
+    return table ? table->cur.capacity : 0;
 }
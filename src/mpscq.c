@@ -0,0 +1,114 @@
+#include "mpscq.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*******************************************
+* Internal Structures
+*******************************************/
+
+// Each cell carries a sequence number that tells producers and the consumer whose turn it is.
+// A cell at position pos is free for a producer when seq == pos and holds an item for the consumer
+// when seq == pos + 1.
+typedef struct {
+    size_t seq;
+    void* item;
+} mpscq_cell;
+
+// Producers and the consumer advance separate cursors, keep them on separate cache lines
+struct mpscq {
+    mpscq_cell* cells;
+    size_t mask;
+    char pad0[64];
+    size_t enq_pos;
+    char pad1[64];
+    size_t deq_pos;
+    char pad2[64];
+};
+
+/*******************************************
+* Public API
+*******************************************/
+
+// Creates a queue, the capacity is rounded up to a power of two
+mpscq* mpscq_create(const size_t CAPACITY)
+{
+    size_t capacity = 2;
+    while (capacity < CAPACITY) capacity <<= 1;
+
+    mpscq* ret = calloc(1, sizeof(mpscq));
+    if (!ret) return NULL;
+
+    ret->cells = calloc(capacity, sizeof(mpscq_cell));
+    if (!ret->cells) {
+        free(ret);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < capacity; ++i) {
+        ret->cells[i].seq = i;
+    }
+    ret->mask = capacity - 1;
+
+    return ret;
+}
+
+// Frees a queue to memory, items still queued are not freed
+void mpscq_destroy(mpscq* q)
+{
+    if (q == NULL) return;
+
+    free(q->cells);
+    free(q);
+}
+
+// Enqueues an item, safe to call from any thread
+// Returns false if the queue is full
+bool mpscq_push(mpscq* q, void* item)
+{
+    if (q == NULL) return false;
+
+    size_t pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+    mpscq_cell* cell;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            // Cell is free, claim the position
+            if (__atomic_compare_exchange_n(&q->enq_pos, &pos, pos + 1, true, 
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // Consumer has not freed this cell yet
+        } else {
+            pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->item = item;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+// Dequeues an item, must only be called from the consumer thread
+// Returns NULL if the queue is empty
+void* mpscq_pop(mpscq* q)
+{
+    if (q == NULL) return NULL;
+
+    size_t pos = q->deq_pos;
+    mpscq_cell* cell = &q->cells[pos & q->mask];
+
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) return NULL;
+
+    void* item = cell->item;
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    q->deq_pos = pos + 1;
+
+    return item;
+}
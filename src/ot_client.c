@@ -1,10 +1,15 @@
-#include "ot_context.h" 
+#include "ot_client.h" 
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <assert.h>
 #include <time.h>
 
@@ -16,43 +21,222 @@
 ////////////////////////////////////////////////////////////////////////////////
 static uint64_t cred_hash(const char* c, size_t clen);
 
+////////////////////////////////////////////////////////////////////////////////
+// PRIVATE FUNCTIONS FOR SOCKETS
+////////////////////////////////////////////////////////////////////////////////
+static int cli_connect(const int PORT, uint32_t SRV_IP);
+
+static int cli_connect_unix(const char* path);
+
+static ssize_t cli_recv(int sockfd, uint8_t* buf, size_t buflen, size_t nreplies);
+
+static ssize_t cli_transact(ot_cli_conn* conn, const int PORT, uint32_t SRV_IP, uint8_t* buf, 
+                            size_t buflen, size_t reqlen, size_t nreplies);
+
+static ssize_t cli_udp_transact(ot_cli_conn* conn, uint8_t* buf, size_t buflen, size_t reqlen, 
+                                size_t nreplies);
+
+static ssize_t cli_shm_transact(ot_cli_conn* conn, uint8_t* buf, size_t buflen, size_t reqlen, 
+                                size_t nreplies);
+
+static void cli_shm_resync(ot_cli_conn* conn);
+
 ////////////////////////////////////////////////////////////////////////////////
 // PRIVATE FUNCTIONS FOR PACKET BUILDING
 ////////////////////////////////////////////////////////////////////////////////
-static int treq_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, 
-                     uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac);
+// The reply views returned by the senders point into the caller's buf
+static int treq_send(ot_pkt_view* reply_pkt, uint8_t* buf, size_t buflen, ot_cli_conn* conn, 
+                     const int PORT, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac);
+
+static int tren_send(ot_pkt_view* reply_pkt, uint8_t* buf, size_t buflen, ot_cli_conn* conn, 
+                     const int PORT, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac);
 
-static int tren_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, 
-                     uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac);
+static ssize_t csend_build(uint8_t* buf, size_t buflen, const char* uname, const char* psk, 
+                           uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac);
 
-static int csend_send(ot_pkt** reply_pkt, const char* uname, const char* psk, const int PORT, 
-                      uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac);
+static int csend_send(ot_pkt_view* reply_pkt, uint8_t* buf, size_t buflen, ot_cli_conn* conn, 
+                      const char* uname, const char* psk, const int PORT, uint32_t SRV_IP, 
+                      uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac);
+
+////////////////////////////////////////////////////////////////////////////////
+// PRIVATE FUNCTIONS FOR REPLY CHECKING
+////////////////////////////////////////////////////////////////////////////////
+static bool cval_check(const ot_pkt_view* cpush_pkt, const ot_cli_ctx* ctx, uint64_t hashed_info);
 
 ////////////////////////////////////////////////////////////////////////////////
 // PUBLIC API
 ////////////////////////////////////////////////////////////////////////////////
+ot_cli_conn* ot_cli_conn_open(const ot_cli_ctx* ctx)
+{
+  ot_cli_conn* conn = malloc(sizeof(ot_cli_conn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "ot_cli_conn_open error: out of memory\n");
+    return NULL;
+  }
+
+  conn->udp = false;
+  conn->next_id = 0;
+  conn->unix_path[0] = '\0';
+  conn->shm = NULL;
+  conn->sockfd = cli_connect(DEF_PORT, ctx->header.srv_ip);
+  if (conn->sockfd < 0)
+  {
+    free(conn);
+    return NULL;
+  }
+
+  return conn;
+}
+
+ot_cli_conn* ot_cli_conn_open_udp(const ot_cli_ctx* ctx)
+{
+  ot_cli_conn* conn = malloc(sizeof(ot_cli_conn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "ot_cli_conn_open_udp error: out of memory\n");
+    return NULL;
+  }
+
+  if ((conn->sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0) 
+  {
+    perror("socket failed");
+    free(conn);
+    return NULL;
+  }
+
+  // Connecting fixes the peer, so datagrams from anyone but the server are filtered out by the kernel
+  struct sockaddr_in serv_addr;
+  memset(&serv_addr, 0, sizeof(serv_addr));
+  serv_addr.sin_family = AF_INET;
+  serv_addr.sin_port = htons(DEF_PORT);
+  serv_addr.sin_addr.s_addr = ctx->header.srv_ip;
+
+  if (connect(conn->sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) 
+  {
+    perror("connect failed");
+    close(conn->sockfd);
+    free(conn);
+    return NULL;
+  }
+
+  // Start somewhere unpredictable so that a restarted client does not reuse the ids of its last run
+  conn->udp = true;
+  conn->next_id = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+  conn->unix_path[0] = '\0';
+  conn->shm = NULL;
+
+  return conn;
+}
+
+ot_cli_conn* ot_cli_conn_open_unix(const char* path)
+{
+  if (path == NULL || strlen(path) >= CLI_UNIX_PATH_MAX)
+  {
+    fprintf(stderr, "ot_cli_conn_open_unix error: invalid socket path\n");
+    return NULL;
+  }
+
+  ot_cli_conn* conn = malloc(sizeof(ot_cli_conn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "ot_cli_conn_open_unix error: out of memory\n");
+    return NULL;
+  }
+
+  conn->udp = false;
+  conn->next_id = 0;
+  strcpy(conn->unix_path, path);
+  conn->shm = NULL;
+  conn->sockfd = cli_connect_unix(path);
+  if (conn->sockfd < 0)
+  {
+    free(conn);
+    return NULL;
+  }
+
+  return conn;
+}
+
+ot_cli_conn* ot_cli_conn_open_shm(const char* path)
+{
+  ot_cli_conn* conn = malloc(sizeof(ot_cli_conn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "ot_cli_conn_open_shm error: out of memory\n");
+    return NULL;
+  }
+
+  conn->sockfd = -1;
+  conn->udp = false;
+  conn->next_id = 0;
+  conn->unix_path[0] = '\0';
+  if ((conn->shm = shmring_attach(path)) == NULL)
+  {
+    fprintf(stderr, "ot_cli_conn_open_shm error: no shared memory ring at %s\n", path);
+    free(conn);
+    return NULL;
+  }
+  if ((conn->shm_chan = shmring_claim(conn->shm, CLI_SHM_TIMEOUT_MS)) < 0)
+  {
+    fprintf(stderr, "ot_cli_conn_open_shm error: no free channel on %s\n", path);
+    shmring_destroy(conn->shm);
+    free(conn);
+    return NULL;
+  }
+
+  return conn;
+}
+
+void ot_cli_conn_close(ot_cli_conn** conn)
+{
+  if (conn == NULL || *conn == NULL) return;
+
+  if ((*conn)->sockfd >= 0) close((*conn)->sockfd);
+  if ((*conn)->shm != NULL)
+  {
+    if ((*conn)->shm_chan >= 0) shmring_release((*conn)->shm, (*conn)->shm_chan);
+    shmring_destroy((*conn)->shm);
+  }
+  free(*conn);
+  *conn = NULL;
+}
+
 bool ot_cli_auth(ot_cli_ctx* ctx)
+{
+  return ot_cli_conn_auth(NULL, ctx);
+}
+
+bool ot_cli_renew(ot_cli_ctx* ctx)
+{
+  return ot_cli_conn_renew(NULL, ctx);
+}
+
+bool ot_cli_send(ot_cli_ctx ctx, const char* uname, const char* psk)
+{
+  return ot_cli_conn_send(NULL, ctx, uname, psk);
+}
+
+bool ot_cli_conn_auth(ot_cli_conn* conn, ot_cli_ctx* ctx)
 {
   bool retval = true;
 
-  ot_pkt* tack_pkt = ot_pkt_create();
-  int res = treq_send(&tack_pkt, 
+  uint8_t buf[2048]; //<< holds the reply that tack_pkt points into
+  ot_pkt_view tack_pkt_view;
+  ot_pkt_view* tack_pkt = &tack_pkt_view;
+  int res = treq_send(tack_pkt, buf, sizeof buf, 
+                      conn,
                       DEF_PORT, 
                       ctx->header.srv_ip,
                       ctx->header.cli_ip,
                       ctx->header.srv_mac,
                       ctx->header.cli_mac
                       );
-  if (res < 0 || tack_pkt == NULL)
+  if (res < 0)
   {
     fprintf(stderr, "failed to send treq to server\n");
-    ot_pkt_destroy(&tack_pkt);
     return false;
   }
-
-  // Build parse table
-  ht* ptable = ht_create(8);
-  pl_parse_table_build(&ptable, tack_pkt->payload);
   
   // Header checks
   if (tack_pkt->header.srv_ip != ctx->header.srv_ip)
@@ -76,22 +260,22 @@ bool ot_cli_auth(ot_cli_ctx* ctx)
 
 
   // Get mandatory TACK entries
-  uint8_t* raw_pl_state = ht_get(ptable, "PL_STATE");
-  uint32_t* pl_srv_ip = ht_get(ptable, "PL_SRV_IP");
-  uint32_t* pl_cli_ip = ht_get(ptable, "PL_CLI_IP");
-  uint32_t* pl_etime = ht_get(ptable, "PL_ETIME");
-  uint32_t* pl_rtime = ht_get(ptable, "PL_RTIME");
-  uint8_t* pl_srv_mac = ht_get(ptable, "PL_SRV_MAC");
-
-  // Nullity checks
-  if (raw_pl_state == NULL) 
+  uint8_t raw_pl_state;
+  uint32_t pl_srv_ip;
+  uint32_t pl_cli_ip;
+  uint32_t pl_etime;
+  uint32_t pl_rtime;
+  const ot_payload_view* pl_srv_mac = ot_pkt_view_get(tack_pkt, PL_SRV_MAC);
+
+  // Presence checks
+  if (!ot_pkt_view_u8(tack_pkt, PL_STATE, &raw_pl_state)) 
   {
     fprintf(stderr, "ot_cli_auth error: no state payload\n");
     retval = false;
     goto cleanup;
   }
 
-  ot_cli_state_t pl_state = *raw_pl_state;
+  ot_cli_state_t pl_state = raw_pl_state;
 
   // Check if reply pkt is TACK
   if (pl_state == TINV) 
@@ -104,32 +288,32 @@ bool ot_cli_auth(ot_cli_ctx* ctx)
     retval = false;
     goto cleanup;
   }
-  if (pl_srv_ip == NULL) 
+  if (!ot_pkt_view_u32(tack_pkt, PL_SRV_IP, &pl_srv_ip)) 
   {
     fprintf(stderr, "ot_cli_auth error: no srv ip payload\n");
     retval = false;
     goto cleanup;
   }
 
-  if (pl_cli_ip == NULL) 
+  if (!ot_pkt_view_u32(tack_pkt, PL_CLI_IP, &pl_cli_ip)) 
   {
     fprintf(stderr, "ot_cli_auth error: no cli ip payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_etime == NULL) 
+  if (!ot_pkt_view_u32(tack_pkt, PL_ETIME, &pl_etime)) 
   {
     fprintf(stderr, "ot_cli_auth error: no etime payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_rtime == NULL) 
+  if (!ot_pkt_view_u32(tack_pkt, PL_RTIME, &pl_rtime)) 
   {
     fprintf(stderr, "ot_cli_auth error: no rtime payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_srv_mac == NULL) 
+  if (pl_srv_mac == NULL || pl_srv_mac->vlen < 6) 
   {
     fprintf(stderr, "ot_cli_auth error: no srv_mac payload\n");
     retval = false;
@@ -138,31 +322,31 @@ bool ot_cli_auth(ot_cli_ctx* ctx)
 
 
   // Header comparison
-  if (*pl_srv_ip != tack_pkt->header.srv_ip) 
+  if (pl_srv_ip != tack_pkt->header.srv_ip) 
   {
     fprintf(stderr, "ot_cli_auth error: srv ip payload mismatch with header\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_cli_ip != tack_pkt->header.cli_ip)
+  if (pl_cli_ip != tack_pkt->header.cli_ip)
   {
     fprintf(stderr, "ot_cli_auth error: cli ip payload mismatch with header\n");
     retval = false;
     goto cleanup;
   }
-  if (memcmp(pl_srv_mac, tack_pkt->header.srv_mac, 6) != 0) 
+  if (memcmp(pl_srv_mac->value, tack_pkt->header.srv_mac, 6) != 0) 
   {
     fprintf(stderr, "ot_cli_auth error: srv mac payload mismatch with header\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_etime == 0)
+  if (pl_etime == 0)
   {
     fprintf(stderr, "ot_cli_auth error: improper exp time (<=0)\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_rtime == 0)
+  if (pl_rtime == 0)
   {
     fprintf(stderr, "ot_cli_auth error: improper renew time (<=0)\n");
     retval = false;
@@ -176,45 +360,41 @@ bool ot_cli_auth(ot_cli_ctx* ctx)
   time(&now); 
 
   // Update client context header info
-  ctx->header.exp_time = *pl_etime;
-  ctx->header.renew_time = *pl_rtime;
+  ctx->header.exp_time = pl_etime;
+  ctx->header.renew_time = pl_rtime;
 
   // Update timestamps for expiry and renewal
-  ctx->ctx_exp_time = now + *pl_etime;
-  ctx->ctx_renew_time = now + *pl_rtime;
+  ctx->ctx_exp_time = now + pl_etime;
+  ctx->ctx_renew_time = now + pl_rtime;
 
   // Replace server mac 
-  memcpy(ctx->header.srv_mac, pl_srv_mac, 6);
+  memcpy(ctx->header.srv_mac, pl_srv_mac->value, 6);
 
 cleanup:
-  ot_pkt_destroy(&tack_pkt);
-  ht_destroy(ptable);
-  ptable = NULL;
   return retval;
 }
 
-bool ot_cli_renew(ot_cli_ctx* ctx)
+bool ot_cli_conn_renew(ot_cli_conn* conn, ot_cli_ctx* ctx)
 {
   bool retval = true;
 
-  ot_pkt* tprv_pkt = ot_pkt_create();
-  int res = tren_send(&tprv_pkt, 
+  uint8_t buf[2048]; //<< holds the reply that tprv_pkt points into
+  ot_pkt_view tprv_pkt_view;
+  ot_pkt_view* tprv_pkt = &tprv_pkt_view;
+  int res = tren_send(tprv_pkt, buf, sizeof buf, 
+                      conn,
                       DEF_PORT, 
                       ctx->header.srv_ip,
                       ctx->header.cli_ip,
                       ctx->header.srv_mac,
                       ctx->header.cli_mac
                       );
-  if (res < 0 || tprv_pkt == NULL)
+  if (res < 0)
   {
     fprintf(stderr, "failed to send treq to server\n");
     retval = false;
     return retval;
   }
-
-  // Build parse table
-  ht* ptable = ht_create(8);
-  pl_parse_table_build(&ptable, tprv_pkt->payload);
   
   // Header checks
   if (tprv_pkt->header.srv_ip != ctx->header.srv_ip)
@@ -238,45 +418,45 @@ bool ot_cli_renew(ot_cli_ctx* ctx)
 
 
   // Get mandatory TACK entries
-  uint8_t* raw_pl_state = ht_get(ptable, "PL_STATE");
-  uint32_t* pl_srv_ip = ht_get(ptable, "PL_SRV_IP");
-  uint32_t* pl_cli_ip = ht_get(ptable, "PL_CLI_IP");
-  uint32_t* pl_etime = ht_get(ptable, "PL_ETIME");
-  uint32_t* pl_rtime = ht_get(ptable, "PL_RTIME");
-
-  // Nullity checks
-  if (raw_pl_state == NULL) 
+  uint8_t raw_pl_state;
+  uint32_t pl_srv_ip;
+  uint32_t pl_cli_ip;
+  uint32_t pl_etime;
+  uint32_t pl_rtime;
+
+  // Presence checks
+  if (!ot_pkt_view_u8(tprv_pkt, PL_STATE, &raw_pl_state)) 
   {
     fprintf(stderr, "ot_cli_renew error: no state payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_srv_ip == NULL) 
+  if (!ot_pkt_view_u32(tprv_pkt, PL_SRV_IP, &pl_srv_ip)) 
   {
     fprintf(stderr, "ot_cli_renew error: no srv ip payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_cli_ip == NULL) 
+  if (!ot_pkt_view_u32(tprv_pkt, PL_CLI_IP, &pl_cli_ip)) 
   {
     fprintf(stderr, "ot_cli_renew error: no cli ip payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_etime == NULL) 
+  if (!ot_pkt_view_u32(tprv_pkt, PL_ETIME, &pl_etime)) 
   {
     fprintf(stderr, "ot_cli_renew error: no etime payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_rtime == NULL) 
+  if (!ot_pkt_view_u32(tprv_pkt, PL_RTIME, &pl_rtime)) 
   {
     fprintf(stderr, "ot_cli_renew error: no rtime payload\n");
     retval = false;
     goto cleanup;
   }
 
-  ot_cli_state_t pl_state = *raw_pl_state;
+  ot_cli_state_t pl_state = raw_pl_state;
 
   // Check if reply is TPRV
   if (pl_state != TPRV) 
@@ -287,37 +467,37 @@ bool ot_cli_renew(ot_cli_ctx* ctx)
   }
 
   // Header comparison
-  if (*pl_srv_ip != tprv_pkt->header.srv_ip) 
+  if (pl_srv_ip != tprv_pkt->header.srv_ip) 
   {
     fprintf(stderr, "ot_cli_renew error: srv ip payload mismatch with header\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_cli_ip != tprv_pkt->header.cli_ip)
+  if (pl_cli_ip != tprv_pkt->header.cli_ip)
   {
     fprintf(stderr, "ot_cli_renew error: cli ip payload mismatch with header\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_etime == tprv_pkt->header.exp_time)
+  if (pl_etime == tprv_pkt->header.exp_time)
   {
     fprintf(stderr, "ot_cli_renew error: exp time payload mismatch with header\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_rtime == tprv_pkt->header.renew_time)
+  if (pl_rtime == tprv_pkt->header.renew_time)
   {
     fprintf(stderr, "ot_cli_renew error: renew time payload mismatch with header\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_etime == 0)
+  if (pl_etime == 0)
   {
     fprintf(stderr, "ot_cli_renew error: improper exp time (<=0)\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_rtime == 0)
+  if (pl_rtime == 0)
   {
     fprintf(stderr, "ot_cli_renew error: improper renew time (<=0)\n");
     retval = false;
@@ -331,25 +511,26 @@ bool ot_cli_renew(ot_cli_ctx* ctx)
   time(&now); 
 
   // Update client context header info
-  ctx->header.exp_time = *pl_etime;
-  ctx->header.renew_time = *pl_rtime;
+  ctx->header.exp_time = pl_etime;
+  ctx->header.renew_time = pl_rtime;
 
   // Update timestamps for expiry and renewal
-  ctx->ctx_exp_time = now + *pl_etime;
-  ctx->ctx_renew_time = now + *pl_rtime;
+  ctx->ctx_exp_time = now + pl_etime;
+  ctx->ctx_renew_time = now + pl_rtime;
 
 cleanup:
-  ot_pkt_destroy(&tprv_pkt);
-  ht_destroy(ptable);
-  ptable = NULL;
   return retval;
 }
 
-bool ot_cli_send(ot_cli_ctx ctx, const char* uname, const char* psk)
+bool ot_cli_conn_send(ot_cli_conn* conn, ot_cli_ctx ctx, const char* uname, const char* psk)
 {
-  bool retval = true;
-  ot_pkt* cpush_pkt = ot_pkt_create();
-  int res = csend_send(&cpush_pkt, 
+  uint8_t buf[2048]; //<< holds the reply that cpush_pkt points into
+  ot_pkt_view cpush_view;
+  ot_pkt_view* cpush_pkt = &cpush_view;
+  int res = csend_send(cpush_pkt, 
+                       buf,
+                       sizeof buf,
+                       conn,
                        uname,
                        psk,
                        DEF_PORT, 
@@ -360,32 +541,101 @@ bool ot_cli_send(ot_cli_ctx ctx, const char* uname, const char* psk)
 
   uint64_t hashed_info = cred_hash(uname, strlen(uname)) + cred_hash(psk, strlen(psk));
 
-  if (res < 0 || cpush_pkt == NULL)
+  if (res < 0)
   {
     fprintf(stderr, "failed to send treq to server\n");
-    ot_pkt_destroy(&cpush_pkt);
-    retval = false;
-    return retval;
+    return false;
   }
 
-  // Build parse table
-  ht* ptable = ht_create(8);
-  pl_parse_table_build(&ptable, cpush_pkt->payload);
+  return cval_check(cpush_pkt, &ctx, hashed_info);
+}
+
+bool ot_cli_conn_send_batch(ot_cli_conn* conn, ot_cli_ctx ctx, const char** unames, const char** psks,
+                            size_t n, bool* results)
+{
+  uint8_t buf[4096];
+
+  for (size_t base = 0; base < n; base += CLI_PIPELINE_DEPTH)
+  {
+    size_t count = (n - base < CLI_PIPELINE_DEPTH) ? n - base : CLI_PIPELINE_DEPTH;
+
+    // Queue up the CSENDs of the window back-to-back
+    size_t reqlen = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      ssize_t bytes_serialized = csend_build(&buf[reqlen], sizeof(buf) - reqlen, 
+                                             unames[base + i], psks[base + i], 
+                                             ctx.header.srv_ip, ctx.header.cli_ip, 
+                                             ctx.header.srv_mac, ctx.header.cli_mac);
+      if (bytes_serialized < 0) return false;
+      reqlen += (size_t)bytes_serialized;
+    }
+
+    ssize_t bytes_received = cli_transact(conn, DEF_PORT, ctx.header.srv_ip, buf, sizeof(buf), 
+                                          reqlen, count);
+    if (bytes_received < 0) 
+    {
+      fprintf(stderr, "failed to send csend batch to server\n");
+      return false;
+    }
+
+    // Replies come back in the order of the requests
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      ssize_t frame_len = ot_pkt_frame_len(&buf[offset], (size_t)bytes_received - offset);
+      if (frame_len <= 0)
+      {
+        fprintf(stderr, "ot_cli error: server reply is not an Otter v%d frame\n", OT_WIRE_VERSION);
+        return false;
+      }
+
+      ot_pkt_view cpush_pkt;
+      const char* uname = unames[base + i];
+      const char* psk = psks[base + i];
+      uint64_t hashed_info = cred_hash(uname, strlen(uname)) + cred_hash(psk, strlen(psk));
+
+      results[base + i] = ot_pkt_view_parse(&cpush_pkt, &buf[offset], (size_t)frame_len) >= 0 &&
+                          cval_check(&cpush_pkt, &ctx, hashed_info);
+
+      offset += (size_t)frame_len;
+    }
+  }
+
+  return true;
+}
+
+static uint64_t cred_hash(const char* c, size_t clen) {
+  uint64_t retval = 0;
+
+  size_t i=0;
+  for(;i<clen;++i)
+  {
+    retval += (uint64_t)c[i];
+  }
+
+  return retval;
+}
+
+// Checks that a reply pkt is a CVAL from the server of the context for the hashed credentials
+static bool cval_check(const ot_pkt_view* cpush_pkt, const ot_cli_ctx* ctx, uint64_t hashed_info)
+{
+  bool retval = true;
   
   // Header checks
-  if (cpush_pkt->header.srv_ip != ctx.header.srv_ip)
+  if (cpush_pkt->header.srv_ip != ctx->header.srv_ip)
   {
     fprintf(stderr, "ot_cli_send error: cpush did not come from intended srv ip\n");
     retval = false;
     goto cleanup;
   }
-  if (cpush_pkt->header.cli_ip != ctx.header.cli_ip)
+  if (cpush_pkt->header.cli_ip != ctx->header.cli_ip)
   {
     fprintf(stderr, "ot_cli_pull error: inbound cpush was not for this client ip\n");
     retval = false;
     goto cleanup;
   }
-  if (memcmp(cpush_pkt->header.cli_mac, ctx.header.cli_mac, 6) != 0)
+  if (memcmp(cpush_pkt->header.cli_mac, ctx->header.cli_mac, 6) != 0)
   {
     fprintf(stderr, "ot_cli_pull error: inbound cpush was not for this client mac\n");
     retval = false;
@@ -394,38 +644,38 @@ bool ot_cli_send(ot_cli_ctx ctx, const char* uname, const char* psk)
 
 
   // Get mandatory CPUSH entries
-  uint8_t* raw_pl_state = ht_get(ptable, "PL_STATE");
-  uint32_t* pl_srv_ip = ht_get(ptable, "PL_SRV_IP");
-  uint32_t* pl_cli_ip = ht_get(ptable, "PL_CLI_IP");
-  uint64_t* pl_hash = ht_get(ptable, "PL_HASH");
+  uint8_t raw_pl_state;
+  uint32_t pl_srv_ip;
+  uint32_t pl_cli_ip;
+  uint64_t pl_hash;
 
-  // Nullity checks
-  if (raw_pl_state == NULL) 
+  // Presence checks
+  if (!ot_pkt_view_u8(cpush_pkt, PL_STATE, &raw_pl_state)) 
   {
     fprintf(stderr, "ot_cli_auth error: no pl_state payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_srv_ip == NULL) 
+  if (!ot_pkt_view_u32(cpush_pkt, PL_SRV_IP, &pl_srv_ip)) 
   {
     fprintf(stderr, "ot_cli_auth error: no srv ip payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_cli_ip == NULL) 
+  if (!ot_pkt_view_u32(cpush_pkt, PL_CLI_IP, &pl_cli_ip)) 
   {
     fprintf(stderr, "ot_cli_auth error: no cli ip payload\n");
     retval = false;
     goto cleanup;
   }
-  if (pl_hash == NULL) 
+  if (!ot_pkt_view_u64(cpush_pkt, PL_HASH, &pl_hash)) 
   {
     fprintf(stderr, "ot_cli_auth error: no hash payload\n");
     retval = false;
     goto cleanup;
   }
 
-  ot_cli_state_t pl_state = *raw_pl_state;
+  ot_cli_state_t pl_state = raw_pl_state;
 
   // Check if reply pkt is CINV or invalid. Return false 
   if (pl_state != CVAL) 
@@ -442,13 +692,13 @@ bool ot_cli_send(ot_cli_ctx ctx, const char* uname, const char* psk)
   } 
 
   // Header comparison / credential sanity checks
-  if (*pl_srv_ip != cpush_pkt->header.srv_ip) 
+  if (pl_srv_ip != cpush_pkt->header.srv_ip) 
   {
     fprintf(stderr, "ot_cli_csend error: srv ip payload mismatch with header\n");
     retval = false;
     goto cleanup;
   }
-  if (*pl_cli_ip != cpush_pkt->header.cli_ip)
+  if (pl_cli_ip != cpush_pkt->header.cli_ip)
   {
     fprintf(stderr, "ot_cli_csend error: cli ip payload mismatch with header\n");
     retval = false;
@@ -456,7 +706,7 @@ bool ot_cli_send(ot_cli_ctx ctx, const char* uname, const char* psk)
   }
 
   // Check if the payload is actually for the intended uname
-  if (*pl_hash != hashed_info) 
+  if (pl_hash != hashed_info) 
   {
     fprintf(stderr, "ot_cli_csend error: inbound hash does not match the intended hash\n");
     retval = false;
@@ -464,83 +714,12 @@ bool ot_cli_send(ot_cli_ctx ctx, const char* uname, const char* psk)
   }
 
 cleanup:
-  ot_pkt_destroy(&cpush_pkt);
-  ht_destroy(ptable);
-  ptable = NULL;
-
-  return retval;
-}
-
-static uint64_t cred_hash(const char* c, size_t clen) {
-  uint64_t retval = 0;
-
-  size_t i=0;
-  for(;i<clen;++i)
-  {
-    retval += (uint64_t)c[i];
-  }
-
   return retval;
 }
 
-static int treq_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, 
-                          uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac)
+// Opens a TCP connection to the server, returns the socket or -1
+static int cli_connect(const int PORT, uint32_t SRV_IP)
 {
-  // Build TREQ header 
-  ot_pkt_header treq_hd = ot_pkt_header_create(SRV_IP, CLI_IP,  srv_mac, cli_mac, 0, 0);
-
-  // Build TREQ pkt
-  ot_pkt* treq_pkt = ot_pkt_create();
-  treq_pkt->header = treq_hd;
-
-  // Specify TREQ state payload
-  uint8_t pl_state_type = (uint8_t)PL_STATE; //<< state to indicate that we are sending a TREQ packet
-  uint8_t pl_state_value = (uint8_t)TREQ; 
-  uint8_t pl_state_vlen = (uint8_t)sizeof(pl_state_value);
-
-  ot_payload* pl_state_payload = ot_payload_create(pl_state_type, &pl_state_value, pl_state_vlen);
-
-  // Specify TREQ srv_ip payload 
-  uint8_t pl_srv_ip_type = (uint8_t)PL_SRV_IP;
-  uint32_t pl_srv_ip_value = SRV_IP;
-  uint8_t pl_srv_ip_vlen = (uint8_t)sizeof(pl_srv_ip_value);
-
-  ot_payload* pl_srv_ip_payload = ot_payload_create(pl_srv_ip_type, &pl_srv_ip_value, pl_srv_ip_vlen);
-
-  // Specify TREQ cli_ip payload 
-  uint8_t pl_cli_ip_type = (uint8_t)PL_CLI_IP;
-  uint32_t pl_cli_ip_value = CLI_IP;
-  uint8_t pl_cli_ip_vlen = (uint8_t)sizeof(pl_cli_ip_value);
-
-  ot_payload* pl_cli_ip_payload = ot_payload_create(pl_cli_ip_type, &pl_cli_ip_value, pl_cli_ip_vlen);
-
-  // Specify TREQ cli_mac payload
-
-  uint8_t pl_cli_mac_type = (uint8_t)PL_CLI_MAC;
-  uint8_t pl_cli_mac_value[6] = {0}; 
-
-  memcpy(pl_cli_mac_value, cli_mac, 6);
-
-  uint8_t pl_cli_mac_vlen = (uint8_t)sizeof(cli_mac);
-
-  ot_payload* pl_cli_mac_payload = ot_payload_create(pl_cli_mac_type, &pl_cli_mac_value, pl_cli_mac_vlen);
-
-  // Create payload list in TREQ pkt
-  treq_pkt->payload = ot_payload_append(treq_pkt->payload, pl_state_payload);
-  treq_pkt->payload = ot_payload_append(treq_pkt->payload, pl_srv_ip_payload);
-  treq_pkt->payload = ot_payload_append(treq_pkt->payload, pl_cli_ip_payload);
-  treq_pkt->payload = ot_payload_append(treq_pkt->payload, pl_cli_mac_payload);
-
-  // Serialize TREQ pkt
-  ssize_t bytes_serialized = 0;
-  uint8_t buf[2048] = {0xff}; //<< pre-set with 0xFF terminator
-  if ( (bytes_serialized = ot_pkt_serialize(treq_pkt, buf, sizeof buf)) < 0) 
-  {
-    printf("serialization failed\n");
-    return -1;
-  } 
-  
-  // Begin TCP send
   int sockfd = 0;
   struct sockaddr_in serv_addr;
   
@@ -550,237 +729,431 @@ static int treq_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP,
     return -1;
   }
   
+  memset(&serv_addr, 0, sizeof(serv_addr));
   serv_addr.sin_family = AF_INET;
   serv_addr.sin_port = htons(PORT);
   serv_addr.sin_addr.s_addr = SRV_IP;
 
   if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-    printf("FAILED\n");
+    perror("connect failed");
+    close(sockfd);
     return -1;
   } 
 
-  // Send the serialized TREQ to server
-  if (send(sockfd, buf, bytes_serialized, 0) < 0) 
+  return sockfd;
+}
+
+static int cli_connect_unix(const char* path)
+{
+  int sockfd = 0;
+  struct sockaddr_un serv_addr;
+
+  if ((sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) 
   {
-    perror("send failed");
+    perror("socket failed");
     return -1;
   }
 
-  ssize_t bytes_received;
-  // Wait for reply
-  if ((bytes_received = read(sockfd, buf, sizeof buf)) < 0) 
-  {
-    perror("read failed");
+  memset(&serv_addr, 0, sizeof(serv_addr));
+  serv_addr.sun_family = AF_UNIX;
+  strncpy(serv_addr.sun_path, path, sizeof(serv_addr.sun_path) - 1);
+
+  if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+    perror("unix connect failed");
+    close(sockfd);
     return -1;
-  } 
+  }
+
+  return sockfd;
+}
 
-  memset(&buf[bytes_received], 0xff, sizeof(buf) - bytes_received);
+// Reads from a socket into buf until the frames of nreplies pkts are complete
+//
+// Returns the number of bytes read, or -1 if the server closed the connection, sent more than fits in
+// buf, or does not speak this wire version.
+static ssize_t cli_recv(int sockfd, uint8_t* buf, size_t buflen, size_t nreplies)
+{
+  size_t len = 0;
+  size_t offset = 0;
+  size_t complete = 0;
 
-  // Finally, deserialize reply
-  if (ot_pkt_deserialize(*reply_pkt, buf, sizeof buf) < 0) 
+  while (complete < nreplies)
   {
-    printf("deserialization failed\n");
-    printf("FAILED\n");
-    return -1;
-  } 
+    if (len == buflen) return -1;
 
-  // Free the pkt we used for sending the TREQ
-  ot_pkt_destroy(&treq_pkt);
+    ssize_t bytes_received = read(sockfd, &buf[len], buflen - len);
+    if (bytes_received < 0 && errno == EINTR) continue;
+    if (bytes_received <= 0) return -1;
+    len += (size_t)bytes_received;
 
-  close(sockfd);
+    while (complete < nreplies)
+    {
+      ssize_t frame_len = ot_pkt_frame_len(&buf[offset], len - offset);
+      if (frame_len == 0) break;
+      if (frame_len < 0)
+      {
+        fprintf(stderr, "ot_cli error: server reply is not an Otter v%d frame\n", OT_WIRE_VERSION);
+        return -1;
+      }
+
+      offset += (size_t)frame_len;
+      ++complete;
+    }
+  }
 
-  return 1;
+  return (ssize_t)len;
 }
 
+// Sends serialized requests (reqlen bytes of buf) and reads their nreplies replies back into buf
+//
+// Without a persistent connection (conn == NULL), a connection is opened for these requests only. A 
+// persistent connection that the server has closed in the meantime (e.g. after its idle timeout) is 
+// reopened once. Returns the number of reply bytes, or -1 on error.
+static ssize_t cli_transact(ot_cli_conn* conn, const int PORT, uint32_t SRV_IP, uint8_t* buf, 
+                            size_t buflen, size_t reqlen, size_t nreplies)
+{
+  if (conn == NULL)
+  {
+    int sockfd = cli_connect(PORT, SRV_IP);
+    if (sockfd < 0) return -1;
+
+    ssize_t bytes_received = -1;
+    if (send(sockfd, buf, reqlen, MSG_NOSIGNAL) < 0) 
+    {
+      perror("send failed");
+    } else if ((bytes_received = cli_recv(sockfd, buf, buflen, nreplies)) < 0) {
+      fprintf(stderr, "ot_cli error: no reply from server\n");
+    }
+
+    close(sockfd);
+    return bytes_received;
+  }
+
+  if (conn->udp) return cli_udp_transact(conn, buf, buflen, reqlen, nreplies);
+  if (conn->shm != NULL) return cli_shm_transact(conn, buf, buflen, reqlen, nreplies);
+
+  for (int attempt = 0; attempt < 2; ++attempt)
+  {
+    bool reused = conn->sockfd >= 0;
+    if (!reused)
+    {
+      conn->sockfd = conn->unix_path[0] ? cli_connect_unix(conn->unix_path) : cli_connect(PORT, SRV_IP);
+      if (conn->sockfd < 0) return -1;
+    }
+
+    ssize_t bytes_received = -1;
+    if (send(conn->sockfd, buf, reqlen, MSG_NOSIGNAL) == (ssize_t)reqlen)
+    {
+      bytes_received = cli_recv(conn->sockfd, buf, buflen, nreplies);
+    }
+    if (bytes_received > 0) return bytes_received;
+
+    // Server went away, only a connection that sat idle is worth reopening
+    close(conn->sockfd);
+    conn->sockfd = -1;
+    if (!reused) break;
+  }
 
-static int tren_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, 
-                          uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac)
+  fprintf(stderr, "ot_cli_conn error: no reply from server\n");
+  return -1;
+}
+
+// Sends the requests (reqlen bytes of buf) of a UDP connection as one datagram each and collects their
+// nreplies replies back-to-back into buf, in the order of the requests
+//
+// Requests without a reply are retransmitted until CLI_UDP_RETRIES retransmits went unanswered. Returns 
+// the number of reply bytes, or -1 on error.
+static ssize_t cli_udp_transact(ot_cli_conn* conn, uint8_t* buf, size_t buflen, size_t reqlen, 
+                                size_t nreplies)
 {
-  // Build TREN header 
-  ot_pkt_header tren_hd = ot_pkt_header_create(SRV_IP, CLI_IP,  srv_mac, cli_mac, 0, 0);
+  if (nreplies == 0 || nreplies > CLI_PIPELINE_DEPTH) return -1;
 
-  // Build TREN pkt
-  ot_pkt* tren_pkt = ot_pkt_create();
-  tren_pkt->header = tren_hd;
+  // Split the requests at their frame boundaries
+  size_t req_off[CLI_PIPELINE_DEPTH];
+  size_t req_len[CLI_PIPELINE_DEPTH];
+  size_t offset = 0;
+  for (size_t i = 0; i < nreplies; ++i)
+  {
+    ssize_t frame_len = ot_pkt_frame_len(&buf[offset], reqlen - offset);
+    if (frame_len <= 0) return -1;
+    req_off[i] = offset;
+    req_len[i] = (size_t)frame_len;
+    offset += (size_t)frame_len;
+  }
 
-  // Specify TREN state payload
-  ot_pkt_msgtype_t pl_state_type = PL_STATE; //<< state to indicate that we are sending a TREN packet
-  uint8_t pl_state_value = (uint8_t)TREN; 
-  uint8_t pl_state_vlen = (uint8_t)sizeof(pl_state_value);
+  // The replies are collected aside, buf still holds the requests for retransmits
+  uint8_t replies[CLI_PIPELINE_DEPTH][SRV_MAX_REPLY_SIZE];
+  size_t reply_len[CLI_PIPELINE_DEPTH] = {0};
+  size_t received = 0;
 
-  ot_payload* pl_state_payload = ot_payload_create(pl_state_type, &pl_state_value, pl_state_vlen);
+  uint32_t base_id = conn->next_id;
+  conn->next_id += (uint32_t)nreplies;
 
-  // Specify TREN srv_ip payload 
-  uint8_t pl_srv_ip_type = PL_SRV_IP;
-  uint32_t pl_srv_ip_value = SRV_IP;
-  uint8_t pl_srv_ip_vlen = (uint8_t)sizeof(pl_srv_ip_value);
-  ot_payload* pl_srv_ip_payload = ot_payload_create(pl_srv_ip_type, &pl_srv_ip_value, pl_srv_ip_vlen);
+  int timeout = CLI_UDP_TIMEOUT_MS;
+  for (int attempt = 0; attempt <= CLI_UDP_RETRIES && received < nreplies; ++attempt, timeout *= 2)
+  {
+    for (size_t i = 0; i < nreplies; ++i)
+    {
+      if (reply_len[i] > 0) continue;
+
+      uint32_t id = htonl(base_id + (uint32_t)i);
+      struct iovec iov[2] = {
+        { .iov_base = &id, .iov_len = sizeof(id) },
+        { .iov_base = &buf[req_off[i]], .iov_len = req_len[i] },
+      };
+      if (writev(conn->sockfd, iov, 2) < 0 && errno != ECONNREFUSED) perror("udp send failed");
+    }
 
-  // Specify TREN cli_ip payload 
-  uint8_t pl_cli_ip_type = PL_CLI_IP;
-  uint32_t pl_cli_ip_value = CLI_IP;
-  uint8_t pl_cli_ip_vlen = (uint8_t)sizeof(pl_cli_ip_value);
-  ot_payload* pl_cli_ip_payload = ot_payload_create(pl_cli_ip_type, &pl_cli_ip_value, pl_cli_ip_vlen);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-  // Specify TREN cli_mac payload 
-  uint8_t pl_cli_mac_type = PL_CLI_MAC;
+    while (received < nreplies)
+    {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      int elapsed = (int)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+      if (elapsed >= timeout) break;
+
+      struct pollfd pfd = { .fd = conn->sockfd, .events = POLLIN };
+      int ready = poll(&pfd, 1, timeout - elapsed);
+      if (ready < 0 && errno == EINTR) continue;
+      if (ready <= 0) break;
+
+      uint8_t dgram[OT_UDP_ID_SIZE + MAX_RECV_SIZE];
+      ssize_t bytes_received = recv(conn->sockfd, dgram, sizeof(dgram), 0);
+      if (bytes_received < OT_UDP_ID_SIZE) continue; //<< e.g. ECONNREFUSED while the server is down
+
+      // Drop replies to other requests, e.g. late replies to an earlier transaction
+      uint32_t id;
+      memcpy(&id, dgram, sizeof(id));
+      uint32_t i = ntohl(id) - base_id;
+      size_t len = (size_t)bytes_received - OT_UDP_ID_SIZE;
+      if (i >= nreplies || reply_len[i] > 0 || len > SRV_MAX_REPLY_SIZE) continue;
+      if (ot_pkt_frame_len(&dgram[OT_UDP_ID_SIZE], len) != (ssize_t)len) continue;
+
+      memcpy(replies[i], &dgram[OT_UDP_ID_SIZE], len);
+      reply_len[i] = len;
+      ++received;
+    }
+  }
 
-  uint8_t pl_cli_mac_value[6] = {0};
-  memcpy(pl_cli_mac_value, cli_mac, 6);
+  if (received < nreplies)
+  {
+    fprintf(stderr, "ot_cli_conn error: no reply from server over udp\n");
+    return -1;
+  }
 
-  uint8_t pl_cli_mac_vlen = (uint8_t)sizeof(pl_cli_mac_value);
-  ot_payload* pl_cli_mac_payload = ot_payload_create(pl_cli_mac_type, &pl_cli_mac_value, pl_cli_mac_vlen);
+  size_t len = 0;
+  for (size_t i = 0; i < nreplies; ++i)
+  {
+    if (len + reply_len[i] > buflen) return -1;
+    memcpy(&buf[len], replies[i], reply_len[i]);
+    len += reply_len[i];
+  }
 
+  return (ssize_t)len;
+}
 
-  // Create payload list in TREN pkt
-  tren_pkt->payload = ot_payload_append(tren_pkt->payload, pl_state_payload);
-  tren_pkt->payload = ot_payload_append(tren_pkt->payload, pl_srv_ip_payload);
-  tren_pkt->payload = ot_payload_append(tren_pkt->payload, pl_cli_ip_payload);
-  tren_pkt->payload = ot_payload_append(tren_pkt->payload, pl_cli_mac_payload);
+static int treq_send(ot_pkt_view* reply_pkt, uint8_t* buf, size_t buflen, ot_cli_conn* conn, 
+                     const int PORT, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac)
+{
+  // Build TREQ header 
+  ot_pkt_header treq_hd = ot_pkt_header_create(SRV_IP, CLI_IP,  srv_mac, cli_mac, 0, 0);
 
-  // Serialize TREN pkt
-  ssize_t bytes_serialized = 0;
-  uint8_t buf[2048] = {0xff}; //<< pre-set with 0xFF terminator
-  if ( (bytes_serialized = ot_pkt_serialize(tren_pkt, buf, sizeof buf)) < 0) 
+  // Build TREQ pkt
+  ot_pkt_fields treq_pkt = { .header = treq_hd, .state = TREQ, .srv_ip = SRV_IP, .cli_ip = CLI_IP };
+  memcpy(treq_pkt.cli_mac, cli_mac, 6);
+
+  // Serialize TREQ pkt
+  ssize_t bytes_serialized = ot_pkt_encode(&treq_pkt, buf, buflen);
+
+  if (bytes_serialized < 0) 
   {
+    printf("serialization failed\n");
     return -1;
   } 
   
-  // Begin TCP send
-  int sockfd = 0;
-  struct sockaddr_in serv_addr;
-  
-  if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) 
+  // Send the serialized TREQ to server and wait for reply
+  ssize_t bytes_received = cli_transact(conn, PORT, SRV_IP, buf, buflen, (size_t)bytes_serialized, 1);
+  if (bytes_received < 0) 
   {
-    perror("socket failed");
+    printf("FAILED\n");
     return -1;
-  }
-  
-  serv_addr.sin_family = AF_INET;
-  serv_addr.sin_port = htons(PORT);
-  serv_addr.sin_addr.s_addr = SRV_IP;
+  } 
 
-  if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+  // Finally, parse the reply in place
+  if (ot_pkt_view_parse(reply_pkt, buf, (size_t)bytes_received) < 0) 
+  {
+    printf("deserialization failed\n");
     printf("FAILED\n");
     return -1;
   } 
 
-  // Send the serialized TREN to server
-  send(sockfd, buf, bytes_serialized, 0);
-  // Wait for reply
-  if (read(sockfd, buf, sizeof buf) < 0) 
+  return 1;
+}
+
+
+static int tren_send(ot_pkt_view* reply_pkt, uint8_t* buf, size_t buflen, ot_cli_conn* conn, 
+                     const int PORT, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac)
+{
+  // Build TREN header 
+  ot_pkt_header tren_hd = ot_pkt_header_create(SRV_IP, CLI_IP,  srv_mac, cli_mac, 0, 0);
+
+  // Build TREN pkt
+  ot_pkt_fields tren_pkt = { .header = tren_hd, .state = TREN, .srv_ip = SRV_IP, .cli_ip = CLI_IP };
+  memcpy(tren_pkt.cli_mac, cli_mac, 6);
+
+  // Serialize TREN pkt
+  ssize_t bytes_serialized = ot_pkt_encode(&tren_pkt, buf, buflen);
+
+  if (bytes_serialized < 0) 
   {
-    perror("read failed");
     return -1;
   } 
-
-  // Finally, deserialize reply
-  if (ot_pkt_deserialize(*reply_pkt, buf, sizeof buf) < 0) 
+  
+  // Send the serialized TREN to server and wait for reply
+  ssize_t bytes_received = cli_transact(conn, PORT, SRV_IP, buf, buflen, (size_t)bytes_serialized, 1);
+  if (bytes_received < 0) 
   {
     return -1;
   } 
 
-  // Free the pkt we used for sending the TREN pkt
-  ot_pkt_destroy(&tren_pkt);
-
-  close(sockfd);
+  // Finally, parse the reply in place
+  if (ot_pkt_view_parse(reply_pkt, buf, (size_t)bytes_received) < 0) 
+  {
+    return -1;
+  } 
 
   return 0;
 }
 
-static int csend_send(ot_pkt** reply_pkt, const char* uname, const char* psk, const int PORT, 
+// Serializes a CSEND pkt into a frame in buf, returns the length of the frame or -1
+static ssize_t csend_build(uint8_t* buf, size_t buflen, const char* uname, const char* psk, 
                            uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac)
 {
   // Build CSEND header 
   ot_pkt_header csend_hd = ot_pkt_header_create(SRV_IP, CLI_IP,  srv_mac, 
                                                 cli_mac, DEF_EXP_TIME, DEF_EXP_TIME*0.75);
 
-  // Build csend pkt
-  ot_pkt* csend_pkt = ot_pkt_create();
-  csend_pkt->header = csend_hd;
-
-  // Specify CSEND state payload
-  uint8_t pl_state_type = PL_STATE; //<< state to indicate that we are sending a TREN packet
-  uint8_t pl_state_value = (uint8_t)CSEND; 
-  uint8_t pl_state_vlen = (uint8_t)sizeof(pl_state_value);
-
-  ot_payload* pl_state_payload = ot_payload_create(pl_state_type, &pl_state_value, pl_state_vlen);
-
-
-  // Specify CSEND srv_ip payload 
-  uint8_t pl_srv_ip_type = PL_SRV_IP;
-  uint32_t pl_srv_ip_value = SRV_IP;
-  uint8_t pl_srv_ip_vlen = (uint8_t)sizeof(pl_srv_ip_value);
-
-  ot_payload* pl_srv_ip_payload = ot_payload_create(pl_srv_ip_type, &pl_srv_ip_value, pl_srv_ip_vlen);
-
-
-  // Specify CSEND cli_ip payload 
-  uint8_t pl_cli_ip_type = PL_CLI_IP;
-  uint32_t pl_cli_ip_value = CLI_IP;
-  uint8_t pl_cli_ip_vlen = (uint8_t)sizeof(pl_cli_ip_value);
-
-  ot_payload* pl_cli_ip_payload = ot_payload_create(pl_cli_ip_type, &pl_cli_ip_value, pl_cli_ip_vlen);
-
-  
-  // Specify CSEND hash payload 
-  uint8_t pl_hash_type = PL_HASH;
-  uint64_t pl_hash_value = cred_hash(uname, strlen(uname)) + cred_hash(psk, strlen(psk));
-  uint8_t pl_hash_vlen = (uint8_t)sizeof(pl_hash_value);
-
-  ot_payload* pl_hash_payload = ot_payload_create(pl_hash_type, &pl_hash_value, pl_hash_vlen);
-  
-  // Create payload list in CSEND pkt
-  csend_pkt->payload = ot_payload_append(csend_pkt->payload, pl_state_payload);
-  csend_pkt->payload = ot_payload_append(csend_pkt->payload, pl_srv_ip_payload);
-  csend_pkt->payload = ot_payload_append(csend_pkt->payload, pl_cli_ip_payload);
-  csend_pkt->payload = ot_payload_append(csend_pkt->payload, pl_hash_payload);
+  // Build CSEND pkt
+  ot_pkt_fields csend_pkt = { 
+    .header = csend_hd, 
+    .state = CSEND, 
+    .srv_ip = SRV_IP, 
+    .cli_ip = CLI_IP,
+    .hash = cred_hash(uname, strlen(uname)) + cred_hash(psk, strlen(psk)),
+  };
 
   // Serialize CSEND pkt
-  ssize_t bytes_serialized = 0;
-  uint8_t buf[2048] = {0xff}; //<< pre-set with 0xFF terminator
-  if ( (bytes_serialized = ot_pkt_serialize(csend_pkt, buf, sizeof buf)) < 0) 
+  return ot_pkt_encode(&csend_pkt, buf, buflen);
+}
+
+static int csend_send(ot_pkt_view* reply_pkt, uint8_t* buf, size_t buflen, ot_cli_conn* conn, 
+                      const char* uname, const char* psk, const int PORT, uint32_t SRV_IP, 
+                      uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac)
+{
+  ssize_t bytes_serialized = csend_build(buf, buflen, uname, psk, SRV_IP, CLI_IP, srv_mac, cli_mac);
+  if (bytes_serialized < 0) 
   {
     return -1;
   } 
   
-  // Begin TCP send
-  int sockfd = 0;
-  struct sockaddr_in serv_addr;
-  
-  if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) 
+  // Send the serialized CSEND to server and wait for reply
+  ssize_t bytes_received = cli_transact(conn, PORT, SRV_IP, buf, buflen, (size_t)bytes_serialized, 1);
+  if (bytes_received < 0) 
   {
-    perror("socket failed");
-    return -1;
-  }
-  
-  serv_addr.sin_family = AF_INET;
-  serv_addr.sin_port = htons(PORT);
-  serv_addr.sin_addr.s_addr = SRV_IP;
-
-  if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
     return -1;
   } 
 
-  // Send the serialized CPULL to server
-  send(sockfd, buf, bytes_serialized, 0);
-  // Wait for reply
-  if (read(sockfd, buf, sizeof buf) < 0) 
+  // Finally, parse the reply in place
+  if (ot_pkt_view_parse(reply_pkt, buf, (size_t)bytes_received) < 0) 
   {
-    perror("read failed");
     return -1;
   } 
 
-  // Finally, deserialize reply
-  if (ot_pkt_deserialize(*reply_pkt, buf, sizeof buf) < 0) 
+  return 0;
+}
+
+// Sends the requests (reqlen bytes of buf) of a shared memory connection through its channel and 
+// collects their nreplies replies back-to-back into buf, in the order of the requests
+//
+// The channel is kept as full as it goes. Returns the number of reply bytes, or -1 on error.
+static ssize_t cli_shm_transact(ot_cli_conn* conn, uint8_t* buf, size_t buflen, size_t reqlen, 
+                                size_t nreplies)
+{
+  if (nreplies == 0 || nreplies > CLI_PIPELINE_DEPTH) return -1;
+  if (conn->shm_chan < 0 && (conn->shm_chan = shmring_claim(conn->shm, CLI_SHM_TIMEOUT_MS)) < 0)
   {
+    fprintf(stderr, "ot_cli_conn error: no free channel on the shm ring\n");
     return -1;
-  } 
+  }
 
-  // Free the pkt we used for sending the CPULL pkt
-  ot_pkt_destroy(&csend_pkt);
+  // Split the requests at their frame boundaries
+  size_t req_off[CLI_PIPELINE_DEPTH];
+  size_t req_len[CLI_PIPELINE_DEPTH];
+  size_t offset = 0;
+  for (size_t i = 0; i < nreplies; ++i)
+  {
+    ssize_t frame_len = ot_pkt_frame_len(&buf[offset], reqlen - offset);
+    if (frame_len <= 0) return -1;
+    req_off[i] = offset;
+    req_len[i] = (size_t)frame_len;
+    offset += (size_t)frame_len;
+  }
 
-  close(sockfd);
+  // The replies are collected aside, buf still holds the requests not sent yet
+  uint8_t replies[CLI_PIPELINE_DEPTH][SRV_MAX_REPLY_SIZE];
+  size_t reply_len[CLI_PIPELINE_DEPTH];
+  size_t sent = 0;
+  size_t received = 0;
+  bool answered = true;
 
-  return 0;
+  while (received < nreplies)
+  {
+    while (sent < nreplies && shmring_send(conn->shm, conn->shm_chan, &buf[req_off[sent]], req_len[sent]))
+    {
+      ++sent;
+    }
+    if (sent == received) //<< a request that does not fit a slot
+    {
+      cli_shm_resync(conn);
+      return -1;
+    }
+
+    ssize_t len = shmring_recv(conn->shm, conn->shm_chan, replies[received], SRV_MAX_REPLY_SIZE, 
+                               CLI_SHM_TIMEOUT_MS);
+    if (len < 0)
+    {
+      fprintf(stderr, "ot_cli_conn error: no reply from server over shm\n");
+      cli_shm_resync(conn);
+      return -1;
+    }
+
+    // Keep taking the replies of the requests already sent, so none is left for the next transaction
+    if (len == 0 || ot_pkt_frame_len(replies[received], (size_t)len) != len) answered = false;
+    reply_len[received++] = (size_t)len;
+  }
+  if (!answered) return -1;
+
+  size_t len = 0;
+  for (size_t i = 0; i < nreplies; ++i)
+  {
+    if (len + reply_len[i] > buflen) return -1;
+    memcpy(&buf[len], replies[i], reply_len[i]);
+    len += reply_len[i];
+  }
+
+  return (ssize_t)len;
+}
+
+// Trades the channel of a failed transaction for a fresh one
+//
+// Shm replies carry no request id, so a late reply left in the ring would be taken for the reply of the
+// next transaction. shmring_claim waits for the requests still outstanding and skips their replies. If
+// the server does not get to them in time, the connection is left without a channel until the next
+// transaction claims one.
+static void cli_shm_resync(ot_cli_conn* conn)
+{
+  shmring_release(conn->shm, conn->shm_chan);
+  conn->shm_chan = shmring_claim(conn->shm, CLI_SHM_TIMEOUT_MS);
 }
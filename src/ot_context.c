@@ -7,17 +7,37 @@
 #include "ot_packet.h"
 #include "ht.h"
 
+/**
+ * Private ctable lock helpers
+ * Note: private ctables (ctable_private) are never locked
+ */
+static void ctable_rdlock(ot_srv_ctx* sc)
+{
+  if (!sc->ctable_private) pthread_rwlock_rdlock(&sc->ctable_lock);
+}
+
+static void ctable_wrlock(ot_srv_ctx* sc)
+{
+  if (!sc->ctable_private) pthread_rwlock_wrlock(&sc->ctable_lock);
+}
+
+static void ctable_unlock(ot_srv_ctx* sc)
+{
+  if (!sc->ctable_private) pthread_rwlock_unlock(&sc->ctable_lock);
+}
+
 /**
  * Private method wrappers for ht API
+ * Note: callers must hold the ctable lock
  */
-static const char* ht_set_cli_ctx(ht* ctable, const char* macstr, ot_cli_ctx cc)
+static bool ht_set_cli_ctx(ht* ctable, uint64_t mac, ot_cli_ctx cc)
 {
-  return ht_set(&ctable, macstr, &cc, sizeof(cc));
+  return ht_set_u64(ctable, mac, &cc, sizeof(cc));
 }
 
-static ot_cli_ctx ht_get_cli_ctx(ht* ctable, const char* macstr)
+static ot_cli_ctx ht_get_cli_ctx(ht* ctable, uint64_t mac)
 {
-  ot_cli_ctx* ret = ht_get(ctable, macstr);
+  ot_cli_ctx* ret = ht_get_u64(ctable, mac);
 
   if (ret == NULL)
   {
@@ -29,6 +49,22 @@ static ot_cli_ctx ht_get_cli_ctx(ht* ctable, const char* macstr)
   return *ret;
 }
 
+// Parses a MAC string key into a packed MAC. Returns false if it is not a MAC string.
+static bool macstr_pack(const char* macstr, uint64_t* mac)
+{
+  if (macstr == NULL || strlen(macstr) != 17) return false;
+
+  unsigned int bytes[6];
+  if (sscanf(macstr, "%02x:%02x:%02x:%02x:%02x:%02x", 
+             &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) return false;
+
+  uint8_t macbytes[6];
+  for (int i = 0; i < 6; ++i) macbytes[i] = (uint8_t)bytes[i];
+  *mac = ot_mac_pack(macbytes);
+
+  return true;
+}
+
 /**
  * Context initializers
  */
@@ -75,8 +111,18 @@ ot_srv_ctx* ot_srv_ctx_create(ot_srv_ctx_mdata sc_mdata)
   memcpy(&(psc->sc_mdata), &sc_mdata, sizeof(ot_srv_ctx_mdata));
 
   // Allocate memory for hash tables
-  psc->ctable = ht_create(HT_DEF_SZ);
+  psc->ctable = ht_create_u64(HT_DEF_SZ, sizeof(ot_cli_ctx));
   psc->otable = ht_create(HT_DEF_SZ);
+  psc->ctable_private = false;
+
+  if (pthread_rwlock_init(&psc->ctable_lock, NULL) != 0)
+  {
+    fprintf(stderr, "ot_psc_ctx_create error: failed to initialize ctable lock");
+    ht_destroy(psc->ctable);
+    ht_destroy(psc->otable);
+    free(psc);
+    return NULL;
+  }
 
   return psc;
 }
@@ -84,14 +130,89 @@ ot_srv_ctx* ot_srv_ctx_create(ot_srv_ctx_mdata sc_mdata)
 /**
 * Client context getters/setters
 */
+// Inserts the client context of a packed MAC into a server's ctable
+bool ot_srv_set_cli_ctx_mac(ot_srv_ctx* sc, uint64_t mac, ot_cli_ctx cc)
+{
+  if (sc == NULL) return false;
+
+  ctable_wrlock(sc);
+  bool set_cc = ht_set_cli_ctx(sc->ctable, mac, cc);
+  ctable_unlock(sc);
+
+  return set_cc;
+}
+
+// Inserts the client context of a packed MAC into a server's ctable only if the MAC has none yet
+bool ot_srv_add_cli_ctx_mac(ot_srv_ctx* sc, uint64_t mac, ot_cli_ctx cc)
+{
+  if (sc == NULL) return false;
+
+  bool set_cc = false;
+
+  ctable_wrlock(sc);
+  if (ht_get_u64(sc->ctable, mac) == NULL) 
+  {
+    set_cc = ht_set_cli_ctx(sc->ctable, mac, cc);
+  }
+  ctable_unlock(sc);
+
+  return set_cc;
+}
+
+// Removes the client context of a packed MAC from a server's ctable
+bool ot_srv_del_cli_ctx_mac(ot_srv_ctx* sc, uint64_t mac)
+{
+  if (sc == NULL) return false;
+
+  ctable_wrlock(sc);
+  bool del_cc = ht_delete_u64(sc->ctable, mac);
+  ctable_unlock(sc);
+
+  return del_cc;
+}
+
+// Finds the client context of a packed MAC from a server's ctable and returns it
+ot_cli_ctx ot_srv_get_cli_ctx_mac(ot_srv_ctx* sc, uint64_t mac)
+{
+  if (sc == NULL)
+  {
+    ot_cli_ctx failret = {0};
+    failret.state = UNKN;
+    return failret;
+  }
+
+  ctable_rdlock(sc);
+  ot_cli_ctx ret = ht_get_cli_ctx(sc->ctable, mac);
+  ctable_unlock(sc);
+
+  return ret;
+}
+
 // Inserts a client context into a server's ctable
 const char* ot_srv_set_cli_ctx(ot_srv_ctx* sc, const char* macstr, ot_cli_ctx cc)
 {
-  if (sc == NULL || macstr == NULL) return NULL;
+  uint64_t mac;
+  if (sc == NULL || !macstr_pack(macstr, &mac)) return NULL;
+
+  return ot_srv_set_cli_ctx_mac(sc, mac, cc) ? macstr : NULL;
+}
+
+// Inserts a client context into a server's ctable only if the MAC has no context yet
+const char* ot_srv_add_cli_ctx(ot_srv_ctx* sc, const char* macstr, ot_cli_ctx cc)
+{
+  uint64_t mac;
+  if (sc == NULL || !macstr_pack(macstr, &mac)) return NULL;
 
-  if (strlen(macstr) != 17) return NULL;
+  return ot_srv_add_cli_ctx_mac(sc, mac, cc) ? macstr : NULL;
+}
 
-  return ht_set_cli_ctx(sc->ctable, macstr, cc);
+// Removes a client context from a server's ctable
+const char* ot_srv_del_cli_ctx(ot_srv_ctx* sc, const char* macstr)
+{
+  uint64_t mac;
+  if (sc == NULL || !macstr_pack(macstr, &mac)) return NULL;
+
+  return ot_srv_del_cli_ctx_mac(sc, mac) ? macstr : NULL;
 }
 
 // Finds a client context from a server's ctable and returns it
@@ -100,12 +221,13 @@ ot_cli_ctx ot_srv_get_cli_ctx(ot_srv_ctx* sc, const char* macstr)
   ot_cli_ctx failret = {0};
   failret.state = UNKN;
 
-  if (sc == NULL || macstr == NULL)
+  uint64_t mac;
+  if (sc == NULL || !macstr_pack(macstr, &mac))
   {
     return failret;
   }
 
-  return ht_get_cli_ctx(sc->ctable, macstr);
+  return ot_srv_get_cli_ctx_mac(sc, mac);
 }
 
 /**
@@ -130,6 +252,8 @@ void ot_srv_ctx_destroy(ot_srv_ctx** os)
     osc->otable = NULL;
   }
 
+  pthread_rwlock_destroy(&osc->ctable_lock);
+
   free(*os);
 
   *os = NULL;
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <arpa/inet.h> //<< for the byte order of the frame length
 
 /**
   * Private prototypes
@@ -12,9 +13,10 @@
 static ssize_t ot_pkt_serialize_pack_header(ot_pkt_header h, uint8_t* buf, size_t buflen);
 static ssize_t ot_pkt_serialize_pack_payload(ot_payload* head, uint8_t* buf, size_t buflen);
 static ssize_t ot_pkt_deserialize_unpack_header(ot_pkt_header* h, uint8_t* buf, size_t buflen);
-static ssize_t ot_pkt_deserialize_unpack_payload(ot_payload** phead, uint8_t* buf, size_t buflen);
+static ssize_t ot_pkt_deserialize_unpack_payload(ot_pkt* pkt, uint8_t* buf, size_t buflen);
 
-static void ot_payload_destroy(ot_payload** pp);
+static void ot_payload_destroy(ot_pkt* pkt);
+static void ot_pkt_frame_write(uint8_t* buf, size_t frame_len);
 /**
   * Public implementations
   */
@@ -41,6 +43,8 @@ ot_pkt* ot_pkt_create()
   }
 
   res->payload = NULL;
+  res->npl = 0;
+  res->vused = 0;
 
   return res;
 }
@@ -64,6 +68,30 @@ ot_payload* ot_payload_create(uint8_t t, void* v, uint8_t vl)
   return res; // Return the pointer to the newly created object
 }
 
+ot_payload* ot_pkt_put(ot_pkt* pkt, uint8_t t, const void* v, uint8_t vl)
+{
+  if (pkt == NULL || pkt->npl == OT_PKT_MAX_PAYLOADS) return NULL;
+
+  size_t vsize = (vl + OT_PKT_VALUE_ALIGN - 1) & ~(size_t)(OT_PKT_VALUE_ALIGN - 1);
+  if (pkt->vused + vsize > OT_PKT_VALUES_SIZE) return NULL;
+
+  ot_payload* res = &pkt->pl[pkt->npl];
+  res->type = t;
+  res->vlen = vl;
+  res->value = &pkt->values[pkt->vused];
+  memcpy(res->value, v, vl);
+
+  // The new node goes right after the last inline one, ahead of any appended nodes
+  ot_payload** link = (pkt->npl == 0) ? &pkt->payload : &pkt->pl[pkt->npl - 1].next;
+  res->next = *link;
+  *link = res;
+
+  pkt->npl++;
+  pkt->vused += vsize;
+
+  return res;
+}
+
 ot_payload* ot_payload_append(ot_payload* head, ot_payload* add) 
 {
   // If there's nothing to add, just return the current list as-is
@@ -90,53 +118,342 @@ ot_payload* ot_payload_append(ot_payload* head, ot_payload* add)
 
 ssize_t ot_pkt_serialize(struct ot_pkt* pkt, uint8_t* buf, size_t buflen)
 {
-  if (pkt == NULL || buf == NULL || buflen == 0) return -1;
+  if (pkt == NULL || buf == NULL || buflen <= sizeof(ot_pkt_frame)) return -1;
   
-  ssize_t bytes_serialized = 0;
-
-  if ( (bytes_serialized += ot_pkt_serialize_pack_header(pkt->header, buf, buflen)) < 0 ) 
+  // The header and payloads follow the frame prefix
+  uint8_t* body = &buf[sizeof(ot_pkt_frame)];
+  size_t bodylen = buflen - sizeof(ot_pkt_frame);
+  ssize_t bytes_serialized = sizeof(ot_pkt_frame);
+  ssize_t packed;
+
+  // Results are checked before they are added, the frame prefix would mask a -1
+  if ( (packed = ot_pkt_serialize_pack_header(pkt->header, body, bodylen)) < 0 ) 
   {
     fprintf(stderr, "pkt serialization failed: cannot serialize header\n");
     return -1;
   }
-  if ( (bytes_serialized += ot_pkt_serialize_pack_payload(pkt->payload, buf, buflen)) < 0 )
+  bytes_serialized += packed;
+  if ( (packed = ot_pkt_serialize_pack_payload(pkt->payload, body, bodylen)) < 0 )
   {
     fprintf(stderr, "pkt serialization failed: cannot serialize payload\n");
     return -1;
   }
+  bytes_serialized += packed;
+  if (bytes_serialized > UINT16_MAX)
+  {
+    fprintf(stderr, "pkt serialization failed: pkt exceeds the frame length limit\n");
+    return -1;
+  }
+
+  ot_pkt_frame_write(buf, (size_t)bytes_serialized);
 
   return bytes_serialized;
 }
 
+int ot_pkt_serialize_iov(const ot_pkt* pkt, uint8_t* heads, size_t headslen, struct iovec* iov, int iovcnt,
+                         size_t* len)
+{
+  if (pkt == NULL || heads == NULL || iov == NULL || len == NULL) return -1;
+  if (headslen < sizeof(ot_pkt_frame) || iovcnt < 2) return -1;
+
+  // The prefix goes first in heads, the header is sent straight from the pkt
+  iov[0] = (struct iovec){ .iov_base = heads, .iov_len = sizeof(ot_pkt_frame) };
+  iov[1] = (struct iovec){ .iov_base = (void*)&pkt->header, .iov_len = sizeof(ot_pkt_header) };
+
+  size_t head_off = sizeof(ot_pkt_frame);
+  size_t frame_len = sizeof(ot_pkt_frame) + sizeof(ot_pkt_header);
+  int n = 2;
+
+  for (ot_payload* oti = pkt->payload; oti != NULL; oti = oti->next)
+  {
+    if (head_off + 2 > headslen || n + 2 > iovcnt) return -1;
+
+    heads[head_off] = oti->type;
+    heads[head_off+1] = oti->vlen;
+    iov[n++] = (struct iovec){ .iov_base = &heads[head_off], .iov_len = 2 };
+    iov[n++] = (struct iovec){ .iov_base = oti->value, .iov_len = oti->vlen };
+
+    head_off += 2;
+    frame_len += 2 + oti->vlen;
+  }
+
+  if (frame_len > UINT16_MAX) return -1;
+
+  ot_pkt_frame_write(heads, frame_len);
+  *len = frame_len;
+
+  return n;
+}
+
 ssize_t ot_pkt_deserialize(struct ot_pkt* pkt, uint8_t* buf, size_t buflen) 
 {
   if (pkt == NULL || buf == NULL || buflen == 0) return -1;
-  
-  ssize_t bytes_deserialized = 0;
 
-  if ( (bytes_deserialized += ot_pkt_deserialize_unpack_header(&(pkt->header), buf, buflen)) < 0 ) 
+  ssize_t frame_len = ot_pkt_frame_len(buf, buflen);
+  if (frame_len <= 0) 
+  {
+    fprintf(stderr, "pkt deserialization failed: %s\n", 
+            (frame_len == 0) ? "incomplete frame" :
+            (frame_len == OT_FRAME_ELEGACY) ? "unframed pkt from a pre-v1 peer" :
+            (frame_len == OT_FRAME_EVERSION) ? "unsupported wire version" : "invalid frame length");
+    return -1;
+  }
+
+  // Only the bytes of the frame are parsed
+  uint8_t* body = &buf[sizeof(ot_pkt_frame)];
+  size_t bodylen = (size_t)frame_len - sizeof(ot_pkt_frame);
+  ssize_t bytes_deserialized = sizeof(ot_pkt_frame);
+  ssize_t unpacked;
+
+  if ( (unpacked = ot_pkt_deserialize_unpack_header(&(pkt->header), body, bodylen)) < 0 ) 
   {
     fprintf(stderr, "pkt deserialization failed: cannot deserialize header\n");
-    if (pkt->payload != NULL)
-    {
-      
-    }
     return -1;
   }
-  if ( (bytes_deserialized += ot_pkt_deserialize_unpack_payload(&(pkt->payload), buf, buflen)) < 0 ) 
+  bytes_deserialized += unpacked;
+  if ( (unpacked = ot_pkt_deserialize_unpack_payload(pkt, body, bodylen)) < 0 ) 
   {
     fprintf(stderr, "pkt deserialization failed: cannot deserialize payload\n");
     return -1;
   }
+  bytes_deserialized += unpacked;
 
   return bytes_deserialized;
 }
 
+#define PL_SIZE(member) sizeof(((ot_pkt_fields*)0)->member) //<< size of the value of a msgtype on the wire
+
+// Smallest vlen of each msgtype; shorter payloads are treated as missing
+static const uint8_t pl_min_vlen[PL_UNKN] = {
+#define X(msgtype, member, type, dims) [msgtype] = PL_SIZE(member),
+  OT_PL_SCHEMA(X)
+#undef X
+};
+
+ssize_t ot_pkt_view_parse(ot_pkt_view* v, const uint8_t* buf, size_t buflen)
+{
+  if (v == NULL || buf == NULL) return -1;
+
+  ssize_t frame_len = ot_pkt_frame_len(buf, buflen);
+  if (frame_len <= 0) return -1; //<< callers only hand over complete frames
+
+  const uint8_t* body = &buf[sizeof(ot_pkt_frame)];
+  size_t bodylen = (size_t)frame_len - sizeof(ot_pkt_frame);
+
+  memcpy(&v->header, body, sizeof(ot_pkt_header)); //<< frame length covers at least the header
+  v->present = 0;
+
+  size_t offset = sizeof(ot_pkt_header);
+  while (offset < bodylen)
+  {
+    if (offset + 2 > bodylen) return -1;                    //<< type and vlen must both fit
+    if (offset + 2 + body[offset+1] > bodylen) return -1;   //<< value must end within the frame
+
+    uint8_t t = body[offset];
+    uint8_t vl = body[offset+1];
+
+    if (t < PL_UNKN && vl >= pl_min_vlen[t])
+    {
+      v->payloads[t].type = t;
+      v->payloads[t].vlen = vl;
+      v->payloads[t].value = &body[offset+2];
+      v->present |= OT_PL_BIT(t);
+    }
+
+    offset += 2 + vl;
+  }
+
+  return frame_len;
+}
+
+const ot_payload_view* ot_pkt_view_get(const ot_pkt_view* v, ot_pkt_msgtype_t type)
+{
+  if (v == NULL || (unsigned)type >= PL_UNKN || !(v->present & OT_PL_BIT(type))) return NULL;
+
+  return &v->payloads[type];
+}
+
+static bool ot_pkt_view_load(const ot_pkt_view* v, ot_pkt_msgtype_t type, void* out, size_t size)
+{
+  const ot_payload_view* pv = ot_pkt_view_get(v, type);
+  if (pv == NULL || pv->vlen < size) return false;
+
+  memcpy(out, pv->value, size); //<< values may sit at any offset of the frame
+  return true;
+}
+
+bool ot_pkt_view_u8(const ot_pkt_view* v, ot_pkt_msgtype_t type, uint8_t* out)
+{
+  return ot_pkt_view_load(v, type, out, sizeof(*out));
+}
+
+bool ot_pkt_view_u32(const ot_pkt_view* v, ot_pkt_msgtype_t type, uint32_t* out)
+{
+  return ot_pkt_view_load(v, type, out, sizeof(*out));
+}
+
+bool ot_pkt_view_u64(const ot_pkt_view* v, ot_pkt_msgtype_t type, uint64_t* out)
+{
+  return ot_pkt_view_load(v, type, out, sizeof(*out));
+}
+
+ssize_t ot_pkt_encode(const ot_pkt_fields* f, uint8_t* buf, size_t buflen)
+{
+  if (f == NULL || buf == NULL || f->state >= UNKN) return -1;
+
+  uint32_t emit = ot_pkt_required(f->state) | (f->present & ot_pkt_optional(f->state));
+  size_t len = sizeof(ot_pkt_frame) + sizeof(ot_pkt_header);
+  if (len > buflen) return -1;
+
+  memcpy(&buf[sizeof(ot_pkt_frame)], &f->header, sizeof(ot_pkt_header));
+
+  // One fixed-size TLV per schema row, in msgtype order
+#define X(msgtype, member, type, dims)                                      \
+  if (emit & OT_PL_BIT(msgtype))                                            \
+  {                                                                         \
+    if (len + 2 + PL_SIZE(member) > buflen) return -1;                      \
+    buf[len] = msgtype;                                                     \
+    buf[len+1] = PL_SIZE(member);                                           \
+    memcpy(&buf[len+2], &f->member, PL_SIZE(member));                       \
+    len += 2 + PL_SIZE(member);                                             \
+  }
+  OT_PL_SCHEMA(X)
+#undef X
+
+  if (len > UINT16_MAX) return -1;
+
+  ot_pkt_frame_write(buf, len);
+
+  return (ssize_t)len;
+}
+
+ssize_t ot_pkt_decode(ot_pkt_fields* f, const uint8_t* buf, size_t buflen)
+{
+  if (f == NULL) return -1;
+
+  ot_pkt_view v;
+  ssize_t frame_len = ot_pkt_view_parse(&v, buf, buflen);
+  if (frame_len < 0) return -1;
+
+  f->header = v.header;
+  f->present = v.present;
+
+  // Values past the schema size of a msgtype are ignored
+#define X(msgtype, member, type, dims)                                      \
+  if (v.present & OT_PL_BIT(msgtype))                                       \
+  {                                                                         \
+    memcpy(&f->member, v.payloads[msgtype].value, PL_SIZE(member));         \
+  }
+  OT_PL_SCHEMA(X)
+#undef X
+
+  return frame_len;
+}
+
+bool ot_pkt_validate(const ot_pkt_fields* f)
+{
+  if (f == NULL || !(f->present & OT_PL_BIT(PL_STATE)) || f->state >= UNKN) return false;
+
+  uint32_t required = ot_pkt_required(f->state);
+  return (f->present & required) == required;
+}
+
+ssize_t ot_pkt_frame_len(const uint8_t* buf, size_t buflen)
+{
+  if (buf == NULL) return 0;
+
+  // Tell older peers apart as early as their first bytes allow
+  if (buflen >= 1 && buf[0] != OT_WIRE_MAGIC_0) return OT_FRAME_ELEGACY;
+  if (buflen >= 2 && buf[1] != OT_WIRE_MAGIC_1) return OT_FRAME_ELEGACY;
+  if (buflen >= 3 && buf[2] != OT_WIRE_VERSION) return OT_FRAME_EVERSION;
+  if (buflen < sizeof(ot_pkt_frame)) return 0;
+
+  ot_pkt_frame frame;
+  memcpy(&frame, buf, sizeof(frame));
+
+  size_t len = ntohs(frame.len);
+  if (len < sizeof(ot_pkt_frame) + sizeof(ot_pkt_header)) return OT_FRAME_EINVAL;
+
+  return (buflen >= len) ? (ssize_t)len : 0;
+}
+
+void ot_pkt_parser_init(ot_pkt_parser* p, uint8_t* buf, size_t cap)
+{
+  p->buf = buf;
+  p->cap = cap;
+  p->head = 0;
+  p->tail = 0;
+  p->need = 0;
+}
+
+uint8_t* ot_pkt_parser_room(ot_pkt_parser* p, size_t* room)
+{
+  // An empty stream starts over at the front of the buffer without moving anything
+  if (p->head == p->tail) 
+  {
+    p->head = 0;
+    p->tail = 0;
+  }
+
+  // Move the frame in progress to the front only if it cannot be completed where it is
+  size_t need = (p->need > 0) ? p->need : sizeof(ot_pkt_frame);
+  if (p->head > 0 && p->head + need > p->cap)
+  {
+    memmove(p->buf, &p->buf[p->head], p->tail - p->head);
+    p->tail -= p->head;
+    p->head = 0;
+  }
+
+  *room = p->cap - p->tail;
+  return &p->buf[p->tail];
+}
+
+void ot_pkt_parser_feed(ot_pkt_parser* p, size_t n)
+{
+  p->tail += n;
+}
+
+size_t ot_pkt_parser_buffered(const ot_pkt_parser* p)
+{
+  return p->tail - p->head;
+}
+
+int ot_pkt_parser_peek(ot_pkt_parser* p, uint8_t** frame, size_t* len)
+{
+  const uint8_t* start = &p->buf[p->head];
+  size_t buffered = p->tail - p->head;
+
+  // The prefix only has to be checked once per frame
+  if (p->need == 0)
+  {
+    ssize_t frame_len = ot_pkt_frame_len(start, buffered);
+    if (frame_len < 0) return (int)frame_len;
+    if (frame_len == 0 && buffered < sizeof(ot_pkt_frame)) return 0;
+
+    ot_pkt_frame prefix;
+    memcpy(&prefix, start, sizeof(prefix));
+    p->need = ntohs(prefix.len);
+    if (p->need > p->cap) return OT_FRAME_ETOOBIG;
+  }
+
+  if (buffered < p->need) return 0;
+
+  *frame = &p->buf[p->head];
+  *len = p->need;
+  return 1;
+}
+
+void ot_pkt_parser_pop(ot_pkt_parser* p)
+{
+  p->head += p->need;
+  p->need = 0;
+}
+
 void ot_pkt_destroy(ot_pkt** o)
 {
   ot_pkt* pkt = *o;
 
-  ot_payload_destroy(&(pkt->payload));
+  ot_payload_destroy(pkt);
 
   free(*o);
   *o = NULL;
@@ -161,7 +478,7 @@ void macstr_to_bytes(const char* macstr, uint8_t* macbytes)
   return;
 }
 
-void bytes_to_macstr(uint8_t* macbytes, char* macstr) 
+void bytes_to_macstr(const uint8_t* macbytes, char* macstr) 
 {
   // %02X ensures two-digit uppercase hex with leading zeros
   sprintf(macstr, "%02x:%02x:%02x:%02x:%02x:%02x", 
@@ -196,7 +513,7 @@ static ssize_t ot_pkt_serialize_pack_payload(ot_payload* head, uint8_t* buf, siz
   for(; oti != NULL; oti=oti->next) 
   {
     // Check if we can still serialize within buffer bounds
-    if (offset + 1 + oti->vlen >= buflen) return -1; 
+    if (offset + 2 + oti->vlen > buflen) return -1; 
     
     //Serialize type
     memcpy(&buf[offset], &(oti->type), sizeof(oti->type));
@@ -211,9 +528,6 @@ static ssize_t ot_pkt_serialize_pack_payload(ot_payload* head, uint8_t* buf, siz
     offset += oti->vlen;
   }
 
-  // Populate rest of buffer with the terminator
-  memset(&buf[offset], 0xFF, buflen - offset);
-
   return offset-sizeof(ot_pkt_header); //<< return bytes we serialized excluding header size
 }
 
@@ -228,15 +542,18 @@ static ssize_t ot_pkt_deserialize_unpack_header(ot_pkt_header* h, uint8_t* buf,
   return (ssize_t)sizeof(ot_pkt_header);
 }
 
-static ssize_t ot_pkt_deserialize_unpack_payload(ot_payload** phead, uint8_t* buf, size_t buflen)
+static ssize_t ot_pkt_deserialize_unpack_payload(ot_pkt* pkt, uint8_t* buf, size_t buflen)
 {
-  if(phead == NULL || buf == NULL || buflen == 0) return -1;
+  if(pkt == NULL || buf == NULL || buflen == 0) return -1;
+
+  // Keep track of the last node so that appending stays O(1) once the inline storage runs out
+  ot_payload* tail = pkt->payload;
+  while (tail != NULL && tail->next != NULL) tail = tail->next;
   
   // Iterate over the buffer 
   size_t offset = sizeof(ot_pkt_header); //<< we start after we serialize the header
   while (offset < buflen)
   {
-    if (buf[offset] == 0xFF) break;       //<< stop iterating if we find the terminator (type=0xFF)
     if (offset + 1 >= buflen) return -1;  //<< if out of bounds, immediately return -1 
 
     // Extract type
@@ -250,35 +567,48 @@ static ssize_t ot_pkt_deserialize_unpack_payload(ot_payload** phead, uint8_t* bu
     if (offset + vl >= buflen) return -1;
     offset++; //<< point to first byte of value
 
-    // Allocate memory for value
-    void* v = malloc(vl);
-    if (v == NULL) return -1; //<< return to caller if out of memory (free the payload!!);
-    
-    // Extract the value from buffer
-    memcpy(v, &buf[offset], vl);
+    // The value is copied straight from the buffer, inline as long as no appended node is in the way
+    if (tail == NULL || (pkt->npl > 0 && tail == &pkt->pl[pkt->npl - 1]))
+    {
+      ot_payload* put = ot_pkt_put(pkt, t, &buf[offset], vl);
+      if (put != NULL)
+      {
+        offset += vl;
+        tail = put;
+        continue;
+      }
+    }
+
+    ot_payload* add = ot_payload_create(t, &buf[offset], vl);
+    if (add == NULL) return -1; //<< return to caller if out of memory
     offset += vl; //<< point to next value type
 
-    if ((*phead = ot_payload_append(*phead, ot_payload_create(t,v,vl))) == NULL) return -1; //<< append; exit if we cant do so
+    if (tail == NULL) pkt->payload = add; 
+    else tail->next = add;
+    tail = add;
   }
 
   return offset-sizeof(ot_pkt_header); //<< return bytes deserialized as usual
 }
 
-static void ot_payload_destroy(ot_payload** pp)
+static void ot_payload_destroy(ot_pkt* pkt)
 {
-  if (pp == NULL) return;
+  if (pkt == NULL) return;
 
-  ot_payload* head = *pp;
+  ot_payload* head = pkt->payload;
 
   while (head != NULL)
   {
     ot_payload* tmp = head;
     head = head->next;
+    if (tmp >= pkt->pl && tmp < &pkt->pl[OT_PKT_MAX_PAYLOADS]) continue; //<< inline, freed with the pkt
     free(tmp->value);
     free(tmp);
   }
   
-  *pp = NULL;
+  pkt->payload = NULL;
+  pkt->npl = 0;
+  pkt->vused = 0;
 
   return;
 }
@@ -319,11 +649,18 @@ void pl_parse_table_build(ht** pt, ot_payload* pl_head)
     char msgtype_str[16];
     msgtype_to_str(msgtype, msgtype_str);
 
-    //void* value = oti->value;
-    void* value = malloc(oti->vlen);
-    memcpy(value, oti->value, oti->vlen);
-    uint8_t vlen = oti->vlen;
-
-    ht_set(pt, msgtype_str, value, (size_t)vlen);
+    ht_set(pt, msgtype_str, oti->value, (size_t)oti->vlen); //<< ht_set keeps its own copy of the value
   }
 }
+
+// Writes the prefix of a frame of frame_len bytes, header and payloads included
+static void ot_pkt_frame_write(uint8_t* buf, size_t frame_len)
+{
+  ot_pkt_frame frame = { 
+    .magic = { OT_WIRE_MAGIC_0, OT_WIRE_MAGIC_1 }, 
+    .version = OT_WIRE_VERSION,
+    .flags = 0,
+    .len = htons((uint16_t)frame_len),
+  };
+  memcpy(buf, &frame, sizeof(frame));
+}
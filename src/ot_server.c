@@ -1,3 +1,5 @@
+#define _GNU_SOURCE //<< for accept4
+
 #include "ot_server.h"
 
 #include <stdlib.h>
@@ -5,45 +7,198 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <stddef.h>
 #include <time.h>
-#include <assert.h>
+#include <pthread.h>
 
 #include "ht.h"
+#include "mpscq.h"
 #include "ot_context.h"
 #include "otfile_utils.h"
+#include "shmring.h"
+#include "uring.h"
+
+/**
+ * Private Structures
+ */
+// Per-connection state of the server event loop
+//
+// Connections are non-blocking, so pkts are accumulated in rx_buffer across readiness events and their
+// replies are drained from tx_buffer (starting at tx_off) until the socket stops accepting bytes. The
+// stream parser (rx) splits rx_buffer into frames, so a client may pipeline pkts: they are handled in
+// order, and their replies are appended to the tx buffer to go out together.
+typedef struct srv_conn
+{
+  int                 fd;
+  struct sockaddr_in  addr;
+  int                 origin;     //<< worker that accepted the connection and owns its fd
+  int                 route;      //<< worker the connection is being posted to
+  bool                inflight;   //<< handed to another worker, must not be touched by the origin
+  bool                hup;        //<< peer hung up, close the connection after the pending reply
+  bool                drop;       //<< a pkt went unanswered, close the connection after the pending replies
+  bool                served;     //<< at least one reply has been written out
+  bool                dgram;      //<< a single UDP request, its reply goes out as a datagram
+  uint8_t             udp_id[OT_UDP_ID_SIZE];  //<< request id of a UDP request
+  int                 shm_chan;   //<< shared memory channel of a single request, -1 for sockets
+  struct srv_conn*    next;       //<< link for the backlog of the posting worker
+  bool                idle_linked;
+  int64_t             idle_deadline;  //<< monotonic time (ms) at which an idle connection is closed
+  struct srv_conn*    idle_prev;
+  struct srv_conn*    idle_next;
+  ot_pkt_parser       rx;         //<< frames of rx_buffer that have not been handled yet
+  size_t              tx_len;
+  size_t              tx_off;
+  uint8_t             rx_buffer[MAX_RECV_SIZE];
+  uint8_t             tx_buffer[MAX_RECV_SIZE];
+} srv_conn;
+
+// Buffer the handler writes the reply to a pkt into
+typedef struct srv_out
+{
+  uint8_t*  buf;
+  size_t    cap;
+  size_t    len;
+} srv_out;
+
+// Tags in the low bits of io_uring user data, next to the (aligned) srv_conn pointer
+enum srv_uring_op
+{
+  SRV_URING_ACCEPT = 1,
+  SRV_URING_WAKE,
+  SRV_URING_RECV,
+  SRV_URING_SEND,
+  SRV_URING_CLOSE,
+  SRV_URING_UDP,
+  SRV_URING_UNIX_ACCEPT,
+};
+#define SRV_URING_OP_MASK 7
+
+// Reply to a UDP request, kept for answering retransmits of the request
+typedef struct srv_udp_reply
+{
+  uint64_t            key;            //<< srv_udp_key of the request
+  struct sockaddr_in  addr;
+  uint8_t             id[OT_UDP_ID_SIZE];
+  int64_t             seen;           //<< monotonic time (ms) the request first arrived
+  bool                pending;        //<< forwarded to the owner of its ctable shard and not back yet
+  size_t              len;            //<< 0 while the request is unanswered
+  uint8_t             bytes[SRV_MAX_REPLY_SIZE];
+} srv_udp_reply;
+
+// Server worker
+//
+// Every worker runs its own event loop over a private SO_REUSEPORT listening socket. The server
+// context (sc) is shared by all workers, unless the server is sharded. In that case each worker owns
+// a private ctable shard in its own context and pkts for clients of other shards are forwarded to
+// their owner through its inbox, a lock-free queue paired with an eventfd for wakeups.
+typedef struct srv_worker
+{
+  int                 id;
+  int                 listen_fd;
+  int                 udp_fd;         //<< -1 unless the server also serves UDP
+  int                 unix_fd;        //<< AF_UNIX listener shared by all workers, -1 unless configured
+  int                 epoll_fd;
+  int                 wake_fd;
+  int                 wake_pending;   //<< set while a wakeup of this worker is already signaled
+  ot_srv_ctx*         sc;
+  pthread_t           thread;
+  bool                sharded;
+  int                 nworkers;
+  struct srv_worker*  peers;          //<< all workers of the server, indexed by id
+  mpscq*              inbox;
+  uring*              ring;           //<< io_uring backend of the worker, NULL when running on epoll
+  srv_conn*           backlog_head;   //<< connections waiting for room in a full inbox
+  srv_conn*           backlog_tail;
+  int                 idle_timeout;   //<< seconds, 0 closes connections after their first reply
+  srv_conn*           idle_head;      //<< connections of the worker, least recently active first
+  srv_conn*           idle_tail;
+  srv_conn*           udp_batch;      //<< SRV_UDP_BATCH scratch connections datagrams are handled in
+  srv_udp_reply*      udp_cache;      //<< ring of the UDP requests of the last SRV_UDP_CACHE_TTL_MS
+  size_t              udp_cache_cap;  //<< entries of the ring, a power of two
+  uint64_t            udp_cache_head; //<< sequence number of the oldest entry
+  uint64_t            udp_cache_tail; //<< sequence number of the next entry
+  ht*                 udp_index;      //<< sequence number of the latest entry of each srv_udp_key
+  shmring*            shm;            //<< shared memory ring served instead of sockets, NULL if none
+  srv_conn*           shm_conn;       //<< scratch connection the requests of the ring are handled in
+  bool*               shm_busy;       //<< channels waiting for a forwarded request to come back
+  int                 shm_inflight;   //<< forwarded requests of the ring
+} srv_worker;
+
+// Reply template
+//
+// Replies of one kind share their layout and only differ in the header and payload values, so every 
+// kind is serialized once with zeroed values. A reply is then queued by copying its template and 
+// storing the values at the offsets recorded here.
+typedef struct srv_reply_tmpl
+{
+  uint8_t   bytes[SRV_MAX_REPLY_SIZE];
+  size_t    len;
+  size_t    off[PL_UNKN];   //<< offset of the value of each msgtype in bytes, if the reply carries it
+} srv_reply_tmpl;
+
+static srv_reply_tmpl srv_reply_tmpls[UNKN];  //<< indexed by the state of the reply
+static pthread_once_t srv_reply_tmpls_once = PTHREAD_ONCE_INIT;
+static bool srv_reply_tmpls_ready = false;
+
+// Logs an event of the handler for pkts that came with a peer to report them from
+#define SRV_LOG(peer, ...) do { if ((peer) != NULL) printf(__VA_ARGS__); } while (0)
+#define SRV_ERR(peer, ...) do { if ((peer) != NULL) fprintf(stderr, __VA_ARGS__); } while (0)
+
+// Prints a client MAC straight from its bytes, so that lookups never need it as a string
+#define SRV_MAC_FMT "%02x:%02x:%02x:%02x:%02x:%02x"
+#define SRV_MAC_ARGS(mac) (mac)[0], (mac)[1], (mac)[2], (mac)[3], (mac)[4], (mac)[5]
+
+#define SRV_SHORT_LIVED_MAC 0x000000ababffULL  //<< 00:00:00:ab:ab:ff, tethered for 20s to exercise expiry
+
+// Names the peer of a pkt in error messages
+static inline const char* srv_peer(const char* peer)
+{
+  return (peer != NULL) ? peer : "local caller";
+}
 
 /**
  * Private Implementations
  */
-static bool srv_add_cli_ctx(ot_srv_ctx* sc, ot_pkt* pkt);
+static bool srv_add_cli_ctx(ot_srv_ctx* sc, ot_pkt_header* hd, time_t curr_time);
+
+// Builds the reply templates once per process, see srv_reply_tmpl
+static void srv_reply_tmpls_build(void);
+
+static void srv_uring_serve(srv_worker* w, srv_conn* conn);
+
+static void srv_udp_reply_send(srv_worker* w, srv_conn* conn);
 
-static ssize_t send_pkt(int* sockfd, ot_pkt* pkt, uint8_t* buf, size_t buflen);
+static void srv_shm_reply_send(srv_worker* w, srv_conn* conn);
 
-static bool cli_expiry_check(ot_srv_ctx* sc, ot_pkt_header hd);
+static bool cli_expiry_check(ot_srv_ctx* sc, ot_pkt_header hd, time_t curr_time);
 
-// Validates a deserialized TREQ pkt.
+// Validates a TREQ pkt view.
 //
-// Populates the parse table (ptable) with existing payloads and checks whether the correct
-// payloads exist and correlate with the header
+// Checks whether the correct payloads exist in the view and correlate with the header
 //
 // Returns true if the pkt is valid, otherwise false.
-static bool pl_treq_validate(ot_srv_ctx* sc, ht* ptable, ot_pkt* recv_pkt);
+static bool pl_treq_validate(ot_srv_ctx* sc, const ot_pkt_view* recv_pkt, const char* peer);
 
-// Validates a deserialized TREN pkt.
+// Validates a TREN pkt view.
 //
-// Populates the parse table (ptable) with existing payloads and checks whether the correct
-// payloads exist and correlate with the header
+// Checks whether the correct payloads exist in the view and correlate with the header
 //
 // Returns true if the pkt is valid, otherwise false.
-static bool tren_pl_validate(ot_srv_ctx* sc, ht* ptable, ot_pkt* recv_pkt);
+static bool tren_pl_validate(ot_srv_ctx* sc, const ot_pkt_view* recv_pkt, const char* peer);
 
 // Validates a deserialized CSEND pkt
 //
 // Checks whether the mandatory payloads are in the CSEND pkt
 //
 // Returns true if the pkt is valid, otherwise false 
-static bool csend_pl_validate(ot_srv_ctx* sc, ht* ptable, ot_pkt* recv_pkt);
+static bool csend_pl_validate(ot_srv_ctx* sc, const ot_pkt_view* recv_pkt, const char* peer);
 
 // Checks if the client sending a TREN pkt can renew. 
 //
@@ -51,930 +206,2324 @@ static bool csend_pl_validate(ot_srv_ctx* sc, ht* ptable, ot_pkt* recv_pkt);
 // bounds for renewal.
 //
 // Returns true if the client can renew, otherwise false.
-static bool tren_renewal_time_check(ot_srv_ctx* sc, uint8_t* cli_mac, time_t curr_time);
+static bool tren_renewal_time_check(ot_srv_ctx* sc, uint8_t* cli_mac, time_t curr_time, const char* peer);
 
-// Builds an allocated TINV reply pkt
+// Queue a reply of each kind after the pending replies in the tx buffer of a connection, to be sent by
+// the event loop. The reply is copied from its template and patched with the header and payload values.
 //
-// Sets the header (tinv_hd) and the appropriate payloads (PL_STATE, PL_SRV_IP, PL_CLI_IP)
-// for a valid TINV reply to a client.
-static void tinv_reply_build(ot_pkt* tinv_reply, ot_pkt_header tinv_hd, 
-                             uint32_t srv_ip, uint32_t cli_ip);
+// Returns the length of the reply, or -1 if it does not fit in the tx buffer.
+static ssize_t tinv_reply_queue(srv_out* out, ot_pkt_header tinv_hd, uint32_t srv_ip, uint32_t cli_ip);
 
-// Builds an allocated TACK reply pkt
-//
-// Sets the header (tack_hd) and the appropriate payloads (PL_STATE, PL_SRV_IP, PL_SRV_MAC, PL_CLI_IP,
-// PL_ETIME, PL_RTIME)
-static void tack_reply_build(ot_pkt* tack_reply, ot_pkt_header tack_hd, 
-                             uint32_t srv_ip, uint8_t* srv_mac, uint32_t cli_ip,
-                             uint32_t exp_time, uint32_t renew_time);
+static ssize_t tack_reply_queue(srv_out* out, ot_pkt_header tack_hd, uint32_t srv_ip, uint8_t* srv_mac, 
+                                uint32_t cli_ip, uint32_t exp_time, uint32_t renew_time);
 
-// Builds an allocated CINV reply pkt
-//
-// Sets the header (tack_hd) and the appropriate payloads (PL_STATE, PL_SRV_IP, PL_CLI_IP)
-static void cinv_reply_build(ot_pkt* cinv_reply, ot_pkt_header cinv_hd, uint32_t srv_ip, 
-                             uint32_t cli_ip, uint64_t hash);
+static ssize_t tprv_reply_queue(srv_out* out, ot_pkt_header tprv_hd, uint32_t srv_ip, uint32_t cli_ip, 
+                                uint32_t exp_time, uint32_t renew_time);
 
-// Builds an allocated CPUSH reply pkt
-//
-// Sets the header (tack_hd) and the appropriate payloads (PL_STATE, PL_SRV_IP, PL_CLI_IP)
-static void cval_reply_build(ot_pkt* cval_reply, ot_pkt_header cval_hd, uint32_t srv_ip,
-                              uint32_t cli_ip, uint64_t hash);
+static ssize_t cinv_reply_queue(srv_out* out, ot_pkt_header cinv_hd, uint32_t srv_ip, uint32_t cli_ip, 
+                                uint64_t hash);
 
+static ssize_t cval_reply_queue(srv_out* out, ot_pkt_header cval_hd, uint32_t srv_ip, uint32_t cli_ip, 
+                                uint64_t hash);
 
-// Builds an allocated TPRV reply pkt 
-// 
-// Sets the header (tprv_hd) and the appropriate payloads (PL_STATE, PL_SRV_IP, PL_CLI_IP, 
-// PL_ETIME, PL_RTIME) for a valid TPRV reply to a client.
-static void tprv_reply_build(ot_pkt* tprv_reply, ot_pkt_header tprv_hd, uint32_t srv_ip, 
-                             uint32_t cli_ip, uint32_t exp_time, uint32_t renew_time);
-// Runs the server loop
-// Note: PATH should be checked from the caller, no measures here in ot_srv_run
-void ot_srv_run(uint32_t SRV_IP, uint8_t* SRV_MAC, const char* PATH)
+// Handles a pkt received from peer (NULL for pkts that are not to be logged)
+//
+// Parses the frame at pkt, runs the TREQ/TREN/CSEND state table against the server context at 
+// curr_time and writes the reply pkt to out. Performs no I/O besides logging, and logs nothing at all
+// without a peer. Returns the length of the reply, or 0 if the pkt goes unanswered.
+static ssize_t srv_handle(ot_srv_ctx* sc, const uint8_t* pkt, size_t len, srv_out* out, time_t curr_time,
+                          const char* peer)
 {
-  time_t curr_time;
+  SRV_LOG(peer, "[ot srv] Received %zu bytes from %s\n", len, srv_peer(peer));
 
-  // Socket variables
-  int server_fd, conn_fd;
-  struct sockaddr_in address;
-  int opt = 1;
-  int addrlen = sizeof(address);
-  uint8_t rx_buffer[MAX_RECV_SIZE];
-  
-  // Socket setup
-  server_fd = socket(AF_INET, SOCK_STREAM, 0);
-  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-  address.sin_family = AF_INET;
-  address.sin_addr.s_addr = INADDR_ANY;
-  address.sin_port = htons(DEF_PORT);
+  // Parse the recv pkt in place; payload values point into the caller's buffer
+  ot_pkt_view recv_view;
+  ot_pkt_view* recv_pkt = &recv_view;
 
-  if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) 
+  if (ot_pkt_view_parse(recv_pkt, pkt, len) < 0)  //<< assure deserialization was successful
   {
-    perror("bind failed");
-    return;
+    SRV_ERR(peer, "[ot srv] failed to deserialize reply from %s\n", srv_peer(peer));
+    goto cleanup;
+  }
+  if (recv_pkt->present == 0)                     //<< assure that we have payloads
+  {
+    SRV_ERR(peer, "[ot srv] recv pkt has no payload from %s\n", srv_peer(peer));
+    goto cleanup;
   }
 
-  listen(server_fd, 5);
-
-  // Build server context metadata and allocate memory for server context
-  ot_srv_ctx_mdata srv_mdata = ot_srv_ctx_mdata_create(DEF_PORT, SRV_IP, SRV_MAC);
-  ot_srv_ctx* srv_ctx = ot_srv_ctx_create(srv_mdata);
+  // Extract the PL_STATE payload
+  uint8_t raw_recv_state;
+  if (!ot_pkt_view_u8(recv_pkt, PL_STATE, &raw_recv_state)) 
+  {
+    SRV_ERR(peer, "[ot srv] pkt recv err: no PL_STATE payload\n");
+    goto cleanup;
+  }
 
-  otfile_build(PATH, &srv_ctx->otable); 
+  ot_cli_state_t recv_state = (ot_cli_state_t)raw_recv_state;
 
-  printf("[ot srv] Ready to receive bytes on port %d...\n", DEF_PORT);
+  // State table for the defined cli state from msgtype
+  switch(recv_state)
+  {
+    case TREQ:
+      {
+        SRV_LOG(peer, "[ot srv] TREQ from %s\n", srv_peer(peer));
+        // Check if the mandatory fields (cli_ip and cli_mac) are in the payloads
+        // or if client already exists
+        if (!pl_treq_validate(sc, recv_pkt, peer)) 
+        {
+          if (tinv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, recv_pkt->header.cli_ip) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send tinv to %s\n", srv_peer(peer));
+          }
+          SRV_LOG(peer, "[ot srv] replied TINV to %s, client already exists or malformed treq\n",
+                  srv_peer(peer));
 
-  // Start server runtime loop
-  while (1) {
-    // Runtime variables
-    time(&curr_time);
-    char ipbuf[INET_ADDRSTRLEN] = {0}; //<< for printing IP addresses via inet_ntop
-    ssize_t bytes_received = 0;
-
-    // Accept any inbound client requests
-    conn_fd = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen);
-    if (conn_fd < 0) continue;
-
-    // Upon accepted client, receive pkt
-    bytes_received = recv(conn_fd, rx_buffer, MAX_RECV_SIZE, 0);
-    if (bytes_received < 0) {
-      perror("recv failed");
-    } else if (bytes_received == 0) {
-      printf("[ot srv] Client closed connection.\n");
-    } else {
-      printf("[ot srv] Received %zd bytes from %s\n", bytes_received, 
-             inet_ntop(AF_INET, &(address.sin_addr.s_addr), (char*)ipbuf, INET_ADDRSTRLEN));
 
-      //Pre-populate the buffer with 0xff terminators after the payload has been set 
-      memset(&rx_buffer[bytes_received], 0xff, sizeof(rx_buffer) - bytes_received);
+          goto cleanup; 
+        }
 
-      // Allocate memory for the recv pkt & parse table 
-      ot_pkt* recv_pkt = ot_pkt_create();
-      ht* ptable = ht_create(8);
 
-      // Deserialize recv pkt from recv buffer
-      ot_pkt_deserialize(recv_pkt, rx_buffer, sizeof(rx_buffer));
-      if (recv_pkt == NULL)           //<< assure deserialization was successful
-      {
-        fprintf(stderr, "[ot srv] failed to deserialize reply from %s\n", 
-                inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-        goto cleanup;
+        // Another worker may have tethered the same MAC since the validation, which is answered like
+        // a TREQ of an existing client
+        if (!srv_add_cli_ctx(sc, &recv_pkt->header, curr_time)) 
+        {
+          SRV_ERR(peer, "[ot srv] failed to add cli ctx\n");
+          if (tinv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, recv_pkt->header.cli_ip) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send tinv to %s\n", srv_peer(peer));
+          }
+          goto cleanup;
+        }
+
+        SRV_LOG(peer, "[ot srv] successfully added client to srv ctable\n");
+
+        // After validating pkt and adding ctx, safely extract 
+        // from the view the mandatory info
+        uint32_t recv_cli_ip = 0;
+        ot_pkt_view_u32(recv_pkt, PL_CLI_IP, &recv_cli_ip);
+        
+        uint8_t recv_cli_mac[6] = {0};
+        memcpy(recv_cli_mac, ot_pkt_view_get(recv_pkt, PL_CLI_MAC)->value, sizeof(recv_cli_mac));
+
+        // Set the header of the TACK reply
+        ot_pkt_header tack_hd = ot_pkt_header_create(sc->sc_mdata.srv_ip, recv_cli_ip, sc->sc_mdata.srv_mac, recv_cli_mac, 
+                                                     DEF_EXP_TIME, DEF_EXP_TIME*0.75);
+
+        // Finally queue the TACK reply to be sent to the client
+        ssize_t bytes_serialized;
+        if ((bytes_serialized = tack_reply_queue(out, tack_hd, sc->sc_mdata.srv_ip, sc->sc_mdata.srv_mac, 
+                                                 recv_pkt->header.cli_ip, recv_pkt->header.exp_time, 
+                                                 recv_pkt->header.renew_time)) < 0)
+        {
+          SRV_ERR(peer, "[ot srv] error: failed to reply TACK to client\n");
+          goto cleanup;
+        }
+
+        SRV_LOG(peer, "[ot srv] sent TACK reply (%zuB) to %s\n", 
+                bytes_serialized, srv_peer(peer));
+
+        break;
       }
-      if (recv_pkt->payload == NULL)  //<< assure that we have payloads
+    case TREN: 
       {
-        fprintf(stderr, "[ot srv] recv pkt has no payload from %s\n", 
-                inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-        goto cleanup;
-      }
+        // We utilize tren_pl_validate to pull the mandatory payloads from the deserialized recv pkt
+        // Check for PL_CLI_MAC and PL_CLI_IP and check if they are the same from the view
+        // Returns false if TREN payload is invalid
 
-      // Build the parse table from recv_pkt payloads
-      pl_parse_table_build(&ptable, recv_pkt->payload);
+        SRV_LOG(peer, "[ot srv] TREN from %s\n", srv_peer(peer));
 
-      // Extract the PL_STATE payload
-      uint8_t* raw_recv_state = ht_get(ptable, "PL_STATE");
-      if (raw_recv_state == NULL) 
-      {
-        fprintf(stderr, "[ot srv] pkt recv err: no PL_STATE payload\n");
-        goto cleanup;
-      }
+        if (!tren_pl_validate(sc, recv_pkt, peer)) 
+        {
+          SRV_ERR(peer, "[ot srv] inbound tren error: one or more tren payloads are missing\n");
+
+          // send tinv due to malformed tren
+          if (tinv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, recv_pkt->header.cli_ip) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send tinv to %s\n", srv_peer(peer));
+          }
+          goto cleanup; 
+        }
+
+        // Handle expired clients
+        if (cli_expiry_check(sc, recv_pkt->header, curr_time)) 
+        {
+          SRV_LOG(peer, "[ot srv] client " SRV_MAC_FMT " is expired, deleting...\n", 
+                  SRV_MAC_ARGS(recv_pkt->header.cli_mac));
+          ot_srv_del_cli_ctx_mac(sc, ot_mac_pack(recv_pkt->header.cli_mac));
+
+          // send tinv due to expired client
+          if (tinv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, recv_pkt->header.cli_ip) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send tinv to %s\n", srv_peer(peer));
+          }
 
-      ot_cli_state_t recv_state = (ot_cli_state_t)(*raw_recv_state);
+          goto cleanup;
+        }
 
-      // State table for the defined cli state from msgtype
-      switch(recv_state)
-      {
-        case TREQ:
+        // Check whether client is eligible for renewal (within renewal window)
+        if (!tren_renewal_time_check(sc, recv_pkt->header.cli_mac, curr_time, peer))
+        {
+          // send tinv due to renewal time error
+          if (tinv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, recv_pkt->header.cli_ip) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send tinv to %s\n", srv_peer(peer));
+          }
+
+          SRV_LOG(peer, "[ot srv] renewal bound error: client %s, replied with TINV\n", srv_peer(peer));
+
+          goto cleanup; 
+        } else {
+          // Get reference of cli ctx but change the expiry and renewal
+          // Replace cli ctx mapped by cli mac with new cli ctx
+
+          // Pack the MAC bytes into the ctable key
+          uint64_t mac = ot_mac_pack(recv_pkt->header.cli_mac);
+
+          // Copy the client context (another worker may have removed it in the meantime)
+          ot_cli_ctx updated_cc = ot_srv_get_cli_ctx_mac(sc, mac);
+          if (updated_cc.state == UNKN)
           {
-            printf("[ot srv] TREQ from %s\n",
-                   inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-            // Check if the mandatory fields (cli_ip and cli_mac) are in the payloads
-            // or if client already exists
-            if (!pl_treq_validate(srv_ctx, ptable, recv_pkt)) 
-            {
-              ot_pkt* tinv_reply = ot_pkt_create();
-              tinv_reply_build(tinv_reply, recv_pkt->header, SRV_IP, recv_pkt->header.cli_ip);
-              if (send_pkt(&conn_fd, tinv_reply, rx_buffer, sizeof rx_buffer) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send tinv to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-              }
-              printf("[ot srv] replied TINV to %s, client already exists or malformed treq\n",
-                     inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-
-              ot_pkt_destroy(&tinv_reply);
-
-              goto cleanup; 
-            }
-
-
-            if (!srv_add_cli_ctx(srv_ctx, recv_pkt)) 
-            {
-              fprintf(stderr, "[ot srv] failed to add cli ctx\n");
-              goto cleanup;
-            }
-
-            printf("[ot srv] successfully added client to srv ctable\n");
-
-            // After validating pkt and adding ctx, safely extract 
-            // from parse table the mandatory info
-            uint32_t* recv_cli_ip = ht_get(ptable, "PL_CLI_IP");
-            
-            uint8_t recv_cli_mac[6] = {0};
-            memcpy(recv_cli_mac, ht_get(ptable, "PL_CLI_MAC"), sizeof(recv_cli_mac));
-
-            // Allocate memory for TACK reply pkt and set header
-            ot_pkt* tack_reply = ot_pkt_create();
-            ot_pkt_header tack_hd = ot_pkt_header_create(SRV_IP, *recv_cli_ip, SRV_MAC, recv_cli_mac, 
-                                                         DEF_EXP_TIME, DEF_EXP_TIME*0.75);
-            tack_reply_build(tack_reply, tack_hd, SRV_IP, SRV_MAC, recv_pkt->header.cli_ip, 
-                             recv_pkt->header.exp_time, recv_pkt->header.renew_time);
-
-            // Finally serialize the TACK reply and send to client
-            ssize_t bytes_serialized;
-            if ((bytes_serialized = send_pkt(&conn_fd, tack_reply, rx_buffer, sizeof rx_buffer)) < 0)
-            {
-              fprintf(stderr, "[ot srv] error: failed to reply TACK to client\n");
-              goto cleanup;
-            }
-
-            // Free the tack reply pkt
-            ot_pkt_destroy(&tack_reply);
-
-            printf("[ot srv] sent TACK reply (%zuB) to %s\n", 
-                   bytes_serialized, 
-                   inet_ntop(AF_INET, &address.sin_addr.s_addr, ipbuf, INET_ADDRSTRLEN));
-
-            break;
+            SRV_ERR(peer, "[ot srv] client " SRV_MAC_FMT " was removed before renewal\n", 
+                    SRV_MAC_ARGS(recv_pkt->header.cli_mac));
+            goto cleanup;
           }
-        case TREN: 
+
+          updated_cc.ctx_exp_time = curr_time + DEF_EXP_TIME;
+          updated_cc.ctx_renew_time = curr_time + 0.75*DEF_EXP_TIME;
+          if (mac == SRV_SHORT_LIVED_MAC)
           {
-            // We utilize tren_pl_validate to pull the mandatory payloads from the deserialized recv pkt
-            // Check for PL_CLI_MAC and PL_CLI_IP and check if they are the same from ptable
-            // Returns false if TREN payload is invalid
-
-            printf("[ot srv] TREN from %s\n",
-                   inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-
-            if (!tren_pl_validate(srv_ctx, ptable, recv_pkt)) 
-            {
-              fprintf(stderr, "[ot srv] inbound tren error: one or more tren payloads are missing\n");
-
-              // send tinv due to malformed tren
-              ot_pkt* tinv_reply = ot_pkt_create();
-              tinv_reply_build(tinv_reply, recv_pkt->header, SRV_IP, recv_pkt->header.cli_ip);
-              if (send_pkt(&conn_fd, tinv_reply, rx_buffer, sizeof rx_buffer) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send tinv to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-              }
-              goto cleanup; 
-            }
-
-            // Handle expired clients
-            if (cli_expiry_check(srv_ctx, recv_pkt->header)) 
-            {
-              char macstr[24] = {0};
-              bytes_to_macstr(recv_pkt->header.cli_mac, macstr);
-              printf("[ot srv] client %s is expired, deleting...\n", macstr);
-              ht_delete(srv_ctx->ctable, macstr);
-
-              // send tinv due to expired client
-              ot_pkt* tinv_reply = ot_pkt_create();
-              tinv_reply_build(tinv_reply, recv_pkt->header, SRV_IP, recv_pkt->header.cli_ip);
-              if (send_pkt(&conn_fd, tinv_reply, rx_buffer, sizeof rx_buffer) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send tinv to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-              }
-
-              goto cleanup;
-            }
-
-            // Check whether client is eligible for renewal (within renewal window)
-            if (!tren_renewal_time_check(srv_ctx, recv_pkt->header.cli_mac, curr_time))
-            {
-              // send tinv due to renewal time error
-              ot_pkt* tinv_reply = ot_pkt_create();
-              tinv_reply_build(tinv_reply, recv_pkt->header, SRV_IP, recv_pkt->header.cli_ip);
-              if (send_pkt(&conn_fd, tinv_reply, rx_buffer, sizeof rx_buffer) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send tinv to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-              }
-
-              printf("[ot srv] renewal bound error: client %s, replied with TINV\n",
-                     inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-
-              goto cleanup; 
-            } else {
-              // Get reference of cli ctx but change the expiry and renewal
-              // Replace cli ctx mapped by cli mac with new cli ctx
-
-              // Convert MAC bytes to string key
-              char macstr[24] = {0};
-              bytes_to_macstr(recv_pkt->header.cli_mac, macstr);
-
-              // Reference the client context 
-              ot_cli_ctx* reference_cc = ht_get(srv_ctx->ctable, macstr);
-              ot_cli_ctx updated_cc = *reference_cc;
-
-              time(&curr_time);
-              updated_cc.ctx_exp_time = curr_time + DEF_EXP_TIME;
-              updated_cc.ctx_renew_time = curr_time + 0.75*DEF_EXP_TIME;
-              if (strcmp(macstr, "00:00:00:ab:ab:ff") == 0)
-              {
-                updated_cc.ctx_exp_time = curr_time + 20;
-                updated_cc.ctx_renew_time = curr_time + 0.75*20;
-              }
-
-              // Replace existing entry in srv ctx with the new client context
-              ht_delete(srv_ctx->ctable, macstr);
-              const char* set_cc = ht_set(&(srv_ctx->ctable), macstr,
-                                        &updated_cc, sizeof(updated_cc));
-              if (strcmp(macstr, set_cc) != 0)
-              {
-                fprintf(stderr, "[ot srv] failed to replace client context with mac %s\n", macstr);
-                //send_oerr(conn_fd);
-                goto cleanup;
-              }
-
-              printf("[ot srv] successfully renewed client context for %s\n", macstr);
-
-              // Allocate memory for TPRV reply to client then build
-              ot_pkt* tprv_reply = ot_pkt_create();
-              tprv_reply_build(tprv_reply, recv_pkt->header, SRV_IP, 
-                               recv_pkt->header.cli_ip, DEF_EXP_TIME, 0.75*DEF_EXP_TIME);
-
-              size_t bytes_serialized;
-              if ( (bytes_serialized = ot_pkt_serialize(tprv_reply, rx_buffer, sizeof rx_buffer)) < 0 ) 
-              {
-                fprintf(stderr, "[ot srv] error: failed to serialize tprv reply\n");
-                goto cleanup;
-              }
-
-              if (send(conn_fd, rx_buffer, bytes_serialized, 0) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send tprv to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-                goto cleanup;
-              }
-              printf("[ot srv] sent TPRV reply (%zuB) to %s\n",
-                     bytes_serialized,
-                     inet_ntop(AF_INET,&address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-            }
-
-            break;
+            updated_cc.ctx_exp_time = curr_time + 20;
+            updated_cc.ctx_renew_time = curr_time + 0.75*20;
           }
-        case CSEND: 
+
+          // Replace existing entry in srv ctx with the new client context
+          if (!ot_srv_set_cli_ctx_mac(sc, mac, updated_cc))
           {
-            printf("[ot srv] CSEND from %s\n",
-                   inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-            // validate the inbound csend packet
-            if (!csend_pl_validate(srv_ctx, ptable, recv_pkt)) 
-            {
-              // If invalid csend, begin building cinv pkt reply
-              ot_pkt* cinv_reply = ot_pkt_create();
-
-              // Do we have a possible hash payload?
-              uint64_t* phash = ht_get(ptable, "PL_HASH");
-              uint64_t hash; //<< stackvar for hash payload
-
-              // If hash payload exists, set it to hash stackvar. Otherwise set it to 0
-              if (phash == NULL) {
-                fprintf(stderr, "[ot srv] csend_pl_validate error: could not find pl_hash payload\n");
-                hash = 0;
-              } else {
-                hash = *phash;
-              }
-
-              cinv_reply_build(cinv_reply, recv_pkt->header,
-                               SRV_IP, recv_pkt->header.cli_ip, hash);
-
-              // If cinv_reply was not built, destroy the pkt and cleanup
-              if (cinv_reply == NULL) 
-              {
-                ot_pkt_destroy(&cinv_reply);
-                goto cleanup;
-              }
-
-              if (send_pkt(&conn_fd, cinv_reply, rx_buffer, sizeof rx_buffer) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send cinv to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-              }
-
-              printf("[ot srv] malformed csend: client %s, replied with CINV\n",
-                     inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-
-              ot_pkt_destroy(&cinv_reply);
-              goto cleanup;
-            }
-
-            // Safely extract phash
-            uint64_t* phash_validated = ht_get(ptable, "PL_HASH");
-
-            printf("[ot srv] received hash %llx\n", *phash_validated);
-
-            // Handle expired clients
-            char macstr[24] = {0};
-            bytes_to_macstr(recv_pkt->header.cli_mac, macstr);
-            if (cli_expiry_check(srv_ctx, recv_pkt->header)) 
-            {
-              printf("[ot srv] client %s for csend is expired, deleting...\n", macstr);
-              ht_delete(srv_ctx->ctable, macstr);
-
-              ot_pkt* cinv_reply = ot_pkt_create();
-            
-              cinv_reply_build(cinv_reply, recv_pkt->header, SRV_IP, recv_pkt->header.cli_ip, *phash_validated);
-
-              // If cinv_reply was not built, destroy the pkt and cleanup
-              if (cinv_reply == NULL) 
-              {
-                ot_pkt_destroy(&cinv_reply);
-                goto cleanup;
-              }
-
-              if (send_pkt(&conn_fd, cinv_reply, rx_buffer, sizeof rx_buffer) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send cinv to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-              }
-
-              ot_pkt_destroy(&cinv_reply);
-              goto cleanup;
-            }
-
-            // CSEND pkt is valid by this point. Start building CVAL/CINV reply if hash exists 
-
-            // Convert hash to key first
-            char hashbuf[16] = {0};
-            snprintf(hashbuf, sizeof hashbuf, "%llx", *phash_validated);
-
-            // Decide if we send a CVAL or CINV (if hash exists in otable)
-            uint64_t* check_hash = ht_get(srv_ctx->otable, hashbuf);
-            if (check_hash == NULL)
-            {
-              ot_pkt* cinv_reply = ot_pkt_create();
-              cinv_reply_build(cinv_reply, recv_pkt->header, SRV_IP, recv_pkt->header.cli_ip,
-                               *phash_validated);
-
-              ssize_t bytes_serialized;
-              if ((bytes_serialized = send_pkt(&conn_fd, cinv_reply, rx_buffer, sizeof rx_buffer)) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send cval to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-              }
-
-              // Destroy pkt after use
-              ot_pkt_destroy(&cinv_reply);
-
-              printf("[ot srv] sent CINV reply (%zuB) to %s\n",
-                     bytes_serialized,
-                     inet_ntop(AF_INET,&address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-            } else {
-              ot_pkt* cval_reply = ot_pkt_create();
-              cval_reply_build(cval_reply, recv_pkt->header, SRV_IP, recv_pkt->header.cli_ip,
-                               *phash_validated);
-
-              ssize_t bytes_serialized;
-              if ((bytes_serialized = send_pkt(&conn_fd, cval_reply, rx_buffer, sizeof rx_buffer)) < 0) 
-              {
-                fprintf(stderr, "[ot srv] failed to send cval to %s\n",
-                        inet_ntop(AF_INET, &address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-              }
-
-              // Destroy pkt after use
-              ot_pkt_destroy(&cval_reply);
-
-              printf("[ot srv] sent CVAL reply (%zuB) to %s\n",
-                     bytes_serialized,
-                     inet_ntop(AF_INET,&address.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN));
-            }
-
-            break;
+            SRV_ERR(peer, "[ot srv] failed to replace client context with mac " SRV_MAC_FMT "\n", 
+                    SRV_MAC_ARGS(recv_pkt->header.cli_mac));
+            //send_oerr(conn_fd);
+            goto cleanup;
           }
-        default: 
+
+          SRV_LOG(peer, "[ot srv] successfully renewed client context for " SRV_MAC_FMT "\n", 
+                  SRV_MAC_ARGS(recv_pkt->header.cli_mac));
+
+          // Queue the TPRV reply to the client
+          ssize_t bytes_serialized;
+          if ((bytes_serialized = tprv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, 
+                                                   recv_pkt->header.cli_ip, DEF_EXP_TIME, 0.75*DEF_EXP_TIME)) < 0) 
           {
-            assert("illegal client state; not yet implemented" && false);
-            break;
+            SRV_ERR(peer, "[ot srv] failed to send tprv to %s\n", srv_peer(peer));
+            goto cleanup;
           }
+
+          SRV_LOG(peer, "[ot srv] sent TPRV reply (%zuB) to %s\n",
+                  bytes_serialized, srv_peer(peer));
+        }
+
+        break;
       }
+    case CSEND: 
+      {
+        SRV_LOG(peer, "[ot srv] CSEND from %s\n", srv_peer(peer));
+        // validate the inbound csend packet
+        if (!csend_pl_validate(sc, recv_pkt, peer)) 
+        {
+          // If invalid csend, reply with a cinv pkt
+          // Do we have a possible hash payload? If so, echo it. Otherwise set it to 0
+          uint64_t hash = 0; //<< stackvar for hash payload
+          if (!ot_pkt_view_u64(recv_pkt, PL_HASH, &hash)) {
+            SRV_ERR(peer, "[ot srv] csend_pl_validate error: could not find pl_hash payload\n");
+            hash = 0;
+          }
 
-    cleanup:
-      ht_destroy(ptable);
-      ptable=NULL;
-      ot_pkt_destroy(&recv_pkt);
+          if (cinv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, recv_pkt->header.cli_ip, hash) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send cinv to %s\n", srv_peer(peer));
+          }
 
-      close(conn_fd);
-    }
-  }
+          SRV_LOG(peer, "[ot srv] malformed csend: client %s, replied with CINV\n", srv_peer(peer));
 
-  printf("[ot srv] shutting down...\n");
-  ot_srv_ctx_destroy(&srv_ctx);
-  close(server_fd);
-  return;
-}
+          goto cleanup;
+        }
 
-static bool srv_add_cli_ctx(ot_srv_ctx* sc, ot_pkt* pkt)
-{
-  if (sc == NULL || sc->ctable == NULL || pkt == NULL) return false;
+        // Safely extract the hash
+        uint64_t hash_validated = 0;
+        ot_pkt_view_u64(recv_pkt, PL_HASH, &hash_validated);
 
-  char macstr[24] = {0};
-  bytes_to_macstr(pkt->header.cli_mac, macstr);
+        SRV_LOG(peer, "[ot srv] received hash %llx\n", hash_validated);
 
-  uint32_t etime = DEF_EXP_TIME;
-  if (strcmp(macstr, "00:00:00:ab:ab:ff") == 0) 
-  {
-    etime = 20; 
-  }
+        // Handle expired clients
+        if (cli_expiry_check(sc, recv_pkt->header, curr_time)) 
+        {
+          SRV_LOG(peer, "[ot srv] client " SRV_MAC_FMT " for csend is expired, deleting...\n", 
+                  SRV_MAC_ARGS(recv_pkt->header.cli_mac));
+          ot_srv_del_cli_ctx_mac(sc, ot_mac_pack(recv_pkt->header.cli_mac));
 
-  uint32_t rtime = 0.75 * etime;
+          if (cinv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, recv_pkt->header.cli_ip, 
+                               hash_validated) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send cinv to %s\n", srv_peer(peer));
+          }
+
+          goto cleanup;
+        }
+
+        // CSEND pkt is valid by this point. Start building CVAL/CINV reply if hash exists 
+
+        // Convert hash to key first
+        char hashbuf[16] = {0};
+        snprintf(hashbuf, sizeof hashbuf, "%llx", hash_validated);
+
+        // Decide if we send a CVAL or CINV (if hash exists in otable)
+        uint64_t* check_hash = ht_get(sc->otable, hashbuf);
+        if (check_hash == NULL)
+        {
+          ssize_t bytes_serialized;
+          if ((bytes_serialized = cinv_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, 
+                                                   recv_pkt->header.cli_ip, hash_validated)) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send cval to %s\n", srv_peer(peer));
+          }
+
+
+          SRV_LOG(peer, "[ot srv] sent CINV reply (%zuB) to %s\n",
+                  bytes_serialized, srv_peer(peer));
+        } else {
+          ssize_t bytes_serialized;
+          if ((bytes_serialized = cval_reply_queue(out, recv_pkt->header, sc->sc_mdata.srv_ip, 
+                                                   recv_pkt->header.cli_ip, hash_validated)) < 0) 
+          {
+            SRV_ERR(peer, "[ot srv] failed to send cval to %s\n", srv_peer(peer));
+          }
 
-  pkt->header.exp_time = etime;
-  pkt->header.renew_time = rtime;
 
-  time_t curr_time;
-  time(&curr_time);
+          SRV_LOG(peer, "[ot srv] sent CVAL reply (%zuB) to %s\n",
+                  bytes_serialized, srv_peer(peer));
+        }
 
-  ot_cli_ctx cc = ot_cli_ctx_create(pkt->header, curr_time + etime, curr_time + rtime);
+        break;
+      }
+    default: 
+      {
+        // Reply states (TACK, TINV, CVAL, ...) and unknown states are not requests
+        SRV_LOG(peer, "[ot srv] unexpected state %u from %s, left unanswered\n", raw_recv_state, 
+                srv_peer(peer));
+        goto cleanup;
+      }
+  }
 
-  const char* set_cc = ht_set(&(sc->ctable), macstr, &cc, sizeof(cc));
-  return (strcmp(set_cc, macstr) == 0);
+cleanup:
+  return (ssize_t)out->len;
 }
 
-static void err_pl_treq_validate(const char* pl) 
+// Handles a pkt buffered in a connection and appends its reply to the tx buffer of the connection
+static void srv_conn_handle(ot_srv_ctx* sc, srv_conn* conn, uint8_t* pkt, size_t len)
 {
-  if (pl == NULL) return;
-  fprintf(stderr, "[ot srv] treq validation error: failed to find %s\n", pl);
+  char ipbuf[INET_ADDRSTRLEN] = {0}; //<< for printing IP addresses via inet_ntop
+  inet_ntop(AF_INET, &conn->addr.sin_addr.s_addr, ipbuf, INET_ADDRSTRLEN);
+
+  srv_out out = { .buf = &conn->tx_buffer[conn->tx_len], .cap = sizeof(conn->tx_buffer) - conn->tx_len };
+  conn->tx_len += (size_t)srv_handle(sc, pkt, len, &out, time(NULL), ipbuf);
 }
 
+// Handles a single request pkt without any I/O, see ot_server.h
+ssize_t ot_srv_handle(ot_srv_ctx* sc, const uint8_t* in, size_t inlen, uint8_t* out, size_t outcap, 
+                      time_t now)
+{
+  if (sc == NULL || in == NULL || out == NULL) return -1;
+
+  pthread_once(&srv_reply_tmpls_once, srv_reply_tmpls_build);
+  if (!srv_reply_tmpls_ready) return -1;
+
+  if (ot_pkt_frame_len(in, inlen) != (ssize_t)inlen) return 0; //<< not exactly one frame
+
+  srv_out reply = { .buf = out, .cap = outcap };
+  return srv_handle(sc, in, inlen, &reply, now, NULL);
+}
 
-static bool pl_treq_validate(ot_srv_ctx* sc, ht* ptable, ot_pkt* recv_pkt)
+// Returns the current monotonic time in milliseconds
+static int64_t srv_now_ms(void)
 {
-  if (sc == NULL || ptable == NULL || recv_pkt == NULL) return false;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-  uint32_t* expected_srv_ip = ht_get(ptable, "PL_SRV_IP");
-  uint32_t* expected_cli_ip = ht_get(ptable, "PL_CLI_IP");
-  uint32_t* expected_cli_mac = ht_get(ptable, "PL_CLI_MAC");
+// Removes a connection from the idle list of its worker
+static void srv_idle_unlink(srv_worker* w, srv_conn* conn)
+{
+  if (!conn->idle_linked) return;
 
-  if (expected_srv_ip == NULL) 
-  {
-    err_pl_treq_validate("PL_SRV_IP");
-    return false;
-  }
-  if (expected_cli_ip == NULL) 
+  if (conn->idle_prev != NULL) 
   {
-    err_pl_treq_validate("PL_CLI_IP");
-    return false;
+    conn->idle_prev->idle_next = conn->idle_next;
+  } else {
+    w->idle_head = conn->idle_next;
   }
-  if (expected_cli_mac == NULL) 
+  if (conn->idle_next != NULL) 
   {
-    err_pl_treq_validate("PL_CLI_MAC");
-    return false;
+    conn->idle_next->idle_prev = conn->idle_prev;
+  } else {
+    w->idle_tail = conn->idle_prev;
   }
 
-  char macstr[24] = {0};
-  bytes_to_macstr(recv_pkt->header.cli_mac, macstr);
-
-  ot_cli_ctx* check_cc = ht_get(sc->ctable, macstr);
-  if (check_cc != NULL) return false; // TREQs are not valid for clients that already exist in the ctable
-
-  return true;
+  conn->idle_prev = NULL;
+  conn->idle_next = NULL;
+  conn->idle_linked = false;
 }
 
-// Serializes and sends a pkt to an existing TCP client  
-static ssize_t send_pkt(int* sockfd, ot_pkt* pkt, uint8_t* buf, size_t buflen)
+// Restarts the idle timer of a connection
+//
+// All connections of a worker share the same timeout, so appending keeps the idle list sorted by 
+// deadline.
+static void srv_idle_touch(srv_worker* w, srv_conn* conn)
 {
-  int retval = -1;
-  ssize_t bytes_serialized;
-  if ((bytes_serialized = ot_pkt_serialize(pkt, buf, buflen)) < 0)
+  if (w->idle_timeout <= 0) return;
+
+  srv_idle_unlink(w, conn);
+
+  conn->idle_deadline = srv_now_ms() + (int64_t)w->idle_timeout * 1000;
+  conn->idle_prev = w->idle_tail;
+  if (w->idle_tail != NULL) 
   {
-    fprintf(stderr, "[ot srv] error: failed to serialize pkt\n");
-    return -1;
+    w->idle_tail->idle_next = conn;
   } else {
-    retval = send(*sockfd, buf, bytes_serialized, 0);
+    w->idle_head = conn;
   }
+  w->idle_tail = conn;
+  conn->idle_linked = true;
+}
 
-  return retval;
+// Resets the buffers and stream state of a connection
+static void srv_conn_reset(srv_conn* conn)
+{
+  conn->hup = false;
+  conn->drop = false;
+  conn->served = false;
+  ot_pkt_parser_init(&conn->rx, conn->rx_buffer, sizeof(conn->rx_buffer));
+  conn->tx_len = 0;
+  conn->tx_off = 0;
 }
 
-static bool cli_expiry_check(ot_srv_ctx* sc, ot_pkt_header hd)
+// Closes a connection and frees its state
+static void srv_conn_close(srv_worker* w, srv_conn* conn)
 {
-  if (sc == NULL) return true;
+  if (conn == NULL) return;
 
-  char macstr[24] = {0};
-  bytes_to_macstr(hd.cli_mac, macstr);
+  srv_idle_unlink(w, conn);
+  close(conn->fd); //<< also removes the fd from the epoll set
+  free(conn);
+}
 
-  ot_cli_ctx* pcc = ht_get(sc->ctable, macstr);
-  ot_cli_ctx cc = *pcc;
-  
-  time_t ctx_exp_time = cc.ctx_exp_time;
+// Closes the connections whose idle timer ran out
+//
+// Returns the milliseconds until the next idle timer runs out, or -1 if no connection is idle.
+static int srv_idle_sweep(srv_worker* w)
+{
+  if (w->idle_head == NULL) return -1;
 
-  time_t curr_time;
-  time(&curr_time);
+  int64_t now = srv_now_ms();
+  while (w->idle_head != NULL && w->idle_head->idle_deadline <= now)
+  {
+    srv_conn* conn = w->idle_head;
+    srv_idle_unlink(w, conn);
 
-  if (curr_time >= ctx_exp_time) return true;
+    // On io_uring the connection has an operation in flight, failing it closes the connection
+    if (w->ring != NULL)
+    {
+      shutdown(conn->fd, SHUT_RDWR);
+    } else {
+      srv_conn_close(w, conn);
+    }
+  }
 
-  return false;
+  return (w->idle_head != NULL) ? (int)(w->idle_head->idle_deadline - now) : -1;
 }
 
-// Validates a deserialized TREN pkt.
+// Flushes the tx buffer of a connection
 //
-// Checks whether the correct payloads exist and correlate with the header
-//
-// Returns true if the pkt is valid, otherwise false.
-static bool tren_pl_validate(ot_srv_ctx* sc, ht* ptable, ot_pkt* recv_pkt)
+// Returns 1 if the tx buffer was fully written, 0 if the socket would block, and -1 on error.
+static int srv_conn_flush(srv_conn* conn)
 {
-  if (sc == NULL || ptable == NULL || recv_pkt == NULL)
+  while (conn->tx_off < conn->tx_len)
   {
-    fprintf(stderr, "[ot srv] tren validation error: sc, ptable, or recv pkt is/are null\n");
-    return false;
+    ssize_t bytes_sent = send(conn->fd, &conn->tx_buffer[conn->tx_off], 
+                              conn->tx_len - conn->tx_off, MSG_NOSIGNAL);
+    if (bytes_sent < 0)
+    {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      perror("send failed");
+      return -1;
+    }
+    conn->tx_off += (size_t)bytes_sent;
   }
 
-  // Check mandatory fields in ptable
-  ot_cli_state_t* pl_state = ht_get(ptable, "PL_STATE");
-  uint32_t* pl_srv_ip = ht_get(ptable, "PL_SRV_IP");
-  uint32_t* pl_cli_ip = ht_get(ptable, "PL_CLI_IP");
-  uint8_t* pl_cli_mac = ht_get(ptable, "PL_CLI_MAC");
+  return 1;
+}
 
-  if (pl_srv_ip == NULL)
+// Reads from a connection straight into its stream parser until the socket would block or the rx 
+// buffer is full, and sets nread to the number of bytes read
+//
+// Returns 1 if the peer is still connected, 0 if the peer closed the connection, and -1 on error.
+static int srv_conn_read(srv_conn* conn, size_t* nread)
+{
+  *nread = 0;
+  while (1)
   {
-    fprintf(stderr, "[ot srv] tren validation error: pl_srv_ip not found\n");
-    return false;
+    size_t room;
+    uint8_t* dst = ot_pkt_parser_room(&conn->rx, &room);
+    if (room == 0) return 1;
+
+    ssize_t bytes_received = recv(conn->fd, dst, room, 0);
+    if (bytes_received < 0)
+    {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+      perror("recv failed");
+      return -1;
+    }
+    if (bytes_received == 0) return 0;
+
+    ot_pkt_parser_feed(&conn->rx, (size_t)bytes_received);
+    *nread += (size_t)bytes_received;
   }
-  if (pl_cli_ip == NULL)
+}
+
+// Finds the worker owning the ctable shard of the client that sent a pkt
+//
+// Clients are partitioned across shards by an FNV-1a hash of the header cli_mac.
+static int srv_pkt_shard(srv_worker* w, const uint8_t* pkt)
+{
+  if (!w->sharded) return w->id;
+
+  const uint8_t* cli_mac = &pkt[sizeof(ot_pkt_frame) + offsetof(ot_pkt_header, cli_mac)];
+
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < 6; ++i)
   {
-    fprintf(stderr, "[ot srv] tren validation error: pl_cli_ip not found\n");
-    return false;
+    hash ^= cli_mac[i];
+    hash *= 16777619u;
   }
-  if (pl_cli_mac == NULL)
+
+  return (int)(hash % (uint32_t)w->nworkers);
+}
+
+// Hands a connection to the inbox of another worker and wakes it up if it is idle
+//
+// Returns false if the inbox of the target worker is full.
+static bool srv_worker_push(srv_worker* target, srv_conn* conn)
+{
+  if (!mpscq_push(target->inbox, conn)) return false;
+
+  // Only the first producer since the target last drained its inbox pays for the eventfd write
+  if (__atomic_exchange_n(&target->wake_pending, 1, __ATOMIC_ACQ_REL) == 0)
   {
-    fprintf(stderr, "[ot srv] tren validation error: pl_cli_mac not found\n");
-    return false;
+    uint64_t one = 1;
+    if (write(target->wake_fd, &one, sizeof(one)) < 0) perror("eventfd write failed");
   }
-  
-  if (*pl_srv_ip != recv_pkt->header.srv_ip) return false;
-  if (*pl_cli_ip != recv_pkt->header.cli_ip) return false;
-  if (memcmp(pl_cli_mac, recv_pkt->header.cli_mac, 6) != 0) return false;
 
-  // Lastly, check if the client mac maps to an existing client context
-  char macstr[24];
-  bytes_to_macstr(pl_cli_mac, macstr);
-  ot_cli_ctx* cc_get = ht_get(sc->ctable, macstr);
-  if (cc_get == NULL) 
+  return true;
+}
+
+// Posts a connection to another worker, parking it in the local backlog if that worker's inbox is full
+static void srv_worker_post(srv_worker* w, srv_conn* conn, int target)
+{
+  conn->route = target;
+  conn->next = NULL;
+
+  // Keep posting order, nothing may overtake connections already parked in the backlog
+  if (w->backlog_head == NULL && srv_worker_push(&w->peers[target], conn)) return;
+
+  if (w->backlog_tail == NULL) 
   {
-    fprintf(stderr, "[ot srv] pl_tren_validate warning: client %s does not exist\n", macstr);
-    return false;
+    w->backlog_head = conn;
+  } else {
+    w->backlog_tail->next = conn;
   }
+  w->backlog_tail = conn;
+}
+
+// Retries posting the connections parked in the local backlog
+static void srv_worker_flush_backlog(srv_worker* w)
+{
+  while (w->backlog_head != NULL)
+  {
+    srv_conn* conn = w->backlog_head;
+    if (!srv_worker_push(&w->peers[conn->route], conn)) return;
 
-  // Check if client exists in the first place
-  ot_cli_ctx cc = *cc_get;
+    w->backlog_head = conn->next;
+    if (w->backlog_head == NULL) w->backlog_tail = NULL;
+  }
+}
 
-  if ( cc.state == UNKN ) return false;
+// Reports a connection whose byte stream cannot be split into frames
+static void srv_frame_reject(srv_conn* conn, ssize_t err)
+{
+  char ipbuf[INET_ADDRSTRLEN] = {0};
+  inet_ntop(AF_INET, &conn->addr.sin_addr.s_addr, (char*)ipbuf, INET_ADDRSTRLEN);
 
-  return true;
+  switch (err)
+  {
+    case OT_FRAME_ELEGACY:
+      fprintf(stderr, "[ot srv] recv error: unframed pkt from pre-v%d peer %s\n", OT_WIRE_VERSION, ipbuf);
+      break;
+    case OT_FRAME_EVERSION:
+      fprintf(stderr, "[ot srv] recv error: unsupported wire version %u from %s\n", 
+              conn->rx.buf[conn->rx.head + 2], ipbuf);
+      break;
+    case OT_FRAME_EINVAL:
+      fprintf(stderr, "[ot srv] recv error: invalid frame length from %s\n", ipbuf);
+      break;
+    case OT_FRAME_ETOOBIG:
+      fprintf(stderr, "[ot srv] recv error: pkt exceeds %d bytes\n", MAX_RECV_SIZE);
+      break;
+    default:
+      fprintf(stderr, "[ot srv] recv error: malformed stream from %s\n", ipbuf);
+      break;
+  }
 }
 
-static bool csend_pl_validate(ot_srv_ctx* sc, ht* ptable, ot_pkt* recv_pkt)
+// Handles the complete frames buffered on a connection in order, for as long as their pkts belong to 
+// the ctable shard of the worker
+//
+// Stops early once the tx buffer has no room left for another reply. A pkt the server does not answer
+// (e.g. malformed, or sent by a peer that does not speak this wire version) ends the stream, since any
+// reply after it would be taken for its own. Returns the worker owning the next pkt, which is w->id
+// unless that pkt has to be forwarded.
+static int srv_conn_run(srv_worker* w, srv_conn* conn)
 {
-  if (sc == NULL || ptable == NULL || recv_pkt == NULL)
+  int owner = w->id;
+
+  while (!conn->drop && conn->tx_len + SRV_MAX_REPLY_SIZE <= sizeof(conn->tx_buffer))
   {
-    fprintf(stderr, "[ot srv] tren validation error: sc, ptable, or recv pkt is/are null\n");
-    return false;
+    uint8_t* pkt;
+    size_t len;
+    int ret = ot_pkt_parser_peek(&conn->rx, &pkt, &len);
+    if (ret == 0) break;
+    if (ret < 0)
+    {
+      srv_frame_reject(conn, ret);
+      conn->drop = true;
+      break;
+    }
+
+    if ((owner = srv_pkt_shard(w, pkt)) != w->id) break;
+
+    size_t tx_len = conn->tx_len;
+    srv_conn_handle(w->sc, conn, pkt, len);
+    ot_pkt_parser_pop(&conn->rx);
+
+    if (conn->tx_len == tx_len) conn->drop = true;
   }
 
-  // Check mandatory fields in ptable
-  uint32_t* pl_srv_ip = ht_get(ptable, "PL_SRV_IP");
-  uint32_t* pl_cli_ip = ht_get(ptable, "PL_CLI_IP");
-  uint64_t* pl_hash = ht_get(ptable, "PL_HASH");
+  return owner;
+}
 
-  if (pl_srv_ip == NULL)
+// Handles the buffered pkts of a connection, or forwards it to the worker owning the next pkt
+//
+// Returns false if the connection was forwarded, it then belongs to the other worker until it is
+// posted back with the replies.
+static bool srv_conn_process(srv_worker* w, srv_conn* conn)
+{
+  int owner = srv_conn_run(w, conn);
+  if (owner != w->id)
   {
-    fprintf(stderr, "[ot srv] csend validation error: pl_srv_ip not found\n");
+    // In flight connections are not idle, their timer restarts once they come back
+    srv_idle_unlink(w, conn);
+    conn->inflight = true;
+    srv_worker_post(w, conn, owner);
     return false;
   }
-  if (pl_cli_ip == NULL)
+
+  return true;
+}
+
+static void srv_conn_serve(srv_worker* w, srv_conn* conn);
+
+// Resumes a connection that comes back from the owners of the ctable shards of its pkts
+static void srv_conn_complete(srv_worker* w, srv_conn* conn)
+{
+  conn->inflight = false;
+
+  if (conn->dgram)
   {
-    fprintf(stderr, "[ot srv] csend validation error: pl_cli_ip not found\n");
-    return false;
+    srv_udp_reply_send(w, conn);
+    free(conn);
+    return;
   }
-  if (pl_hash == NULL)
+  if (conn->shm_chan >= 0)
   {
-    fprintf(stderr, "[ot srv] csend validation error: pl_hash not found\n");
-    return false;
+    srv_shm_reply_send(w, conn);
+    free(conn);
+    return;
   }
-  
-  // Header correlation checks
-  if (*pl_srv_ip != recv_pkt->header.srv_ip) return false;
-  if (*pl_cli_ip != recv_pkt->header.cli_ip) return false;
 
-  // Lastly, check if the client mac maps to an existing client context
-  char macstr[24];
-  bytes_to_macstr(recv_pkt->header.cli_mac, macstr);
-  ot_cli_ctx* cc_get = ht_get(sc->ctable, macstr);
-  if (cc_get == NULL) 
+  if (w->ring != NULL)
   {
-    fprintf(stderr, "[ot srv] csend_pl_validate warning: client %s does not exist\n", macstr);
-    return false;
+    srv_uring_serve(w, conn);
+    return;
   }
 
-  // Check if client exists in the first place
-  ot_cli_ctx cc = *cc_get;
-
-  if ( cc.state == UNKN ) return false;
-
-  return true;
+  srv_conn_serve(w, conn);
 }
 
-// Checks if the client sending a TREN pkt can renew. 
+// Drains the inbox of a worker
 //
-// Validates whether the client is present in the srv ctable, then checks if the current time is within
-// bounds for renewal.
-//
-// Returns true if the client can renew, otherwise false.
-static bool tren_renewal_time_check(ot_srv_ctx* sc, uint8_t* cli_mac, time_t curr_time)
+// The inbox carries pkts forwarded by other workers for the local ctable shard, as well as this
+// worker's own connections coming back with their replies.
+static void srv_worker_drain(srv_worker* w)
 {
-  time(&curr_time);
-  ht* srv_ctable = sc->ctable;
+  uint64_t count;
+  if (read(w->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("eventfd read failed");
 
-  char macstr[24] = {0};
-  bytes_to_macstr(cli_mac, macstr);
+  // Re-arm the wakeup before draining so that a concurrent push is never missed
+  __atomic_exchange_n(&w->wake_pending, 0, __ATOMIC_ACQ_REL);
 
-  ot_cli_ctx* cc_get = ht_get(srv_ctable, macstr);
-  ot_cli_ctx cc = *cc_get;
-  if(cc.state == UNKN) 
+  srv_conn* conn;
+  while ((conn = mpscq_pop(w->inbox)) != NULL)
   {
-    fprintf(stderr, "[ot srv] client %s does not have a context\n", macstr);
-    return false;
-  }
+    if (conn->origin == w->id)
+    {
+      srv_conn_complete(w, conn);
+      continue;
+    }
 
-  /* DEPRECATED, HANDLE EXPIRY FROM RUNTIME
-  // Check if client is expired (delete if it is)
-  uint32_t ctx_exp_time = cc.ctx_exp_time;
-  if (curr_time >= ctx_exp_time) 
-  {
-    ht_delete(srv_ctable, macstr);
-    return false;
+    srv_conn_run(w, conn);
+    srv_worker_post(w, conn, conn->origin);
   }
-  */
-
-  // Return true if within renew bounds
-  uint32_t ctx_renew_time = cc.ctx_renew_time;
-  if (curr_time >= ctx_renew_time) return true;
-
-  return false;
 }
 
-// Builds an allocated TINV reply pkt
+// Serves a connection until its socket would block
 //
-// Sets the header (tinv_hd) and the appropriate payloads (PL_STATE, PL_SRV_IP, PL_CLI_IP)
-// for a valid TINV reply to a client.
-static void tinv_reply_build(ot_pkt* tinv_reply, ot_pkt_header tinv_hd, 
-                             uint32_t srv_ip, uint32_t cli_ip)
+// Handles every complete pkt that has been read and writes out all of their replies at once, then 
+// reads again for as long as the client keeps sending. Once its replies are out, a keep-alive 
+// connection waits for its next pkts while any other connection is closed. In sharded mode, a pkt for
+// a client owned by another worker is forwarded to it and the connection sits idle until it comes back
+// with the reply.
+static void srv_conn_serve(srv_worker* w, srv_conn* conn)
 {
-  if (tinv_reply == NULL) fprintf(stderr, "[ot srv] tinv reply build error: tinv pkt not allocated\n");
-  
-  tinv_reply->header = tinv_hd;
-  
-  uint8_t pl_state_msgtype = PL_STATE;
-  uint8_t pl_state_value = TINV;
-  uint8_t pl_state_vlen = sizeof(pl_state_value);
-  ot_payload* pl_state_payload = ot_payload_create(pl_state_msgtype, &pl_state_value, pl_state_vlen);
-
-  uint8_t pl_srv_ip_msgtype = PL_SRV_IP;
-  uint32_t pl_srv_ip_value = srv_ip;
-  uint8_t pl_srv_ip_vlen = sizeof(pl_srv_ip_value);
-  ot_payload* pl_srv_ip_payload = ot_payload_create(pl_srv_ip_msgtype, &pl_srv_ip_value, pl_srv_ip_vlen);
-
-  uint8_t pl_cli_ip_msgtype = PL_CLI_IP;
-  uint32_t pl_cli_ip_value = cli_ip;
-  uint8_t pl_cli_ip_vlen = sizeof(pl_cli_ip_value);
-  ot_payload* pl_cli_ip_payload = ot_payload_create(pl_cli_ip_msgtype, 
-                                                    &pl_cli_ip_value, 
-                                                    pl_cli_ip_vlen);
-
-  tinv_reply->payload = ot_payload_append(tinv_reply->payload, pl_state_payload);
-  tinv_reply->payload = ot_payload_append(tinv_reply->payload, pl_srv_ip_payload);
-  tinv_reply->payload = ot_payload_append(tinv_reply->payload, pl_cli_ip_payload);
-}
-
-static void tack_reply_build(ot_pkt* tack_reply, ot_pkt_header tack_hd, 
-                             uint32_t srv_ip, uint8_t* srv_mac, uint32_t cli_ip,
-                             uint32_t exp_time, uint32_t renew_time)
-{
-  tack_reply->header = tack_hd;
-
-  // Start building payloads for TACK reply
-
-  // PL_STATE payload
-  uint8_t pl_tack_state_msgtype = (uint8_t)PL_STATE;
-  uint8_t pl_tack_state_value = (uint8_t)TACK;
-  uint8_t pl_tack_state_vlen = (uint8_t)sizeof(pl_tack_state_value);
-  ot_payload* pl_tack_state_payload = ot_payload_create(pl_tack_state_msgtype, 
-                                                        &pl_tack_state_value, 
-                                                        pl_tack_state_vlen);
-
-  // PL_SRV_IP payload
-  uint8_t pl_tack_srv_ip_msgtype = (uint8_t)PL_SRV_IP;
-  uint32_t pl_tack_srv_ip_value = srv_ip;
-  uint8_t pl_tack_srv_ip_vlen = (uint8_t)sizeof(pl_tack_srv_ip_value);
-  ot_payload* pl_tack_srv_ip_payload = ot_payload_create(pl_tack_srv_ip_msgtype, 
-                                                         &pl_tack_srv_ip_value,
-                                                         pl_tack_srv_ip_vlen);
-
-  // PL_SRV_MAC payload
-  uint8_t pl_tack_srv_mac_msgtype = (uint8_t)PL_SRV_MAC;
-  uint8_t pl_tack_srv_mac_value[6] = {0}; 
-  memcpy(pl_tack_srv_mac_value, srv_mac, 6);
-  uint8_t pl_tack_srv_mac_vlen = (uint8_t)sizeof(pl_tack_srv_mac_value);
-  ot_payload* pl_tack_srv_mac_payload = ot_payload_create(pl_tack_srv_mac_msgtype, 
-                                                          &pl_tack_srv_mac_value,
-                                                          pl_tack_srv_mac_vlen);
-
-  uint8_t pl_tack_cli_ip_msgtype = (uint8_t)PL_CLI_IP;
-  uint32_t pl_tack_cli_ip_value = cli_ip;
-  uint8_t pl_tack_cli_ip_vlen = (uint8_t)sizeof(pl_tack_cli_ip_value);
-  ot_payload* pl_tack_cli_ip_payload = ot_payload_create(pl_tack_cli_ip_msgtype, 
-                                                         &pl_tack_cli_ip_value,
-                                                         pl_tack_cli_ip_vlen);
-
-  // PL_ETIME payload
-  uint8_t pl_tack_exp_time_msgtype = (uint8_t)PL_ETIME;
-  uint32_t pl_tack_exp_time_value = exp_time;
-  uint8_t pl_tack_exp_time_vlen = (uint8_t)sizeof(pl_tack_exp_time_value);
-  ot_payload* pl_tack_exp_time_payload = ot_payload_create(pl_tack_exp_time_msgtype, 
-                                                           &pl_tack_exp_time_value,
-                                                           pl_tack_exp_time_vlen);
-
-  // PL_RTIME payload
-  uint8_t pl_tack_renew_time_msgtype = (uint8_t)PL_RTIME;
-  uint32_t pl_tack_renew_time_value = renew_time;
-  uint8_t pl_tack_renew_time_vlen = (uint8_t)sizeof(pl_tack_renew_time_value);
-  ot_payload* pl_tack_renew_time_payload = ot_payload_create(pl_tack_renew_time_msgtype, 
-                                                             &pl_tack_renew_time_value,
-                                                             pl_tack_renew_time_vlen);
-
-  // Build the list on the TACK reply pkt
-  tack_reply->payload = ot_payload_append(tack_reply->payload, pl_tack_state_payload);
-  tack_reply->payload = ot_payload_append(tack_reply->payload, pl_tack_srv_ip_payload);
-  tack_reply->payload = ot_payload_append(tack_reply->payload, pl_tack_srv_mac_payload);
-  tack_reply->payload = ot_payload_append(tack_reply->payload, pl_tack_cli_ip_payload);
-  tack_reply->payload = ot_payload_append(tack_reply->payload, pl_tack_exp_time_payload);
-  tack_reply->payload = ot_payload_append(tack_reply->payload, pl_tack_renew_time_payload);
-}
-
-static void cinv_reply_build(ot_pkt* cinv_reply, ot_pkt_header cinv_hd, uint32_t srv_ip,
-                              uint32_t cli_ip, uint64_t hash)
-{
-  if (cinv_reply == NULL) fprintf(stderr, "[ot srv] cinv reply build error: cval pkt not allocated\n");
-  
-  cinv_reply->header = cinv_hd;
-  
-  uint8_t pl_state_msgtype = PL_STATE;
-  uint8_t pl_state_value = CINV;
-  uint8_t pl_state_vlen = sizeof(pl_state_value);
-  ot_payload* pl_state_payload = ot_payload_create(pl_state_msgtype, &pl_state_value, pl_state_vlen);
-
-  uint8_t pl_srv_ip_msgtype = PL_SRV_IP;
-  uint32_t pl_srv_ip_value = srv_ip;
-  uint8_t pl_srv_ip_vlen = sizeof(pl_srv_ip_value);
-  ot_payload* pl_srv_ip_payload = ot_payload_create(pl_srv_ip_msgtype, &pl_srv_ip_value, 
-                                                    pl_srv_ip_vlen);
-
-  uint8_t pl_cli_ip_msgtype = PL_CLI_IP;
-  uint32_t pl_cli_ip_value = cli_ip;
-  uint8_t pl_cli_ip_vlen = sizeof(pl_cli_ip_value);
-  ot_payload* pl_cli_ip_payload = ot_payload_create(pl_cli_ip_msgtype, &pl_cli_ip_value, 
-                                                    pl_cli_ip_vlen);
-
-  uint8_t pl_hash_msgtype = PL_HASH;
-  uint64_t pl_hash_value = hash;
-  uint8_t pl_hash_vlen = (uint8_t)sizeof(pl_hash_value);
-  ot_payload* pl_hash_payload = ot_payload_create(pl_hash_msgtype, &pl_hash_value, 
-                                                   pl_hash_vlen);
-
-  cinv_reply->payload = ot_payload_append(cinv_reply->payload, pl_state_payload);
-  cinv_reply->payload = ot_payload_append(cinv_reply->payload, pl_srv_ip_payload);
-  cinv_reply->payload = ot_payload_append(cinv_reply->payload, pl_cli_ip_payload);
-  cinv_reply->payload = ot_payload_append(cinv_reply->payload, pl_hash_payload);
-}
-
-static void cval_reply_build(ot_pkt* cval_reply, ot_pkt_header cval_hd, uint32_t srv_ip,
-                              uint32_t cli_ip, uint64_t hash)
-{
-  if (cval_reply == NULL) fprintf(stderr, "[ot srv] cval reply build error: cval pkt not allocated\n");
-  
-  cval_reply->header = cval_hd;
-  
-  uint8_t pl_state_msgtype = PL_STATE;
-  uint8_t pl_state_value = CVAL;
-  uint8_t pl_state_vlen = sizeof(pl_state_value);
-  ot_payload* pl_state_payload = ot_payload_create(pl_state_msgtype, &pl_state_value, pl_state_vlen);
-
-  uint8_t pl_srv_ip_msgtype = PL_SRV_IP;
-  uint32_t pl_srv_ip_value = srv_ip;
-  uint8_t pl_srv_ip_vlen = sizeof(pl_srv_ip_value);
-  ot_payload* pl_srv_ip_payload = ot_payload_create(pl_srv_ip_msgtype, &pl_srv_ip_value, 
-                                                    pl_srv_ip_vlen);
-
-  uint8_t pl_cli_ip_msgtype = PL_CLI_IP;
-  uint32_t pl_cli_ip_value = cli_ip;
-  uint8_t pl_cli_ip_vlen = sizeof(pl_cli_ip_value);
-  ot_payload* pl_cli_ip_payload = ot_payload_create(pl_cli_ip_msgtype, &pl_cli_ip_value, 
-                                                    pl_cli_ip_vlen);
-
-  uint8_t pl_hash_msgtype = PL_HASH;
-  uint64_t pl_hash_value = hash;
-  uint8_t pl_hash_vlen = (uint8_t)sizeof(pl_hash_value);
-  ot_payload* pl_hash_payload = ot_payload_create(pl_hash_msgtype, &pl_hash_value, pl_hash_vlen);
-
-  cval_reply->payload = ot_payload_append(cval_reply->payload, pl_state_payload);
-  cval_reply->payload = ot_payload_append(cval_reply->payload, pl_srv_ip_payload);
-  cval_reply->payload = ot_payload_append(cval_reply->payload, pl_cli_ip_payload);
-  cval_reply->payload = ot_payload_append(cval_reply->payload, pl_hash_payload);
-}
-
-// Builds an allocated TPRV reply pkt 
-// 
-// Sets the header (tprv_hd) and the appropriate payloads (PL_STATE, PL_SRV_IP, PL_CLI_IP, 
-// PL_ETIME, PL_RTIME) for a valid TPRV reply to a client.
-static void tprv_reply_build(ot_pkt* tprv_reply, ot_pkt_header tprv_hd, uint32_t srv_ip, 
-                             uint32_t cli_ip, uint32_t exp_time, uint32_t renew_time)
-{
-  if (tprv_reply == NULL) fprintf(stderr, "[ot srv] tprv reply build error: tprv pkt not allocated\n");
+  while (1)
+  {
+    if (!srv_conn_process(w, conn)) return;
+
+    if (conn->tx_len > 0)
+    {
+      int wr = srv_conn_flush(conn);
+      if (wr == 0) return; //<< wait for EPOLLOUT
+      if (wr < 0)
+      {
+        srv_conn_close(w, conn);
+        return;
+      }
+
+      conn->tx_len = 0;
+      conn->tx_off = 0;
+      conn->served = true;
+      srv_idle_touch(w, conn);
+      continue; //<< handle the pkts that did not fit the tx buffer
+    }
+
+    // Nothing left to reply with (e.g. malformed pkt, peer hung up), drop the connection
+    if (conn->drop || conn->hup || (w->idle_timeout <= 0 && conn->served))
+    {
+      srv_conn_close(w, conn);
+      return;
+    }
+
+    size_t nread;
+    int rd = srv_conn_read(conn, &nread);
+    if (rd < 0 || (rd == 0 && ot_pkt_parser_buffered(&conn->rx) == 0))
+    {
+      if (rd == 0) printf("[ot srv] Client closed connection.\n");
+      srv_conn_close(w, conn);
+      return;
+    }
+    if (rd == 0) conn->hup = true; //<< reply to the last pkts of the peer, then close
+    if (rd > 0 && nread == 0) return; //<< wait for EPOLLIN
+
+    srv_idle_touch(w, conn);
+  }
+}
+
+// Services an epoll event on a client connection
+static void srv_conn_event(srv_worker* w, srv_conn* conn, uint32_t events)
+{
+  // The owner of the connection is busy with it, remember hangups for when it comes back
+  if (conn->inflight)
+  {
+    if (events & (EPOLLERR | EPOLLHUP)) conn->hup = true;
+    return;
+  }
+
+  if (events & (EPOLLERR | EPOLLHUP))
+  {
+    srv_conn_close(w, conn);
+    return;
+  }
+
+  srv_conn_serve(w, conn);
+}
+
+// Allocates the state of an accepted connection, closes the socket if out of memory
+static srv_conn* srv_conn_create(srv_worker* w, int conn_fd, struct sockaddr_in address)
+{
+  srv_conn* conn = malloc(sizeof(srv_conn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "[ot srv] accept error: out of memory\n");
+    close(conn_fd);
+    return NULL;
+  }
+
+  conn->fd = conn_fd;
+  conn->addr = address;
+  conn->origin = w->id;
+  conn->route = w->id;
+  conn->inflight = false;
+  conn->dgram = false;
+  conn->shm_chan = -1;
+  conn->next = NULL;
+  conn->idle_linked = false;
+  conn->idle_prev = NULL;
+  conn->idle_next = NULL;
+  srv_conn_reset(conn);
+  srv_idle_touch(w, conn);
+
+  return conn;
+}
+
+// Accepts all pending connections on a listening socket and registers them with epoll
+//
+// The unix listener is shared by all workers, so another worker may have taken a connection first.
+static void srv_accept_all(srv_worker* w, int listen_fd)
+{
+  while (1)
+  {
+    struct sockaddr_in address;
+    socklen_t addrlen = sizeof(address);
+
+    int conn_fd = accept4(listen_fd, (struct sockaddr *)&address, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (conn_fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept failed");
+      return;
+    }
+    if (address.sin_family != AF_INET) memset(&address, 0, sizeof(address)); //<< local peers log as 0.0.0.0
+
+    srv_conn* conn = srv_conn_create(w, conn_fd, address);
+    if (conn == NULL) continue;
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = conn;
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, conn_fd, &ev) < 0)
+    {
+      perror("epoll_ctl failed");
+      srv_conn_close(w, conn);
+    }
+  }
+}
+
+/**
+ * UDP transport
+ *
+ * Datagrams are received SRV_UDP_BATCH at a time with recvmmsg, each straight into the stream parser 
+ * of a scratch connection of the worker with its request id split off. The whole batch is handled 
+ * before its replies go out together with sendmmsg, from the tx buffers of the same connections. A 
+ * datagram for a client of another ctable shard is copied into a connection of its own and forwarded 
+ * like any pkt, and comes back with its reply to be sent from the worker that received it.
+ *
+ * Every request gets an entry in the reply cache of the worker that received it, appended to a ring in
+ * order of arrival and found through udp_index. Entries are kept for SRV_UDP_CACHE_TTL_MS, past the last
+ * retransmit of their client, and the ring doubles whenever it is full of entries that young. The entry 
+ * of a forwarded request is marked pending until the request comes back, and its retransmits are 
+ * dropped in the meantime.
+ */
+// Hashes the sender and request id of a UDP request into the key of its reply cache entry
+static uint64_t srv_udp_key(const struct sockaddr_in* addr, const uint8_t* id)
+{
+  uint64_t hash = 14695981039346656037ull;
+  const uint8_t* key[3] = { (const uint8_t*)&addr->sin_addr.s_addr, (const uint8_t*)&addr->sin_port, id };
+  const size_t keylen[3] = { sizeof(addr->sin_addr.s_addr), sizeof(addr->sin_port), OT_UDP_ID_SIZE };
+
+  for (size_t k = 0; k < 3; ++k)
+  {
+    for (size_t i = 0; i < keylen[k]; ++i)
+    {
+      hash ^= key[k][i];
+      hash *= 1099511628211ull;
+    }
+  }
+
+  return hash;
+}
+
+// Drops the reply cache entries of requests whose clients have stopped retransmitting them
+static void srv_udp_expire(srv_worker* w, int64_t now)
+{
+  while (w->udp_cache_head != w->udp_cache_tail)
+  {
+    uint64_t seq = w->udp_cache_head;
+    const srv_udp_reply* cached = &w->udp_cache[seq & (w->udp_cache_cap - 1)];
+    if (now - cached->seen < SRV_UDP_CACHE_TTL_MS) return;
+
+    // A later request with the same key has taken over the index
+    uint64_t* latest = ht_get_u64(w->udp_index, cached->key);
+    if (latest != NULL && *latest == seq) ht_delete_u64(w->udp_index, cached->key);
+    ++w->udp_cache_head;
+  }
+}
+
+// Finds the reply cache entry of the request of conn, returns NULL if the request is new
+static srv_udp_reply* srv_udp_lookup(srv_worker* w, const srv_conn* conn, uint64_t key)
+{
+  uint64_t* seq = ht_get_u64(w->udp_index, key);
+  if (seq == NULL) return NULL;
+
+  srv_udp_reply* cached = &w->udp_cache[*seq & (w->udp_cache_cap - 1)];
+  if (cached->addr.sin_addr.s_addr != conn->addr.sin_addr.s_addr ||
+      cached->addr.sin_port != conn->addr.sin_port ||
+      memcmp(cached->id, conn->udp_id, OT_UDP_ID_SIZE) != 0) return NULL;
+
+  return cached;
+}
+
+// Appends an unanswered entry for the request of conn to the reply cache, doubling the ring if it is
+// full. Returns NULL if out of memory.
+static srv_udp_reply* srv_udp_push(srv_worker* w, const srv_conn* conn, uint64_t key, int64_t now)
+{
+  if (w->udp_cache_tail - w->udp_cache_head == w->udp_cache_cap)
+  {
+    size_t cap = 2 * w->udp_cache_cap;
+    srv_udp_reply* ring = malloc(cap * sizeof(srv_udp_reply));
+    if (ring == NULL) return NULL;
+
+    // Sequence numbers stay the same, so the index does not change
+    for (uint64_t seq = w->udp_cache_head; seq != w->udp_cache_tail; ++seq)
+    {
+      ring[seq & (cap - 1)] = w->udp_cache[seq & (w->udp_cache_cap - 1)];
+    }
+    free(w->udp_cache);
+    w->udp_cache = ring;
+    w->udp_cache_cap = cap;
+  }
+
+  uint64_t seq = w->udp_cache_tail;
+  if (!ht_set_u64(w->udp_index, key, &seq, sizeof(seq))) return NULL;
+  ++w->udp_cache_tail;
+
+  srv_udp_reply* cached = &w->udp_cache[seq & (w->udp_cache_cap - 1)];
+  cached->key = key;
+  cached->addr = conn->addr;
+  memcpy(cached->id, conn->udp_id, OT_UDP_ID_SIZE);
+  cached->seen = now;
+  cached->pending = false;
+  cached->len = 0;
+
+  return cached;
+}
+
+// Sends a reply datagram of len bytes behind the request id of conn to its sender
+static void srv_udp_send(srv_worker* w, srv_conn* conn, const uint8_t* reply, size_t len)
+{
+  struct iovec iov[2] = {
+    { .iov_base = conn->udp_id, .iov_len = OT_UDP_ID_SIZE },
+    { .iov_base = (void*)reply, .iov_len = len },
+  };
+  struct msghdr msg = {0};
+  msg.msg_name = &conn->addr;
+  msg.msg_namelen = sizeof(conn->addr);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  if (sendmsg(w->udp_fd, &msg, MSG_DONTWAIT) < 0) perror("udp send failed");
+}
+
+// Remembers the reply of a handled UDP request for retransmits of the request
+static void srv_udp_remember(srv_worker* w, const srv_conn* conn)
+{
+  int64_t now = srv_now_ms();
+  srv_udp_expire(w, now);
+
+  uint64_t key = srv_udp_key(&conn->addr, conn->udp_id);
+  srv_udp_reply* cached = srv_udp_lookup(w, conn, key);
+  if (cached == NULL) cached = srv_udp_push(w, conn, key, now);
+  if (cached == NULL) return; //<< out of memory, retransmits get handled again
+
+  memcpy(cached->bytes, conn->tx_buffer, conn->tx_len);
+  cached->len = conn->tx_len;
+  cached->pending = false;
+}
+
+// Sends the reply of a UDP request handled by the worker owning its ctable shard
+static void srv_udp_reply_send(srv_worker* w, srv_conn* conn)
+{
+  if (conn->tx_len == 0 || conn->tx_len > SRV_MAX_REPLY_SIZE)
+  {
+    // Unanswered, the retransmit of the client gets handled again
+    srv_udp_reply* cached = srv_udp_lookup(w, conn, srv_udp_key(&conn->addr, conn->udp_id));
+    if (cached != NULL) cached->pending = false;
+    return;
+  }
+
+  srv_udp_send(w, conn, conn->tx_buffer, conn->tx_len);
+  srv_udp_remember(w, conn);
+}
+
+// Copies a received datagram into a connection of its own and forwards it to the worker owning its
+// ctable shard. Returns false if out of memory.
+static bool srv_udp_forward(srv_worker* w, const srv_conn* dgram, const uint8_t* pkt, size_t len, 
+                            int owner)
+{
+  srv_conn* conn = malloc(sizeof(srv_conn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "[ot srv] udp error: out of memory\n");
+    return false;
+  }
+
+  conn->fd = -1;
+  conn->addr = dgram->addr;
+  conn->origin = w->id;
+  conn->inflight = true;
+  conn->dgram = true;
+  conn->shm_chan = -1;
+  memcpy(conn->udp_id, dgram->udp_id, OT_UDP_ID_SIZE);
+  conn->next = NULL;
+  conn->idle_linked = false;
+  conn->idle_prev = NULL;
+  conn->idle_next = NULL;
+  srv_conn_reset(conn);
+
+  size_t room;
+  memcpy(ot_pkt_parser_room(&conn->rx, &room), pkt, len); //<< a datagram always fits an empty parser
+  ot_pkt_parser_feed(&conn->rx, len);
+
+  srv_worker_post(w, conn, owner);
+  return true;
+}
+
+// Handles a datagram of len bytes received into a scratch connection
+//
+// Returns true if the tx buffer of the connection holds a reply to send back.
+static bool srv_udp_handle(srv_worker* w, srv_conn* conn, size_t len, int flags)
+{
+  if ((flags & MSG_TRUNC) || len < OT_UDP_ID_SIZE) return false;
+
+  len -= OT_UDP_ID_SIZE;
+  ot_pkt_parser_feed(&conn->rx, len);
+
+  // A datagram holds exactly one frame
+  uint8_t* pkt;
+  size_t frame_len;
+  int ret = ot_pkt_parser_peek(&conn->rx, &pkt, &frame_len);
+  if (ret < 0) srv_frame_reject(conn, ret);
+  if (ret != 1 || frame_len != len) return false;
+
+  // A retransmit is answered with the reply already sent, or dropped while the request is forwarded
+  int64_t now = srv_now_ms();
+  srv_udp_expire(w, now);
+
+  uint64_t key = srv_udp_key(&conn->addr, conn->udp_id);
+  srv_udp_reply* cached = srv_udp_lookup(w, conn, key);
+  if (cached != NULL && cached->pending) return false;
+  if (cached != NULL && cached->len > 0)
+  {
+    memcpy(conn->tx_buffer, cached->bytes, cached->len);
+    conn->tx_len = cached->len;
+    return true;
+  }
+
+  int owner = srv_pkt_shard(w, pkt);
+  if (owner != w->id)
+  {
+    if (cached == NULL) cached = srv_udp_push(w, conn, key, now);
+    if (srv_udp_forward(w, conn, pkt, len, owner) && cached != NULL) cached->pending = true;
+    return false;
+  }
+
+  srv_conn_run(w, conn);
+  if (conn->tx_len == 0 || conn->tx_len > SRV_MAX_REPLY_SIZE) return false; //<< unanswered, the client retries
+
+  srv_udp_remember(w, conn);
+  return true;
+}
+
+// Points a message at the request id of a scratch connection followed by len bytes at buf
+static void srv_udp_msg(struct mmsghdr* msg, struct iovec* iov, srv_conn* conn, void* buf, size_t len)
+{
+  iov[0] = (struct iovec){ .iov_base = conn->udp_id, .iov_len = OT_UDP_ID_SIZE };
+  iov[1] = (struct iovec){ .iov_base = buf, .iov_len = len };
+
+  memset(msg, 0, sizeof(*msg));
+  msg->msg_hdr.msg_name = &conn->addr;
+  msg->msg_hdr.msg_namelen = sizeof(conn->addr);
+  msg->msg_hdr.msg_iov = iov;
+  msg->msg_hdr.msg_iovlen = 2;
+}
+
+// Handles every datagram waiting on the UDP socket of a worker, SRV_UDP_BATCH per syscall
+static void srv_udp_drain(srv_worker* w)
+{
+  struct mmsghdr msgs[SRV_UDP_BATCH];
+  struct iovec iov[SRV_UDP_BATCH][2];
+
+  while (1)
+  {
+    // The request id of each datagram lands in a scratch connection, the frame in its stream parser
+    for (int i = 0; i < SRV_UDP_BATCH; ++i)
+    {
+      srv_conn* conn = &w->udp_batch[i];
+      srv_conn_reset(conn);
+
+      size_t room;
+      uint8_t* dst = ot_pkt_parser_room(&conn->rx, &room);
+      srv_udp_msg(&msgs[i], iov[i], conn, dst, room);
+    }
+
+    int nrecv = recvmmsg(w->udp_fd, msgs, SRV_UDP_BATCH, MSG_DONTWAIT, NULL);
+    if (nrecv < 0)
+    {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) perror("udp recv failed");
+      return;
+    }
+
+    // Replies reuse the messages of the batch, never one past the datagram they answer
+    int nreplies = 0;
+    for (int i = 0; i < nrecv; ++i)
+    {
+      srv_conn* conn = &w->udp_batch[i];
+      if (!srv_udp_handle(w, conn, msgs[i].msg_len, msgs[i].msg_hdr.msg_flags)) continue;
+
+      srv_udp_msg(&msgs[nreplies], iov[nreplies], conn, conn->tx_buffer, conn->tx_len);
+      ++nreplies;
+    }
+
+    int nsent = 0;
+    while (nsent < nreplies)
+    {
+      int ret = sendmmsg(w->udp_fd, &msgs[nsent], (unsigned)(nreplies - nsent), MSG_DONTWAIT);
+      if (ret < 0)
+      {
+        if (errno == EINTR) continue;
+        perror("udp send failed"); //<< the clients retransmit the requests of dropped replies
+        break;
+      }
+      nsent += ret;
+    }
+
+    if (nrecv < SRV_UDP_BATCH) return; //<< the socket was emptied
+  }
+}
+
+// Creates a non-blocking UDP socket on DEF_PORT, next to the TCP listeners. Returns the socket or -1.
+static int srv_listen_udp(void)
+{
+  struct sockaddr_in address;
+  int opt = 1;
+
+  int server_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server_fd < 0)
+  {
+    perror("socket failed");
+    return -1;
+  }
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = INADDR_ANY;
+  address.sin_port = htons(DEF_PORT);
+
+  if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) 
+  {
+    perror("bind failed");
+    close(server_fd);
+    return -1;
+  }
+
+  return server_fd;
+}
+
+/**
+ * Shared memory transport
+ *
+ * The ring is served by a worker of its own, with no sockets, that polls the channels for requests and
+ * handles them one by one in a scratch connection. It only sleeps on the futex of the ring after
+ * SHMRING_SPIN rounds without a request. Replies of a channel go out in order, so while a request is
+ * forwarded to the worker owning its ctable shard, the later requests of its channel wait.
+ */
+// Answers the oldest request of a shared memory channel with the replies queued on conn
+static void srv_shm_reply(srv_worker* w, int ch, const srv_conn* conn)
+{
+  size_t len = (conn->tx_len <= SRV_MAX_REPLY_SIZE) ? conn->tx_len : 0; //<< unanswered, see shmring_reply
+  shmring_reply(w->shm, ch, conn->tx_buffer, len);
+  shmring_pop(w->shm, ch);
+}
+
+// Answers a request that comes back from the owner of its ctable shard and unblocks its channel
+static void srv_shm_reply_send(srv_worker* w, srv_conn* conn)
+{
+  srv_shm_reply(w, conn->shm_chan, conn);
+  w->shm_busy[conn->shm_chan] = false;
+  w->shm_inflight--;
+}
+
+// Copies a request into a connection of its own and forwards it to the worker owning its ctable shard
+static bool srv_shm_forward(srv_worker* w, int ch, const uint8_t* pkt, size_t len, int owner)
+{
+  srv_conn* conn = malloc(sizeof(srv_conn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "[ot srv] shm error: out of memory\n");
+    return false;
+  }
+
+  conn->fd = -1;
+  memset(&conn->addr, 0, sizeof(conn->addr));
+  conn->origin = w->id;
+  conn->inflight = true;
+  conn->dgram = false;
+  conn->shm_chan = ch;
+  conn->next = NULL;
+  conn->idle_linked = false;
+  conn->idle_prev = NULL;
+  conn->idle_next = NULL;
+  srv_conn_reset(conn);
+
+  size_t room;
+  memcpy(ot_pkt_parser_room(&conn->rx, &room), pkt, len); //<< a slot always fits an empty parser
+  ot_pkt_parser_feed(&conn->rx, len);
+
+  w->shm_busy[ch] = true;
+  w->shm_inflight++;
+  srv_worker_post(w, conn, owner);
+
+  return true;
+}
+
+// Handles the requests queued on a shared memory channel, returns how many were taken
+static int srv_shm_serve(srv_worker* w, int ch)
+{
+  srv_conn* conn = w->shm_conn;
+  int taken = 0;
+  size_t len;
+  const uint8_t* req;
+
+  while (!w->shm_busy[ch] && (req = shmring_peek(w->shm, ch, &len)) != NULL)
+  {
+    ++taken;
+
+    // The client can still write to the slot, so handle a private copy
+    srv_conn_reset(conn);
+    size_t room;
+    memcpy(ot_pkt_parser_room(&conn->rx, &room), req, len);
+    ot_pkt_parser_feed(&conn->rx, len);
+
+    // A slot holds exactly one frame
+    uint8_t* pkt;
+    size_t frame_len;
+    int ret = ot_pkt_parser_peek(&conn->rx, &pkt, &frame_len);
+    if (ret < 0) srv_frame_reject(conn, ret);
+    if (ret == 1 && frame_len == len)
+    {
+      int owner = srv_pkt_shard(w, pkt);
+      if (owner != w->id && srv_shm_forward(w, ch, pkt, len, owner)) break;
+      if (owner == w->id) srv_conn_run(w, conn);
+    }
+
+    srv_shm_reply(w, ch, conn);
+  }
+
+  return taken;
+}
+
+// Runs the polling loop of the shared memory worker
+static void* srv_shm_main(void* arg)
+{
+  srv_worker* w = arg;
+  unsigned nchan = shmring_nchan(w->shm);
+  int idle_rounds = 0;
+
+  while (1)
+  {
+    if (w->inbox != NULL && __atomic_load_n(&w->wake_pending, __ATOMIC_ACQUIRE)) srv_worker_drain(w);
+
+    int taken = 0;
+    for (unsigned ch = 0; ch < nchan; ++ch)
+    {
+      taken += srv_shm_serve(w, (int)ch);
+    }
+    srv_worker_flush_backlog(w);
+
+    if (taken > 0 || ++idle_rounds < SHMRING_SPIN)
+    {
+      if (taken > 0) idle_rounds = 0;
+      continue;
+    }
+
+    // Forwarded requests come back through the inbox, which does not wake the futex
+    bool waiting = w->shm_inflight > 0 || w->backlog_head != NULL;
+    shmring_wait(w->shm, waiting ? 1 : -1);
+    idle_rounds = 0;
+  }
+
+  return NULL;
+}
+
+/**
+ * io_uring backend
+ *
+ * A worker on io_uring keeps a multishot accept armed on its listener and receives into the provided
+ * buffers of its ring, so no memory is pinned for idle connections. The replies to all pkts received
+ * so far go out with a single send. Without keep-alive, that send is linked to the close of the socket.
+ * Completions are reaped in batches, and a single io_uring_enter call covers every submission and wait
+ * of a loop iteration.
+ */
+static uint64_t srv_uring_data(srv_conn* conn, enum srv_uring_op op)
+{
+  return (uint64_t)(uintptr_t)conn | (uint64_t)op;
+}
+
+// Closes a connection through the ring, its state is freed on completion
+static void srv_uring_close(srv_worker* w, srv_conn* conn)
+{
+  srv_idle_unlink(w, conn);
+  if (!uring_prep_close(w->ring, conn->fd, srv_uring_data(conn, SRV_URING_CLOSE))) srv_conn_close(w, conn);
+}
+
+// Arms a receive on a connection, limited to the room its stream parser has left
+static void srv_uring_recv(srv_worker* w, srv_conn* conn)
+{
+  size_t room;
+  ot_pkt_parser_room(&conn->rx, &room);
+
+  if (!uring_prep_recv(w->ring, conn->fd, room, srv_uring_data(conn, SRV_URING_RECV)))
+  {
+    fprintf(stderr, "[ot srv] io_uring error: submission queue full\n");
+    srv_conn_close(w, conn);
+  }
+}
+
+// Queues the replies of a connection
+//
+// Without keep-alive, the send is linked to the close of the socket.
+static void srv_uring_reply(srv_worker* w, srv_conn* conn)
+{
+  bool queued;
+  if (w->idle_timeout > 0)
+  {
+    queued = uring_prep_send(w->ring, conn->fd, conn->tx_buffer, conn->tx_len, 
+                             srv_uring_data(conn, SRV_URING_SEND));
+  } else {
+    queued = uring_prep_send_close(w->ring, conn->fd, conn->tx_buffer, conn->tx_len, 
+                                   srv_uring_data(conn, SRV_URING_SEND), 
+                                   srv_uring_data(conn, SRV_URING_CLOSE));
+  }
+
+  if (!queued)
+  {
+    fprintf(stderr, "[ot srv] io_uring error: submission queue full\n");
+    srv_conn_close(w, conn);
+  }
+}
+
+// Handles the buffered pkts of a connection and queues their replies, or waits for more pkts
+static void srv_uring_serve(srv_worker* w, srv_conn* conn)
+{
+  if (!srv_conn_process(w, conn)) return;
+
+  if (conn->tx_len > 0)
+  {
+    srv_uring_reply(w, conn);
+    return;
+  }
+
+  // Nothing left to reply with (e.g. malformed pkt, peer hung up), drop the connection
+  if (conn->drop || conn->hup)
+  {
+    srv_uring_close(w, conn);
+    return;
+  }
+
+  srv_uring_recv(w, conn);
+}
+
+// Goes on with the pkts of a keep-alive connection once its replies have been sent
+static void srv_uring_sent(srv_worker* w, srv_conn* conn, const uring_cqe* cqe)
+{
+  if (cqe->res != (int32_t)conn->tx_len)
+  {
+    srv_uring_close(w, conn);
+    return;
+  }
+
+  conn->tx_len = 0;
+  conn->tx_off = 0;
+  conn->served = true;
+  srv_idle_touch(w, conn);
+  srv_uring_serve(w, conn);
+}
+
+// Sets up a connection produced by the multishot accept and arms its first receive
+static void srv_uring_accepted(srv_worker* w, int conn_fd)
+{
+  // Multishot accept has no per-socket address slot, ask for the peer address directly
+  struct sockaddr_in address;
+  socklen_t addrlen = sizeof(address);
+  if (getpeername(conn_fd, (struct sockaddr *)&address, &addrlen) < 0 || address.sin_family != AF_INET)
+  {
+    memset(&address, 0, sizeof(address));
+  }
+
+  srv_conn* conn = srv_conn_create(w, conn_fd, address);
+  if (conn == NULL) return;
+
+  srv_uring_recv(w, conn);
+}
+
+// Appends received bytes to a connection and handles its pkts once the socket has been drained
+static void srv_uring_received(srv_worker* w, srv_conn* conn, const uring_cqe* cqe)
+{
+  if (cqe->res == -ENOBUFS)
+  {
+    srv_uring_recv(w, conn); //<< provided buffers are recycled as completions are reaped
+    return;
+  }
+  if (cqe->res < 0)
+  {
+    fprintf(stderr, "[ot srv] recv failed: %s\n", strerror(-cqe->res));
+    srv_uring_close(w, conn);
+    return;
+  }
+
+  if (cqe->res == 0 && ot_pkt_parser_buffered(&conn->rx) == 0)
+  {
+    printf("[ot srv] Client closed connection.\n");
+    srv_uring_close(w, conn);
+    return;
+  }
+  if (cqe->res == 0) conn->hup = true; //<< reply to the last pkts of the peer, then close
+
+  if (cqe->bid >= 0)
+  {
+    srv_idle_touch(w, conn);
+
+    // The receive was limited to the room of the parser, which stays put until bytes are fed
+    size_t room;
+    uint8_t* dst = ot_pkt_parser_room(&conn->rx, &room);
+    memcpy(dst, uring_buf(w->ring, cqe->bid), (size_t)cqe->res);
+    ot_pkt_parser_feed(&conn->rx, (size_t)cqe->res);
+    uring_buf_recycle(w->ring, cqe->bid);
+  }
+
+  // Keep reading while the socket still holds bytes, like the epoll path reads until EAGAIN
+  size_t room;
+  ot_pkt_parser_room(&conn->rx, &room);
+  if (cqe->res > 0 && cqe->nonempty && room > 0)
+  {
+    srv_uring_recv(w, conn);
+    return;
+  }
+
+  srv_uring_serve(w, conn);
+}
+
+// Dispatches a completion of the ring of a worker
+static void srv_uring_complete(srv_worker* w, const uring_cqe* cqe)
+{
+  enum srv_uring_op op = (enum srv_uring_op)(cqe->user_data & SRV_URING_OP_MASK);
+  srv_conn* conn = (srv_conn*)(uintptr_t)(cqe->user_data & ~(uint64_t)SRV_URING_OP_MASK);
+
+  switch (op)
+  {
+    case SRV_URING_ACCEPT:
+      if (cqe->res >= 0) 
+      {
+        srv_uring_accepted(w, cqe->res);
+      } else if (cqe->res != -EINTR && cqe->res != -ECONNABORTED) {
+        fprintf(stderr, "[ot srv] accept failed: %s\n", strerror(-cqe->res));
+      }
+      if (!cqe->more && !uring_prep_accept_multishot(w->ring, w->listen_fd, SRV_URING_ACCEPT))
+      {
+        fprintf(stderr, "[ot srv] io_uring error: failed to re-arm accept\n");
+      }
+      break;
+    case SRV_URING_UNIX_ACCEPT:
+      if (cqe->res >= 0) 
+      {
+        srv_uring_accepted(w, cqe->res);
+      } else if (cqe->res != -EINTR && cqe->res != -ECONNABORTED) {
+        fprintf(stderr, "[ot srv] unix accept failed: %s\n", strerror(-cqe->res));
+      }
+      if (!cqe->more && !uring_prep_accept_multishot(w->ring, w->unix_fd, SRV_URING_UNIX_ACCEPT))
+      {
+        fprintf(stderr, "[ot srv] io_uring error: failed to re-arm unix accept\n");
+      }
+      break;
+    case SRV_URING_WAKE:
+      srv_worker_drain(w);
+      if (!cqe->more && !uring_prep_poll_multishot(w->ring, w->wake_fd, SRV_URING_WAKE))
+      {
+        fprintf(stderr, "[ot srv] io_uring error: failed to re-arm inbox wakeup\n");
+      }
+      break;
+    case SRV_URING_RECV:
+      srv_uring_received(w, conn, cqe);
+      break;
+    case SRV_URING_SEND:
+      if (cqe->res < 0) fprintf(stderr, "[ot srv] send failed: %s\n", strerror(-cqe->res));
+
+      // Without keep-alive, successful sends are silent and a failed one cancels the linked close
+      if (w->idle_timeout > 0) srv_uring_sent(w, conn, cqe);
+      break;
+    case SRV_URING_CLOSE:
+      if (cqe->res == -ECANCELED) close(conn->fd);
+      free(conn);
+      break;
+    case SRV_URING_UDP:
+      srv_udp_drain(w);
+      if (!cqe->more && !uring_prep_poll_multishot(w->ring, w->udp_fd, SRV_URING_UDP))
+      {
+        fprintf(stderr, "[ot srv] io_uring error: failed to re-arm udp poll\n");
+      }
+      break;
+    default:
+      fprintf(stderr, "[ot srv] io_uring error: unknown completion\n");
+      break;
+  }
+}
+
+// Sets up the io_uring backend of a worker, returns false if io_uring is unavailable
+static bool srv_uring_init(srv_worker* w)
+{
+  w->ring = uring_create(SRV_URING_ENTRIES, SRV_URING_BUFS, MAX_RECV_SIZE);
+  if (w->ring == NULL) return false;
+
+  if (!uring_prep_accept_multishot(w->ring, w->listen_fd, SRV_URING_ACCEPT) ||
+      (w->wake_fd >= 0 && !uring_prep_poll_multishot(w->ring, w->wake_fd, SRV_URING_WAKE)) ||
+      (w->udp_fd >= 0 && !uring_prep_poll_multishot(w->ring, w->udp_fd, SRV_URING_UDP)) ||
+      (w->unix_fd >= 0 && !uring_prep_accept_multishot(w->ring, w->unix_fd, SRV_URING_UNIX_ACCEPT)))
+  {
+    uring_destroy(w->ring);
+    w->ring = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+// Runs the io_uring event loop of a worker
+static void srv_uring_main(srv_worker* w)
+{
+  while (1) {
+    int timeout = srv_idle_sweep(w);
+
+    // Poll instead of blocking while connections are waiting for room in a full inbox
+    if (w->backlog_head != NULL) timeout = 1;
+
+    int ret = uring_submit_and_wait(w->ring, timeout);
+    if (ret < 0)
+    {
+      fprintf(stderr, "[ot srv] io_uring_enter failed: %s\n", strerror(-ret));
+      break;
+    }
+
+    uring_cqe cqe;
+    while (uring_next(w->ring, &cqe))
+    {
+      srv_uring_complete(w, &cqe);
+    }
+
+    srv_worker_flush_backlog(w);
+  }
+}
+
+// Creates a non-blocking TCP listening socket on DEF_PORT
+//
+// SO_REUSEPORT lets every worker bind its own socket to the same port. Returns the socket or -1.
+static int srv_listen_tcp(void)
+{
+  struct sockaddr_in address;
+  int opt = 1;
+
+  int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server_fd < 0)
+  {
+    perror("socket failed");
+    return -1;
+  }
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = INADDR_ANY;
+  address.sin_port = htons(DEF_PORT);
+
+  if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) 
+  {
+    perror("bind failed");
+    close(server_fd);
+    return -1;
+  }
+
+  if (listen(server_fd, SRV_BACKLOG) < 0)
+  {
+    perror("listen failed");
+    close(server_fd);
+    return -1;
+  }
+
+  return server_fd;
+}
+
+// Creates a non-blocking AF_UNIX stream listening socket at path
+//
+// A socket left at the path by an earlier run is unlinked first, anything else there is an error. 
+// Returns the socket or -1.
+static int srv_listen_unix(const char* path)
+{
+  struct sockaddr_un address;
+  struct stat st;
+
+  if (strlen(path) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "[ot srv] error: unix socket path too long: %s\n", path);
+    return -1;
+  }
+
+  int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server_fd < 0)
+  {
+    perror("socket failed");
+    return -1;
+  }
+
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) 
+  {
+    perror("unix bind failed");
+    close(server_fd);
+    return -1;
+  }
+
+  if (listen(server_fd, SRV_BACKLOG) < 0)
+  {
+    perror("listen failed");
+    close(server_fd);
+    unlink(path);
+    return -1;
+  }
+
+  return server_fd;
+}
+
+// Releases the sockets and inbox of a worker
+static void srv_worker_fini(srv_worker* w)
+{
+  if (w->epoll_fd >= 0) close(w->epoll_fd);
+  if (w->listen_fd >= 0) close(w->listen_fd);
+  if (w->udp_fd >= 0) close(w->udp_fd);
+  if (w->wake_fd >= 0) close(w->wake_fd);
+  mpscq_destroy(w->inbox);
+  uring_destroy(w->ring);
+  free(w->udp_batch);
+  free(w->udp_cache);
+  ht_destroy(w->udp_index);
+  shmring_destroy(w->shm);
+  free(w->shm_conn);
+  free(w->shm_busy);
+
+  w->epoll_fd = -1;
+  w->listen_fd = -1;
+  w->udp_fd = -1;
+  w->wake_fd = -1;
+  w->inbox = NULL;
+  w->ring = NULL;
+  w->udp_batch = NULL;
+  w->udp_cache = NULL;
+  w->udp_index = NULL;
+  w->shm = NULL;
+  w->shm_conn = NULL;
+  w->shm_busy = NULL;
+}
+
+// Registers an fd for edge-triggered reads with the event loop of a worker
+static bool srv_worker_watch(srv_worker* w, int fd, void* tag)
+{
+  struct epoll_event ev = {0};
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = tag;
+  if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    perror("epoll_ctl failed");
+    return false;
+  }
+
+  return true;
+}
+
+// Sets up the event loop of a worker
+//
+// On epoll, the listening socket is tagged with a NULL data pointer, the inbox eventfd with the 
+// address of the worker's wake_fd, the UDP socket with the address of its udp_fd and the shared unix
+// listener (unix_fd, owned by the caller) with the address of its unix_fd. A worker asked to run on 
+// io_uring falls back to epoll if the kernel does not support it. Returns false if the worker could 
+// not be set up.
+static bool srv_worker_init(srv_worker* w, int id, ot_srv_ctx* sc, srv_worker* peers, 
+                            const ot_srv_cfg* cfg, int unix_fd)
+{
+  w->id = id;
+  w->sc = sc;
+  w->peers = peers;
+  w->nworkers = cfg->nworkers;
+  w->sharded = cfg->sharded;
+  w->idle_timeout = cfg->idle_timeout;
+  w->idle_head = NULL;
+  w->idle_tail = NULL;
+  w->wake_pending = 0;
+  w->backlog_head = NULL;
+  w->backlog_tail = NULL;
+  w->epoll_fd = -1;
+  w->wake_fd = -1;
+  w->inbox = NULL;
+  w->ring = NULL;
+  w->udp_fd = -1;
+  w->udp_batch = NULL;
+  w->udp_cache = NULL;
+  w->udp_cache_cap = SRV_UDP_CACHE_SIZE;
+  w->udp_cache_head = 0;
+  w->udp_cache_tail = 0;
+  w->udp_index = NULL;
+  w->unix_fd = unix_fd;
+
+  if ((w->listen_fd = srv_listen_tcp()) < 0) return false;
+
+  if (cfg->udp)
+  {
+    w->udp_fd = srv_listen_udp();
+    w->udp_batch = calloc(SRV_UDP_BATCH, sizeof(srv_conn));
+    w->udp_cache = calloc(SRV_UDP_CACHE_SIZE, sizeof(srv_udp_reply));
+    w->udp_index = ht_create_u64(SRV_UDP_CACHE_SIZE, sizeof(uint64_t));
+    if (w->udp_fd < 0 || w->udp_batch == NULL || w->udp_cache == NULL || w->udp_index == NULL)
+    {
+      fprintf(stderr, "[ot srv] error: failed to set up udp socket of worker %d\n", id);
+      srv_worker_fini(w);
+      return false;
+    }
+    for (int i = 0; i < SRV_UDP_BATCH; ++i)
+    {
+      w->udp_batch[i].fd = -1;
+      w->udp_batch[i].origin = id;
+      w->udp_batch[i].dgram = true;
+      w->udp_batch[i].shm_chan = -1;
+    }
+  }
+
+  // Sharded workers exchange connections through their inboxes
+  if (cfg->sharded)
+  {
+    w->inbox = mpscq_create(SRV_INBOX_SIZE);
+    w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->inbox == NULL || w->wake_fd < 0)
+    {
+      fprintf(stderr, "[ot srv] error: failed to set up inbox of worker %d\n", id);
+      srv_worker_fini(w);
+      return false;
+    }
+  }
+
+  if (cfg->uring)
+  {
+    if (srv_uring_init(w)) return true;
+    fprintf(stderr, "[ot srv] worker %d: io_uring unavailable, falling back to epoll\n", id);
+  }
+
+  if ((w->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+  {
+    perror("epoll_create1 failed");
+    srv_worker_fini(w);
+    return false;
+  }
+
+  if (!srv_worker_watch(w, w->listen_fd, NULL) || 
+      (w->wake_fd >= 0 && !srv_worker_watch(w, w->wake_fd, &w->wake_fd)) ||
+      (w->udp_fd >= 0 && !srv_worker_watch(w, w->udp_fd, &w->udp_fd)) ||
+      (w->unix_fd >= 0 && !srv_worker_watch(w, w->unix_fd, &w->unix_fd)))
+  {
+    srv_worker_fini(w);
+    return false;
+  }
+
+  return true;
+}
+
+// Sets up the shared memory worker, which serves the ring at the shm_path of cfg and no sockets
+//
+// Its id comes after those of the socket workers, so no ctable shard maps to it. Returns false if the
+// ring could not be created.
+static bool srv_shm_init(srv_worker* w, int id, ot_srv_ctx* sc, srv_worker* peers, 
+                         const ot_srv_cfg* cfg)
+{
+  memset(w, 0, sizeof(*w));
+  w->id = id;
+  w->sc = sc;
+  w->peers = peers;
+  w->nworkers = cfg->nworkers;
+  w->sharded = cfg->sharded;
+  w->listen_fd = -1;
+  w->udp_fd = -1;
+  w->unix_fd = -1;
+  w->epoll_fd = -1;
+  w->wake_fd = -1;
+
+  w->shm = shmring_create(cfg->shm_path, SRV_SHM_CHANNELS);
+  w->shm_conn = calloc(1, sizeof(srv_conn));
+  w->shm_busy = calloc(SRV_SHM_CHANNELS, sizeof(bool));
+  if (w->shm == NULL || w->shm_conn == NULL || w->shm_busy == NULL)
+  {
+    fprintf(stderr, "[ot srv] error: failed to set up shared memory ring at %s\n", cfg->shm_path);
+    srv_worker_fini(w);
+    return false;
+  }
+  w->shm_conn->fd = -1;
+  w->shm_conn->origin = id;
+  w->shm_conn->shm_chan = -1;
+
+  // Requests for the ctable shards of the socket workers are forwarded to them
+  if (cfg->sharded)
+  {
+    w->inbox = mpscq_create(SRV_INBOX_SIZE);
+    w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->inbox == NULL || w->wake_fd < 0)
+    {
+      fprintf(stderr, "[ot srv] error: failed to set up inbox of worker %d\n", id);
+      srv_worker_fini(w);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Runs the event loop of a worker
+static void* srv_worker_main(void* arg)
+{
+  srv_worker* w = arg;
+  struct epoll_event events[SRV_MAX_EVENTS];
+
+  if (w->ring != NULL)
+  {
+    srv_uring_main(w);
+    return NULL;
+  }
+
+  while (1) {
+    int timeout = srv_idle_sweep(w);
+
+    // Poll instead of blocking while connections are waiting for room in a full inbox
+    if (w->backlog_head != NULL) timeout = 1;
+
+    int nfds = epoll_wait(w->epoll_fd, events, SRV_MAX_EVENTS, timeout);
+    if (nfds < 0)
+    {
+      if (errno == EINTR) continue;
+      perror("epoll_wait failed");
+      break;
+    }
+
+    for (int i = 0; i < nfds; ++i)
+    {
+      if (events[i].data.ptr == NULL) 
+      {
+        srv_accept_all(w, w->listen_fd);
+        continue;
+      }
+      if (events[i].data.ptr == &w->unix_fd)
+      {
+        srv_accept_all(w, w->unix_fd);
+        continue;
+      }
+      if (events[i].data.ptr == &w->wake_fd)
+      {
+        srv_worker_drain(w);
+        continue;
+      }
+      if (events[i].data.ptr == &w->udp_fd)
+      {
+        srv_udp_drain(w);
+        continue;
+      }
+
+      srv_conn_event(w, (srv_conn*)events[i].data.ptr, events[i].events);
+    }
+
+    srv_worker_flush_backlog(w);
+  }
+
+  return NULL;
+}
+
+// Creates a server configuration with default values
+ot_srv_cfg ot_srv_cfg_default(void)
+{
+  ot_srv_cfg ret = {0};
+
+  ret.nworkers = DEF_WORKERS;
+  ret.sharded = false;
+  ret.uring = false;
+  ret.idle_timeout = DEF_IDLE_TIMEOUT;
+  ret.udp = false;
+  ret.unix_path = NULL;
+  ret.shm_path = NULL;
+  ret.ctable_reserve = 0;
+
+  return ret;
+}
+
+// Runs the server loop with the default configuration
+void ot_srv_run(uint32_t SRV_IP, uint8_t* SRV_MAC, const char* PATH)
+{
+  ot_srv_run_cfg(SRV_IP, SRV_MAC, PATH, ot_srv_cfg_default());
+}
+
+// Runs the server loop
+// Note: PATH should be checked from the caller, no measures here in ot_srv_run
+void ot_srv_run_cfg(uint32_t SRV_IP, uint8_t* SRV_MAC, const char* PATH, ot_srv_cfg cfg)
+{
+  int nworkers = cfg.nworkers;
+  if (nworkers <= 0) nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (nworkers <= 0) nworkers = 1;
+  if (nworkers > SRV_MAX_WORKERS) nworkers = SRV_MAX_WORKERS;
+
+  // A single worker owns the whole ctable anyway
+  bool sharded = cfg.sharded && nworkers > 1;
+  int nctx = sharded ? nworkers : 1;
+
+  // Hand the resolved values down to the workers
+  cfg.nworkers = nworkers;
+  cfg.sharded = sharded;
+
+  // Replies are patched from templates that are built once per process
+  pthread_once(&srv_reply_tmpls_once, srv_reply_tmpls_build);
+  if (!srv_reply_tmpls_ready)
+  {
+    fprintf(stderr, "[ot srv] error: failed to build reply templates\n");
+    return;
+  }
+
+  // The shared memory ring gets a worker of its own behind the socket workers
+  int nthreads = nworkers + (cfg.shm_path != NULL ? 1 : 0);
+
+  srv_worker* workers = calloc((size_t)nthreads, sizeof(srv_worker));
+  ot_srv_ctx** contexts = calloc((size_t)nctx, sizeof(ot_srv_ctx*));
+  if (workers == NULL || contexts == NULL)
+  {
+    fprintf(stderr, "[ot srv] error: out of memory\n");
+    free(workers);
+    free(contexts);
+    return;
+  }
+
+  // Build server context metadata and allocate memory for server context(s)
+  // In sharded mode every worker gets its own ctable, while the otable of the first context is shared
+  ot_srv_ctx_mdata srv_mdata = ot_srv_ctx_mdata_create(DEF_PORT, SRV_IP, SRV_MAC);
+  int nctx_init = 0;
+  for (; nctx_init < nctx; ++nctx_init)
+  {
+    ot_srv_ctx* sc = ot_srv_ctx_create(srv_mdata);
+    if (sc == NULL) break;
+
+    // Presize the ctable so that tethering the expected clients never has to resize it
+    if (cfg.ctable_reserve > 0 && ht_reserve(sc->ctable, (cfg.ctable_reserve + nctx - 1) / nctx) < 0)
+    {
+      fprintf(stderr, "[ot srv] error: failed to reserve the ctable for %zu clients\n", cfg.ctable_reserve);
+      ot_srv_ctx_destroy(&sc);
+      break;
+    }
+
+    sc->ctable_private = sharded;
+    if (nctx_init > 0)
+    {
+      ht_destroy(sc->otable);
+      sc->otable = contexts[0]->otable;
+    }
+    contexts[nctx_init] = sc;
+
+    if (nctx_init == 0) otfile_build(PATH, &sc->otable); 
+  }
+
+  int ninit = 0;
+  int unix_fd = -1;
+  if (nctx_init < nctx) goto shutdown;
+
+  // Bind every listener before serving so that a port conflict is reported up front
+  if (cfg.unix_path != NULL && (unix_fd = srv_listen_unix(cfg.unix_path)) < 0) goto shutdown;
+  for (; ninit < nworkers; ++ninit)
+  {
+    ot_srv_ctx* sc = contexts[sharded ? ninit : 0];
+    if (!srv_worker_init(&workers[ninit], ninit, sc, workers, &cfg, unix_fd)) break;
+  }
+  if (ninit < nworkers) goto shutdown;
+  if (cfg.shm_path != NULL)
+  {
+    if (!srv_shm_init(&workers[ninit], ninit, contexts[0], workers, &cfg)) goto shutdown;
+    ++ninit;
+  }
+
+  printf("[ot srv] Ready to receive bytes on port %d%s with %d %s worker(s) on %s...\n", 
+         DEF_PORT, cfg.udp ? " (tcp+udp)" : "", nworkers, sharded ? "sharded" : "shared", 
+         workers[0].ring ? "io_uring" : "epoll");
+  if (unix_fd >= 0) printf("[ot srv] Also listening on unix socket %s\n", cfg.unix_path);
+  if (cfg.shm_path != NULL) printf("[ot srv] Also serving the shared memory ring %s\n", cfg.shm_path);
+
+  // Worker 0 runs on the calling thread
+  int nstarted = 1;
+  for (; nstarted < nthreads; ++nstarted)
+  {
+    void* (*worker_main)(void*) = (nstarted < nworkers) ? srv_worker_main : srv_shm_main;
+    if (pthread_create(&workers[nstarted].thread, NULL, worker_main, &workers[nstarted]) != 0)
+    {
+      fprintf(stderr, "[ot srv] error: failed to start worker %d\n", nstarted);
+      break;
+    }
+  }
+
+  // Sharded workers depend on each other, so do not run with a partial set
+  if (nstarted == nthreads || !sharded) srv_worker_main(&workers[0]);
+
+  for (int i = 1; i < nstarted; ++i)
+  {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+shutdown:
+  printf("[ot srv] shutting down...\n");
+  if (ninit > nworkers) unlink(cfg.shm_path); //<< the ring was set up
+  for (int i = 0; i < ninit; ++i)
+  {
+    srv_worker_fini(&workers[i]);
+  }
+  if (unix_fd >= 0)
+  {
+    close(unix_fd);
+    unlink(cfg.unix_path);
+  }
+  for (int i = nctx_init - 1; i >= 0; --i)
+  {
+    if (i > 0) contexts[i]->otable = NULL; //<< owned by the first context
+    ot_srv_ctx_destroy(&contexts[i]);
+  }
+  free(contexts);
+  free(workers);
+  return;
+}
+
+static bool srv_add_cli_ctx(ot_srv_ctx* sc, ot_pkt_header* hd, time_t curr_time)
+{
+  if (sc == NULL || hd == NULL) return false;
+
+  uint64_t mac = ot_mac_pack(hd->cli_mac);
+
+  uint32_t etime = DEF_EXP_TIME;
+  if (mac == SRV_SHORT_LIVED_MAC) 
+  {
+    etime = 20; 
+  }
+
+  uint32_t rtime = 0.75 * etime;
+
+  hd->exp_time = etime;
+  hd->renew_time = rtime;
+
+  ot_cli_ctx cc = ot_cli_ctx_create(*hd, curr_time + etime, curr_time + rtime);
+
+  // Fails if another worker tethered the same MAC since the TREQ was validated
+  return ot_srv_add_cli_ctx_mac(sc, mac, cc);
+}
+
+// Reports the mandatory payloads that a pkt view is missing
+static void err_pl_missing(const char* pkt_name, const ot_pkt_view* recv_pkt, uint32_t required, 
+                           const char* peer)
+{
+  uint32_t missing = required & ~recv_pkt->present;
+
+  for (int t = 0; t < PL_UNKN; ++t) 
+  {
+    if (!(missing & OT_PL_BIT(t))) continue;
+
+    char msgtype_str[16];
+    msgtype_to_str((ot_pkt_msgtype_t)t, msgtype_str);
+    SRV_ERR(peer, "[ot srv] %s validation error: failed to find %s\n", pkt_name, msgtype_str);
+  }
+}
+
+static bool pl_treq_validate(ot_srv_ctx* sc, const ot_pkt_view* recv_pkt, const char* peer)
+{
+  if (sc == NULL || recv_pkt == NULL) return false;
+
+  if (!ot_pkt_view_has(recv_pkt, ot_pkt_required(TREQ))) 
+  {
+    err_pl_missing("treq", recv_pkt, ot_pkt_required(TREQ), peer);
+    return false;
+  }
+
+  ot_cli_ctx check_cc = ot_srv_get_cli_ctx_mac(sc, ot_mac_pack(recv_pkt->header.cli_mac));
+  if (check_cc.state != UNKN) return false; // TREQs are not valid for clients that already exist in the ctable
+
+  return true;
+}
+
+static void srv_reply_tmpls_build(void)
+{
+  const ot_cli_state_t states[] = {TACK, TPRV, TINV, CVAL, CINV};
+
+  for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); ++i) 
+  {
+    ot_cli_state_t state = states[i];
+
+    // Zeroed values, laid out by the schema of the state. CINV replies echo the hash they rejected.
+    ot_pkt_fields f = {0};
+    f.state = (uint8_t)state;
+    if (state == CINV) f.present |= OT_PL_BIT(PL_HASH);
+
+    // Record where the values of the payloads ended up
+    srv_reply_tmpl* t = &srv_reply_tmpls[state];
+    ssize_t len = ot_pkt_encode(&f, t->bytes, sizeof(t->bytes));
+    ot_pkt_view v;
+    if (len < 0 || ot_pkt_view_parse(&v, t->bytes, (size_t)len) != len) return;
+
+    t->len = (size_t)len;
+    for (int m = 0; m < PL_UNKN; ++m)
+    {
+      if (v.present & OT_PL_BIT(m)) t->off[m] = (size_t)(v.payloads[m].value - t->bytes);
+    }
+  }
+
+  srv_reply_tmpls_ready = true;
+}
+
+// Copies the template of a reply after the pending replies in an output buffer and stores its 
+// header. Returns the start of the reply, or NULL if it does not fit.
+static uint8_t* srv_reply_start(srv_out* out, ot_cli_state_t state, const ot_pkt_header* hd)
+{
+  const srv_reply_tmpl* t = &srv_reply_tmpls[state];
+  if (out->len + t->len > out->cap) return NULL; //<< reported by the handler, which knows the peer
+
+  uint8_t* reply = &out->buf[out->len];
+  memcpy(reply, t->bytes, t->len);
+  memcpy(&reply[sizeof(ot_pkt_frame)], hd, sizeof(ot_pkt_header));
+
+  out->len += t->len;
+
+  return reply;
+}
+
+// Stores the value of a payload in a reply started by srv_reply_start
+static inline void srv_reply_set(uint8_t* reply, ot_cli_state_t state, ot_pkt_msgtype_t type, 
+                                 const void* value, size_t vlen)
+{
+  memcpy(&reply[srv_reply_tmpls[state].off[type]], value, vlen);
+}
+
+static ssize_t tinv_reply_queue(srv_out* out, ot_pkt_header tinv_hd, uint32_t srv_ip, uint32_t cli_ip)
+{
+  uint8_t* reply = srv_reply_start(out, TINV, &tinv_hd);
+  if (reply == NULL) return -1;
+
+  srv_reply_set(reply, TINV, PL_SRV_IP, &srv_ip, sizeof(srv_ip));
+  srv_reply_set(reply, TINV, PL_CLI_IP, &cli_ip, sizeof(cli_ip));
+
+  return (ssize_t)srv_reply_tmpls[TINV].len;
+}
+
+static ssize_t tack_reply_queue(srv_out* out, ot_pkt_header tack_hd, uint32_t srv_ip, uint8_t* srv_mac, 
+                                uint32_t cli_ip, uint32_t exp_time, uint32_t renew_time)
+{
+  uint8_t* reply = srv_reply_start(out, TACK, &tack_hd);
+  if (reply == NULL) return -1;
+
+  srv_reply_set(reply, TACK, PL_SRV_IP, &srv_ip, sizeof(srv_ip));
+  srv_reply_set(reply, TACK, PL_SRV_MAC, srv_mac, 6);
+  srv_reply_set(reply, TACK, PL_CLI_IP, &cli_ip, sizeof(cli_ip));
+  srv_reply_set(reply, TACK, PL_ETIME, &exp_time, sizeof(exp_time));
+  srv_reply_set(reply, TACK, PL_RTIME, &renew_time, sizeof(renew_time));
+
+  return (ssize_t)srv_reply_tmpls[TACK].len;
+}
+
+static ssize_t tprv_reply_queue(srv_out* out, ot_pkt_header tprv_hd, uint32_t srv_ip, uint32_t cli_ip, 
+                                uint32_t exp_time, uint32_t renew_time)
+{
+  uint8_t* reply = srv_reply_start(out, TPRV, &tprv_hd);
+  if (reply == NULL) return -1;
+
+  srv_reply_set(reply, TPRV, PL_SRV_IP, &srv_ip, sizeof(srv_ip));
+  srv_reply_set(reply, TPRV, PL_CLI_IP, &cli_ip, sizeof(cli_ip));
+  srv_reply_set(reply, TPRV, PL_ETIME, &exp_time, sizeof(exp_time));
+  srv_reply_set(reply, TPRV, PL_RTIME, &renew_time, sizeof(renew_time));
+
+  return (ssize_t)srv_reply_tmpls[TPRV].len;
+}
+
+static ssize_t cinv_reply_queue(srv_out* out, ot_pkt_header cinv_hd, uint32_t srv_ip, uint32_t cli_ip, 
+                                uint64_t hash)
+{
+  uint8_t* reply = srv_reply_start(out, CINV, &cinv_hd);
+  if (reply == NULL) return -1;
+
+  srv_reply_set(reply, CINV, PL_SRV_IP, &srv_ip, sizeof(srv_ip));
+  srv_reply_set(reply, CINV, PL_CLI_IP, &cli_ip, sizeof(cli_ip));
+  srv_reply_set(reply, CINV, PL_HASH, &hash, sizeof(hash));
+
+  return (ssize_t)srv_reply_tmpls[CINV].len;
+}
+
+static ssize_t cval_reply_queue(srv_out* out, ot_pkt_header cval_hd, uint32_t srv_ip, uint32_t cli_ip, 
+                                uint64_t hash)
+{
+  uint8_t* reply = srv_reply_start(out, CVAL, &cval_hd);
+  if (reply == NULL) return -1;
+
+  srv_reply_set(reply, CVAL, PL_SRV_IP, &srv_ip, sizeof(srv_ip));
+  srv_reply_set(reply, CVAL, PL_CLI_IP, &cli_ip, sizeof(cli_ip));
+  srv_reply_set(reply, CVAL, PL_HASH, &hash, sizeof(hash));
+
+  return (ssize_t)srv_reply_tmpls[CVAL].len;
+}
+
+static bool cli_expiry_check(ot_srv_ctx* sc, ot_pkt_header hd, time_t curr_time)
+{
+  if (sc == NULL) return true;
+
+  ot_cli_ctx cc = ot_srv_get_cli_ctx_mac(sc, ot_mac_pack(hd.cli_mac));
+  if (cc.state == UNKN) return true; //<< a missing context is as good as expired
+  
+  time_t ctx_exp_time = cc.ctx_exp_time;
+
+  if (curr_time >= ctx_exp_time) return true;
+
+  return false;
+}
+
+// Validates a deserialized TREN pkt.
+//
+// Checks whether the correct payloads exist and correlate with the header
+//
+// Returns true if the pkt is valid, otherwise false.
+static bool tren_pl_validate(ot_srv_ctx* sc, const ot_pkt_view* recv_pkt, const char* peer)
+{
+  if (sc == NULL || recv_pkt == NULL)
+  {
+    SRV_ERR(peer, "[ot srv] tren validation error: sc or recv pkt is/are null\n");
+    return false;
+  }
+
+  // Check mandatory fields in the view
+  if (!ot_pkt_view_has(recv_pkt, ot_pkt_required(TREN)))
+  {
+    err_pl_missing("tren", recv_pkt, ot_pkt_required(TREN), peer);
+    return false;
+  }
+
+  uint32_t pl_srv_ip;
+  uint32_t pl_cli_ip;
+  ot_pkt_view_u32(recv_pkt, PL_SRV_IP, &pl_srv_ip);
+  ot_pkt_view_u32(recv_pkt, PL_CLI_IP, &pl_cli_ip);
+  const ot_payload_view* pl_cli_mac = ot_pkt_view_get(recv_pkt, PL_CLI_MAC);
   
-  tprv_reply->header = tprv_hd;
+  if (pl_srv_ip != recv_pkt->header.srv_ip) return false;
+  if (pl_cli_ip != recv_pkt->header.cli_ip) return false;
+  if (memcmp(pl_cli_mac->value, recv_pkt->header.cli_mac, 6) != 0) return false;
+
+  // Lastly, check if the client mac maps to an existing client context
+  ot_cli_ctx cc = ot_srv_get_cli_ctx_mac(sc, ot_mac_pack(recv_pkt->header.cli_mac));
+  if (cc.state == UNKN) 
+  {
+    SRV_ERR(peer, "[ot srv] pl_tren_validate warning: client " SRV_MAC_FMT " does not exist\n", 
+            SRV_MAC_ARGS(recv_pkt->header.cli_mac));
+    return false;
+  }
+
+  return true;
+}
+
+static bool csend_pl_validate(ot_srv_ctx* sc, const ot_pkt_view* recv_pkt, const char* peer)
+{
+  if (sc == NULL || recv_pkt == NULL)
+  {
+    SRV_ERR(peer, "[ot srv] csend validation error: sc or recv pkt is/are null\n");
+    return false;
+  }
+
+  // Check mandatory fields in the view
+  if (!ot_pkt_view_has(recv_pkt, ot_pkt_required(CSEND)))
+  {
+    err_pl_missing("csend", recv_pkt, ot_pkt_required(CSEND), peer);
+    return false;
+  }
+
+  uint32_t pl_srv_ip;
+  uint32_t pl_cli_ip;
+  ot_pkt_view_u32(recv_pkt, PL_SRV_IP, &pl_srv_ip);
+  ot_pkt_view_u32(recv_pkt, PL_CLI_IP, &pl_cli_ip);
   
-  uint8_t pl_state_msgtype = PL_STATE;
-  uint8_t pl_state_value = TPRV;
-  uint8_t pl_state_vlen = sizeof(pl_state_value);
-  ot_payload* pl_state_payload = ot_payload_create(pl_state_msgtype, &pl_state_value, pl_state_vlen);
-
-  uint8_t pl_srv_ip_msgtype = PL_SRV_IP;
-  uint32_t pl_srv_ip_value = srv_ip;
-  uint8_t pl_srv_ip_vlen = sizeof(pl_srv_ip_value);
-  ot_payload* pl_srv_ip_payload = ot_payload_create(pl_srv_ip_msgtype, &pl_srv_ip_value, pl_srv_ip_vlen);
-
-  uint8_t pl_cli_ip_msgtype = PL_CLI_IP;
-  uint32_t pl_cli_ip_value = cli_ip;
-  uint8_t pl_cli_ip_vlen = sizeof(pl_cli_ip_value);
-  ot_payload* pl_cli_ip_payload = ot_payload_create(pl_cli_ip_msgtype, &pl_cli_ip_value, pl_cli_ip_vlen);
-
-  uint8_t pl_exp_time_msgtype = PL_ETIME;
-  uint32_t pl_exp_time_value = exp_time;
-  uint8_t pl_exp_time_vlen = sizeof(pl_exp_time_value);
-  ot_payload* pl_exp_time_payload = ot_payload_create(pl_exp_time_msgtype, &pl_exp_time_value, 
-                                                      pl_exp_time_vlen);
-
-  uint8_t pl_renew_time_msgtype = PL_RTIME;
-  uint32_t pl_renew_time_value = renew_time;
-  uint8_t pl_renew_time_vlen = sizeof(pl_renew_time_value);
-  ot_payload* pl_renew_time_payload = ot_payload_create(pl_renew_time_msgtype, &pl_renew_time_value, 
-                                                      pl_renew_time_vlen);
-
-  tprv_reply->payload = ot_payload_append(tprv_reply->payload, pl_state_payload);
-  tprv_reply->payload = ot_payload_append(tprv_reply->payload, pl_srv_ip_payload);
-  tprv_reply->payload = ot_payload_append(tprv_reply->payload, pl_cli_ip_payload);
-  tprv_reply->payload = ot_payload_append(tprv_reply->payload, pl_exp_time_payload);
-  tprv_reply->payload = ot_payload_append(tprv_reply->payload, pl_renew_time_payload);
+  // Header correlation checks
+  if (pl_srv_ip != recv_pkt->header.srv_ip) return false;
+  if (pl_cli_ip != recv_pkt->header.cli_ip) return false;
+
+  // Lastly, check if the client mac maps to an existing client context
+  ot_cli_ctx cc = ot_srv_get_cli_ctx_mac(sc, ot_mac_pack(recv_pkt->header.cli_mac));
+  if (cc.state == UNKN) 
+  {
+    SRV_ERR(peer, "[ot srv] csend_pl_validate warning: client " SRV_MAC_FMT " does not exist\n", 
+            SRV_MAC_ARGS(recv_pkt->header.cli_mac));
+    return false;
+  }
+
+  return true;
+}
+
+// Checks if the client sending a TREN pkt can renew. 
+//
+// Validates whether the client is present in the srv ctable, then checks if the current time is within
+// bounds for renewal.
+//
+// Returns true if the client can renew, otherwise false.
+static bool tren_renewal_time_check(ot_srv_ctx* sc, uint8_t* cli_mac, time_t curr_time, const char* peer)
+{
+  ot_cli_ctx cc = ot_srv_get_cli_ctx_mac(sc, ot_mac_pack(cli_mac));
+  if(cc.state == UNKN) 
+  {
+    SRV_ERR(peer, "[ot srv] client " SRV_MAC_FMT " does not have a context\n", SRV_MAC_ARGS(cli_mac));
+    return false;
+  }
+
+  /* DEPRECATED, HANDLE EXPIRY FROM RUNTIME
+  // Check if client is expired (delete if it is)
+  uint32_t ctx_exp_time = cc.ctx_exp_time;
+  if (curr_time >= ctx_exp_time) 
+  {
+    ht_delete(srv_ctable, macstr);
+    return false;
+  }
+  */
+
+  // Return true if within renew bounds
+  uint32_t ctx_renew_time = cc.ctx_renew_time;
+  if (curr_time >= ctx_renew_time) return true;
+
+  return false;
 }
+
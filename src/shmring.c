@@ -0,0 +1,378 @@
+#include "shmring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define SHMRING_MAGIC 0x4f54524eu   //<< "OTRN", written last by the server once the region is set up
+#define SHMRING_MASK (SHMRING_DEPTH - 1)
+#define SHMRING_PAYLOAD (SHMRING_SLOT_SIZE - sizeof(uint32_t))
+
+/*******************************************
+* Internal Structures
+*******************************************/
+
+typedef struct {
+    uint32_t len;
+    uint8_t bytes[SHMRING_PAYLOAD];
+} shmring_slot;
+
+// Each side only writes its own cursors, which sit on a cache line of their own
+//
+// The client owns req_tail and rep_head, the server owns req_head and rep_tail. Both rings have the
+// same depth and a client never has more than SHMRING_DEPTH requests without a consumed reply, so the
+// server never finds the response ring full.
+typedef struct {
+    uint32_t owner;         //<< pid of the client process that claimed the channel, 0 if free
+    uint32_t req_tail;
+    uint32_t rep_head;
+    uint32_t cli_idle;      //<< the client sleeps on rep_tail and has to be woken
+    char pad0[48];
+    uint32_t req_head;
+    uint32_t rep_tail;      //<< futex word of the client
+    char pad1[56];
+    shmring_slot req[SHMRING_DEPTH];
+    shmring_slot rep[SHMRING_DEPTH];
+} shmring_chan;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t nchan;
+    uint32_t srv_seq;       //<< futex word of the server, bumped by clients waking it up
+    uint32_t srv_idle;      //<< the server sleeps on srv_seq and has to be woken
+    char pad[48];
+} shmring_hdr;
+
+// Mapping of the shared region in this process
+struct shmring {
+    shmring_hdr* hdr;
+    shmring_chan* chans;
+    size_t size;
+    unsigned nchan;
+};
+
+/*******************************************
+* Internal Helpers
+*******************************************/
+
+static size_t shmring_size(unsigned nchan)
+{
+    return sizeof(shmring_hdr) + (size_t)nchan * sizeof(shmring_chan);
+}
+
+static void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// The region is shared between processes, so the futexes must not be process private
+static void futex_wait(uint32_t* addr, uint32_t val, int timeout_ms)
+{
+    struct timespec ts;
+    struct timespec* tsp = NULL;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+        tsp = &ts;
+    }
+
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, tsp, NULL, 0);
+}
+
+static void futex_wake(uint32_t* addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static shmring* shmring_map(int fd, size_t size)
+{
+    shmring* r = calloc(1, sizeof(shmring));
+    if (!r) return NULL;
+
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mem == MAP_FAILED) {
+        free(r);
+        return NULL;
+    }
+
+    r->hdr = mem;
+    r->chans = (shmring_chan*)((uint8_t*)mem + sizeof(shmring_hdr));
+    r->size = size;
+
+    return r;
+}
+
+// Tells whether the file at PATH is a region left by an earlier server: a regular file that starts
+// with the magic and is exactly as large as its header says
+static bool shmring_stale(const char* PATH)
+{
+    int fd = open(PATH, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    shmring_hdr hdr;
+    bool stale = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                 pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+                 hdr.magic == SHMRING_MAGIC && (size_t)st.st_size == shmring_size(hdr.nchan);
+    close(fd);
+
+    return stale;
+}
+
+/*******************************************
+* Public API
+*******************************************/
+
+// Creates the shared region with NCHAN channels at PATH (e.g. under /dev/shm), replacing a region
+// left there by an earlier server. Anything else at PATH is left alone and fails the call. The file is
+// only accessible to the user of the server. Returns NULL on failure.
+shmring* shmring_create(const char* PATH, const unsigned NCHAN)
+{
+    size_t size = shmring_size(NCHAN);
+
+    struct stat st;
+    if (lstat(PATH, &st) == 0) {
+        if (!shmring_stale(PATH)) return NULL;
+        unlink(PATH);
+    }
+
+    int fd = open(PATH, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, (off_t)size) < 0) {
+        close(fd);
+        unlink(PATH);
+        return NULL;
+    }
+
+    shmring* r = shmring_map(fd, size);
+    close(fd);
+    if (!r) {
+        unlink(PATH);
+        return NULL;
+    }
+
+    // The file starts out zeroed, i.e. with every channel free and empty
+    r->nchan = NCHAN;
+    r->hdr->nchan = NCHAN;
+    __atomic_store_n(&r->hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+    return r;
+}
+
+// Maps the shared region a server created at PATH, returns NULL if there is none
+shmring* shmring_attach(const char* PATH)
+{
+    int fd = open(PATH, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(shmring_hdr)) {
+        close(fd);
+        return NULL;
+    }
+
+    shmring* r = shmring_map(fd, (size_t)st.st_size);
+    close(fd);
+    if (!r) return NULL;
+
+    r->nchan = r->hdr->nchan;
+    if (__atomic_load_n(&r->hdr->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC ||
+        shmring_size(r->nchan) != r->size) {
+        shmring_destroy(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+// Unmaps the shared region, the file itself is left to its creator
+void shmring_destroy(shmring* r)
+{
+    if (r == NULL) return;
+
+    munmap(r->hdr, r->size);
+    free(r);
+}
+
+unsigned shmring_nchan(const shmring* r)
+{
+    return r->nchan;
+}
+
+// Claims a free channel for the calling process, returns its index or -1 if none is free
+//
+// Channels of processes that died without releasing them are taken over. Their leftover requests are
+// answered by the server first, waiting up to timeout_ms, and the replies are skipped.
+int shmring_claim(shmring* r, int timeout_ms)
+{
+    uint32_t pid = (uint32_t)getpid();
+
+    for (unsigned ch = 0; ch < r->nchan; ++ch) {
+        shmring_chan* c = &r->chans[ch];
+
+        uint32_t owner = __atomic_load_n(&c->owner, __ATOMIC_RELAXED);
+        if (owner != 0 && !(kill((pid_t)owner, 0) < 0 && errno == ESRCH)) continue;
+        if (!__atomic_compare_exchange_n(&c->owner, &owner, pid, false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_RELAXED)) continue;
+
+        int64_t deadline = now_ms() + timeout_ms;
+        while (__atomic_load_n(&c->req_head, __ATOMIC_ACQUIRE) != c->req_tail) {
+            if (now_ms() >= deadline) {
+                shmring_release(r, (int)ch);
+                return -1;
+            }
+            struct timespec ts = { .tv_sec = 0, .tv_nsec = 100000 };
+            nanosleep(&ts, NULL);
+        }
+        __atomic_store_n(&c->rep_head, __atomic_load_n(&c->rep_tail, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        c->cli_idle = 0;
+
+        return (int)ch;
+    }
+
+    return -1;
+}
+
+// Hands a channel back, requests still outstanding on it are answered to nobody
+void shmring_release(shmring* r, int ch)
+{
+    __atomic_store_n(&r->chans[ch].owner, 0, __ATOMIC_RELEASE);
+}
+
+// Queues a request of len bytes on a channel and wakes the server if it is idle
+//
+// Returns false if the request does not fit a slot or SHMRING_DEPTH replies are still unread.
+bool shmring_send(shmring* r, int ch, const void* buf, size_t len)
+{
+    shmring_chan* c = &r->chans[ch];
+    if (len > SHMRING_PAYLOAD) return false;
+
+    uint32_t tail = c->req_tail;
+    if (tail - c->rep_head >= SHMRING_DEPTH) return false;
+
+    shmring_slot* slot = &c->req[tail & SHMRING_MASK];
+    slot->len = (uint32_t)len;
+    memcpy(slot->bytes, buf, len);
+    __atomic_store_n(&c->req_tail, tail + 1, __ATOMIC_RELEASE);
+
+    // Pairs with the fence in shmring_wait, either the server sees the request or we see it idle
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->hdr->srv_idle, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&r->hdr->srv_seq, 1, __ATOMIC_RELEASE);
+        futex_wake(&r->hdr->srv_seq);
+    }
+
+    return true;
+}
+
+// Takes the next reply off a channel into buf, polling for SHMRING_SPIN rounds before sleeping
+//
+// Returns the length of the reply, or -1 if none arrived within timeout_ms or it did not fit buf.
+ssize_t shmring_recv(shmring* r, int ch, void* buf, size_t buflen, int timeout_ms)
+{
+    shmring_chan* c = &r->chans[ch];
+    uint32_t head = c->rep_head;
+    int64_t deadline = now_ms() + timeout_ms;
+
+    for (int spins = 0; __atomic_load_n(&c->rep_tail, __ATOMIC_ACQUIRE) == head; ) {
+        if (spins < SHMRING_SPIN) {
+            ++spins;
+            cpu_relax();
+            continue;
+        }
+
+        int64_t left = deadline - now_ms();
+        if (left <= 0) return -1;
+
+        // Pairs with the fence in shmring_reply
+        __atomic_store_n(&c->cli_idle, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&c->rep_tail, __ATOMIC_RELAXED) == head) futex_wait(&c->rep_tail, head, (int)left);
+        __atomic_store_n(&c->cli_idle, 0, __ATOMIC_RELAXED);
+    }
+
+    const shmring_slot* slot = &c->rep[head & SHMRING_MASK];
+    size_t len = slot->len;
+    bool fits = len <= SHMRING_PAYLOAD && len <= buflen;
+    if (fits) memcpy(buf, slot->bytes, len);
+    __atomic_store_n(&c->rep_head, head + 1, __ATOMIC_RELEASE);
+
+    return fits ? (ssize_t)len : -1;
+}
+
+// Returns the next request of a channel without taking it off, or NULL if there is none
+//
+// The bytes live in memory the client can still write to, so copy them before looking at them.
+const uint8_t* shmring_peek(shmring* r, int ch, size_t* len)
+{
+    shmring_chan* c = &r->chans[ch];
+    uint32_t head = c->req_head;
+    if (head == __atomic_load_n(&c->req_tail, __ATOMIC_ACQUIRE)) return NULL;
+
+    const shmring_slot* slot = &c->req[head & SHMRING_MASK];
+    size_t slot_len = slot->len;
+    *len = slot_len <= SHMRING_PAYLOAD ? slot_len : SHMRING_PAYLOAD;
+
+    return slot->bytes;
+}
+
+// Takes the request returned by shmring_peek off its channel, once its reply has been queued
+void shmring_pop(shmring* r, int ch)
+{
+    shmring_chan* c = &r->chans[ch];
+    __atomic_store_n(&c->req_head, c->req_head + 1, __ATOMIC_RELEASE);
+}
+
+// Queues the reply to the oldest request of a channel and wakes its client if it is sleeping
+//
+// An empty reply tells the client that its request went unanswered.
+void shmring_reply(shmring* r, int ch, const void* buf, size_t len)
+{
+    shmring_chan* c = &r->chans[ch];
+    if (len > SHMRING_PAYLOAD) len = 0;
+
+    uint32_t tail = c->rep_tail;
+    shmring_slot* slot = &c->rep[tail & SHMRING_MASK];
+    slot->len = (uint32_t)len;
+    memcpy(slot->bytes, buf, len);
+    __atomic_store_n(&c->rep_tail, tail + 1, __ATOMIC_RELEASE);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&c->cli_idle, __ATOMIC_RELAXED)) futex_wake(&c->rep_tail);
+}
+
+// Sleeps until a client queues a request or timeout_ms (-1 for no limit) has passed
+void shmring_wait(shmring* r, int timeout_ms)
+{
+    uint32_t seq = __atomic_load_n(&r->hdr->srv_seq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&r->hdr->srv_idle, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // Requests queued before the idle flag was visible do not wake us up
+    bool pending = false;
+    for (unsigned ch = 0; ch < r->nchan && !pending; ++ch) {
+        shmring_chan* c = &r->chans[ch];
+        pending = __atomic_load_n(&c->req_head, __ATOMIC_RELAXED) != __atomic_load_n(&c->req_tail, __ATOMIC_RELAXED);
+    }
+
+    if (!pending) futex_wait(&r->hdr->srv_seq, seq, timeout_ms);
+    __atomic_store_n(&r->hdr->srv_idle, 0, __ATOMIC_RELAXED);
+}
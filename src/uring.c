@@ -0,0 +1,468 @@
+#include "uring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// Multishot accept and provided buffer rings arrived together (Linux 5.19), older headers get the stubs
+#ifdef IORING_ACCEPT_MULTISHOT
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#define URING_BGID 0 //<< id of the provided buffer group
+
+/*******************************************
+* Internal Structures
+*******************************************/
+
+// Mappings of the submission and completion rings shared with the kernel
+struct uring {
+    int ring_fd;
+    unsigned features;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned to_submit;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* ring_mem;
+    size_t ring_size;
+    size_t sqes_size;
+
+    // Provided receive buffers, bid i lives at bufs + i * buf_size
+    struct io_uring_buf_ring* br;
+    size_t br_size;
+    unsigned br_mask;
+    uint16_t br_tail;
+    uint8_t* bufs;
+    size_t buf_size;
+    unsigned nbufs;
+};
+
+/*******************************************
+* Internal Helpers
+*******************************************/
+
+static int sys_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                           void* arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Hands a provided buffer back to the kernel, published by buf_ring_commit
+static void buf_ring_add(uring* u, int bid)
+{
+    struct io_uring_buf* buf = &u->br->bufs[u->br_tail & u->br_mask];
+    buf->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * u->buf_size);
+    buf->len = (uint32_t)u->buf_size;
+    buf->bid = (uint16_t)bid;
+    u->br_tail++;
+}
+
+static void buf_ring_commit(uring* u)
+{
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+// Grabs the next free submission entry, flushing the queue once if it is full
+static struct io_uring_sqe* uring_get_sqe(uring* u)
+{
+    unsigned tail = *u->sq_tail;
+    if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+        if (uring_submit_and_wait(u, 0) < 0) return NULL;
+        if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) return NULL;
+    }
+
+    unsigned idx = tail & u->sq_mask;
+    struct io_uring_sqe* sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+
+    return sqe;
+}
+
+/*******************************************
+* Public API
+*******************************************/
+
+// Creates an io_uring instance with NBUFS provided receive buffers of BUF_SIZE bytes each
+//
+// ENTRIES and NBUFS must be powers of two. Returns NULL if the kernel lacks io_uring or one of the
+// features the ring relies on (single mmap, provided buffer rings), so callers can fall back.
+uring* uring_create(const unsigned ENTRIES, const unsigned NBUFS, const size_t BUF_SIZE)
+{
+    uring* u = calloc(1, sizeof(uring));
+    if (!u) return NULL;
+    u->ring_fd = -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    u->ring_fd = sys_uring_setup(ENTRIES, &p);
+    if (u->ring_fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p)); //<< setup flags unknown to older kernels
+        u->ring_fd = sys_uring_setup(ENTRIES, &p);
+    }
+    if (u->ring_fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP)) goto fail;
+    u->features = p.features;
+
+    // The SQ and CQ rings share one mapping, the SQE array gets its own
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+    u->ring_mem = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->ring_mem == MAP_FAILED) {
+        u->ring_mem = NULL;
+        goto fail;
+    }
+
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto fail;
+    }
+
+    uint8_t* base = u->ring_mem;
+    u->sq_head = (unsigned*)(base + p.sq_off.head);
+    u->sq_tail = (unsigned*)(base + p.sq_off.tail);
+    u->sq_mask = *(unsigned*)(base + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->sq_array = (unsigned*)(base + p.sq_off.array);
+    u->cq_head = (unsigned*)(base + p.cq_off.head);
+    u->cq_tail = (unsigned*)(base + p.cq_off.tail);
+    u->cq_mask = *(unsigned*)(base + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(base + p.cq_off.cqes);
+
+    // Provided buffer ring, the kernel picks a buffer only once a receive has bytes to deliver
+    u->nbufs = NBUFS;
+    u->buf_size = BUF_SIZE;
+    u->br_mask = NBUFS - 1;
+    u->br_size = NBUFS * sizeof(struct io_uring_buf);
+    u->br = mmap(NULL, u->br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED) {
+        u->br = NULL;
+        goto fail;
+    }
+    u->bufs = malloc(NBUFS * BUF_SIZE);
+    if (!u->bufs) goto fail;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = NBUFS;
+    reg.bgid = URING_BGID;
+    if (sys_uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) goto fail;
+
+    for (unsigned i = 0; i < NBUFS; ++i) {
+        buf_ring_add(u, (int)i);
+    }
+    buf_ring_commit(u);
+
+    return u;
+
+fail:
+    uring_destroy(u);
+    return NULL;
+}
+
+// Frees an io_uring instance, in-flight operations are cancelled by the kernel
+void uring_destroy(uring* u)
+{
+    if (u == NULL) return;
+
+    if (u->ring_fd >= 0) close(u->ring_fd);
+    if (u->sqes) munmap(u->sqes, u->sqes_size);
+    if (u->ring_mem) munmap(u->ring_mem, u->ring_size);
+    if (u->br) munmap(u->br, u->br_size);
+    free(u->bufs);
+    free(u);
+}
+
+// Queues a multishot accept, every accepted socket completes with its fd as the result
+bool uring_prep_accept_multishot(uring* u, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(u);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+
+    return true;
+}
+
+// Queues a multishot readability poll
+bool uring_prep_poll_multishot(uring* u, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(u);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+
+    return true;
+}
+
+// Queues a receive of at most len bytes into one of the provided buffers
+bool uring_prep_recv(uring* u, int fd, size_t len, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(u);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = (uint32_t)(len < u->buf_size ? len : u->buf_size);
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = user_data;
+
+    return true;
+}
+
+// Queues a send of the whole buffer, a short send completes with the number of bytes sent
+bool uring_prep_send(uring* u, int fd, const void* buf, size_t len, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(u);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = user_data;
+
+    return true;
+}
+
+// Queues a send linked to a close of the same fd
+//
+// The close only runs once the whole buffer was sent and completes with -ECANCELED otherwise, leaving
+// the fd open. Successful sends do not post a completion where the kernel supports skipping it.
+bool uring_prep_send_close(uring* u, int fd, const void* buf, size_t len, uint64_t send_data,
+                           uint64_t close_data)
+{
+    // Both entries must land in the same submission for the link to hold
+    unsigned tail = *u->sq_tail;
+    if (u->sq_entries - (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE)) < 2) {
+        if (uring_submit_and_wait(u, 0) < 0) return false;
+    }
+
+    struct io_uring_sqe* send_sqe = uring_get_sqe(u);
+    if (!send_sqe) return false;
+
+    send_sqe->opcode = IORING_OP_SEND;
+    send_sqe->fd = fd;
+    send_sqe->addr = (uint64_t)(uintptr_t)buf;
+    send_sqe->len = (uint32_t)len;
+    send_sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL; //<< short sends fail the link
+    send_sqe->flags = IOSQE_IO_LINK;
+    if (u->features & IORING_FEAT_CQE_SKIP) send_sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    send_sqe->user_data = send_data;
+
+    struct io_uring_sqe* close_sqe = uring_get_sqe(u);
+    if (!close_sqe) return false; //<< unreachable, room for both was made above
+
+    close_sqe->opcode = IORING_OP_CLOSE;
+    close_sqe->fd = fd;
+    close_sqe->user_data = close_data;
+
+    return true;
+}
+
+// Queues a close
+bool uring_prep_close(uring* u, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(u);
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+
+    return true;
+}
+
+// Submits queued entries and waits for a completion
+//
+// A timeout_ms of -1 waits indefinitely and 0 only submits. The wait is skipped while completions are
+// already pending. Returns 0 on success (including timeouts and interrupts) and a negative errno
+// otherwise.
+int uring_submit_and_wait(uring* u, int timeout_ms)
+{
+    unsigned flags = 0;
+    unsigned min_complete = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void* argp = NULL;
+    size_t argsz = 0;
+
+    bool pending = *u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    if (timeout_ms != 0 && !pending) {
+        flags |= IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+        if (timeout_ms > 0) {
+            memset(&arg, 0, sizeof(arg));
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+    }
+
+    if (u->to_submit == 0 && min_complete == 0) return 0;
+
+    int ret = sys_uring_enter(u->ring_fd, u->to_submit, min_complete, flags, argp, argsz);
+    if (ret < 0) {
+        if (errno == EINTR || errno == ETIME) return 0;
+        return -errno;
+    }
+    u->to_submit -= ((unsigned)ret < u->to_submit) ? (unsigned)ret : u->to_submit;
+
+    return 0;
+}
+
+// Pops the next completion, returns false if there is none
+bool uring_next(uring* u, uring_cqe* cqe)
+{
+    unsigned head = *u->cq_head;
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) return false;
+
+    struct io_uring_cqe* c = &u->cqes[head & u->cq_mask];
+    cqe->user_data = c->user_data;
+    cqe->res = c->res;
+    cqe->bid = (c->flags & IORING_CQE_F_BUFFER) ? (int)(c->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+    cqe->more = (c->flags & IORING_CQE_F_MORE) != 0;
+    cqe->nonempty = (c->flags & IORING_CQE_F_SOCK_NONEMPTY) != 0;
+
+    __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+// Returns the memory of a provided buffer
+uint8_t* uring_buf(uring* u, int bid)
+{
+    return u->bufs + (size_t)bid * u->buf_size;
+}
+
+// Gives a provided buffer back to the kernel once its bytes have been consumed
+void uring_buf_recycle(uring* u, int bid)
+{
+    buf_ring_add(u, bid);
+    buf_ring_commit(u);
+}
+
+#else
+
+/*******************************************
+* Stubs for systems without io_uring
+*******************************************/
+
+uring* uring_create(const unsigned ENTRIES, const unsigned NBUFS, const size_t BUF_SIZE)
+{
+    (void)ENTRIES; (void)NBUFS; (void)BUF_SIZE;
+    return NULL;
+}
+
+void uring_destroy(uring* u) { (void)u; }
+
+bool uring_prep_accept_multishot(uring* u, int fd, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)user_data;
+    return false;
+}
+
+bool uring_prep_poll_multishot(uring* u, int fd, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)user_data;
+    return false;
+}
+
+bool uring_prep_recv(uring* u, int fd, size_t len, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)len; (void)user_data;
+    return false;
+}
+
+bool uring_prep_send(uring* u, int fd, const void* buf, size_t len, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)buf; (void)len; (void)user_data;
+    return false;
+}
+
+bool uring_prep_send_close(uring* u, int fd, const void* buf, size_t len, uint64_t send_data,
+                           uint64_t close_data)
+{
+    (void)u; (void)fd; (void)buf; (void)len; (void)send_data; (void)close_data;
+    return false;
+}
+
+bool uring_prep_close(uring* u, int fd, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)user_data;
+    return false;
+}
+
+int uring_submit_and_wait(uring* u, int timeout_ms)
+{
+    (void)u; (void)timeout_ms;
+    return -1;
+}
+
+bool uring_next(uring* u, uring_cqe* cqe)
+{
+    (void)u; (void)cqe;
+    return false;
+}
+
+uint8_t* uring_buf(uring* u, int bid)
+{
+    (void)u; (void)bid;
+    return NULL;
+}
+
+void uring_buf_recycle(uring* u, int bid) { (void)u; (void)bid; }
+
+#endif
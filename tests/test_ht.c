@@ -0,0 +1,219 @@
+/* Otter Protocol (C) Rommel John Ronduen 2026
+*
+* file: test_ht.c
+*
+* Contains unit tests for the hash table backing the server ctable and otable.
+*/
+
+#include "ht.h"
+#include "testing_utils.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+int tests_failed = 0;
+
+// Checks that keys [from, to) of a table built by the tests map to their index, or are absent
+static bool keys_check(ht* table, int from, int to, bool present)
+{
+  char key[32];
+  for (int i = from; i < to; ++i)
+  {
+    snprintf(key, sizeof key, "key-%d", i);
+    int* value = ht_get(table, key);
+    if (present ? (value == NULL || *value != i) : value != NULL) return false;
+  }
+  return true;
+}
+
+static bool keys_set(ht** table, int from, int to)
+{
+  char key[32];
+  for (int i = from; i < to; ++i)
+  {
+    snprintf(key, sizeof key, "key-%d", i);
+    if (ht_set(table, key, &i, sizeof(i)) == NULL) return false;
+  }
+  return true;
+}
+
+static bool keys_delete(ht* table, int from, int to, int stride)
+{
+  char key[32];
+  for (int i = from; i < to; i += stride)
+  {
+    snprintf(key, sizeof key, "key-%d", i);
+    if (ht_delete(table, key) == NULL) return false;
+  }
+  return true;
+}
+
+int main(void)
+{
+  printf("\n---- BEGIN HT TESTS ----\n");
+
+  // A table filled up to its load limit has keys displaced past their full home group. Deleting
+  // every other key leaves tombstones in full groups, which must not cut off the keys behind them.
+  ht* table = ht_create(1024);
+  size_t capacity = ht_capacity(table);
+  EXPECT(keys_set(&table, 0, 896) && ht_capacity(table) == capacity && ht_length(table) == 896,
+         "[ht] fill to the load limit without resizing");
+  EXPECT(keys_delete(table, 0, 896, 2) && ht_length(table) == 448, "[ht] delete every other key");
+
+  bool odd_found = true;
+  bool even_gone = true;
+  for (int i = 0; i < 896; ++i)
+  {
+    char key[32];
+    snprintf(key, sizeof key, "key-%d", i);
+    int* value = ht_get(table, key);
+    if (i % 2 == 1) odd_found = odd_found && value != NULL && *value == i;
+    else even_gone = even_gone && value == NULL;
+  }
+  EXPECT(odd_found, "[ht] neighbours of deleted keys are still found");
+  EXPECT(even_gone, "[ht] deleted keys are gone");
+  EXPECT(ht_delete(table, "key-0") == NULL, "[ht] deleting a deleted key fails");
+  ht_destroy(table);
+
+  // Churning through distinct keys leaves tombstones all over a table that is less than half full.
+  // They must be reused or reclaimed by a rebuild in place, instead of growing the table.
+  table = ht_create(256);
+  capacity = ht_capacity(table);
+  bool churn_ok = true;
+  for (int i = 0; i < 20000 && churn_ok; ++i)
+  {
+    churn_ok = keys_set(&table, i, i + 1) && (i < 100 || keys_delete(table, i - 100, i - 99, 1));
+  }
+  EXPECT(churn_ok && ht_length(table) == 100 && keys_check(table, 20000 - 100, 20000, true) &&
+         keys_check(table, 0, 20000 - 100, false), "[ht] churn keeps the live keys");
+  EXPECT(ht_capacity(table) == capacity, "[ht] churn reuses tombstones instead of growing");
+  ht_destroy(table);
+
+  // Growth from the default size goes through several resizes and keeps every key
+  table = ht_create(HT_DEF_SZ);
+  capacity = ht_capacity(table);
+  EXPECT(keys_set(&table, 0, 20000) && ht_length(table) == 20000, "[ht] grow to 20000 keys");
+  EXPECT(ht_capacity(table) >= 8 * capacity && ht_capacity(table) >= 20000, "[ht] capacity doubled several times");
+  EXPECT(keys_check(table, 0, 20000, true) && keys_check(table, 20000, 21000, false),
+         "[ht] all keys found after growing");
+  EXPECT(keys_delete(table, 0, 20000, 1) && ht_length(table) == 0 && keys_check(table, 0, 20000, false),
+         "[ht] all keys deleted after growing");
+  ht_destroy(table);
+
+  // One insert past the load limit starts a resize. Every write moves 64 slots of the old arrays, so
+  // the writes below run while entries are still spread over the old and the new arrays.
+  table = ht_create_u64(1024, 0);
+  capacity = ht_capacity(table);
+  bool filled = true;
+  for (uint64_t k = 1; k <= 897; ++k) filled = filled && ht_set_u64(table, k, &k, sizeof(k));
+  EXPECT(filled && ht_capacity(table) == 2 * capacity, "[ht migration] insert past the load limit resizes");
+
+  bool mid_get = true;
+  for (uint64_t k = 1; k <= 897; ++k)
+  {
+    uint64_t* value = ht_get_u64(table, k);
+    mid_get = mid_get && value != NULL && *value == k;
+  }
+  EXPECT(mid_get, "[ht migration] get finds every key mid-migration");
+
+  uint64_t overwritten[3] = {100, 500, 897};
+  bool mid_set = true;
+  for (int i = 0; i < 3; ++i)
+  {
+    uint64_t value = overwritten[i] + 1000000;
+    mid_set = mid_set && ht_set_u64(table, overwritten[i], &value, sizeof(value));
+  }
+  bool mid_delete = ht_delete_u64(table, 1) && ht_delete_u64(table, 450) && ht_delete_u64(table, 896) &&
+                    !ht_delete_u64(table, 450);
+  bool mid_insert = true;
+  for (uint64_t k = 2001; k <= 2003; ++k) mid_insert = mid_insert && ht_set_u64(table, k, &k, sizeof(k));
+  EXPECT(mid_set && mid_delete && mid_insert && ht_length(table) == 897, "[ht migration] set and delete mid-migration");
+
+  // Checks every key of the migration table against the writes above
+  bool migrated_ok = true;
+  for (uint64_t k = 1; k <= 2003; ++k)
+  {
+    uint64_t* value = ht_get_u64(table, k);
+    bool deleted = (k == 1 || k == 450 || k == 896 || (k > 897 && k <= 2000));
+    uint64_t expect = (k == 100 || k == 500 || k == 897) ? k + 1000000 : k;
+    migrated_ok = migrated_ok && (deleted ? value == NULL : value != NULL && *value == expect);
+  }
+  EXPECT(migrated_ok, "[ht migration] writes mid-migration are visible");
+
+  // Writing on until the old arrays are empty keeps everything in place
+  uint64_t extra = 3000;
+  for (int i = 0; i < 32; ++i, ++extra) ht_set_u64(table, extra, &extra, sizeof(extra));
+  for (extra = 3000; extra < 3032; ++extra) migrated_ok = migrated_ok && ht_delete_u64(table, extra);
+  for (uint64_t k = 1; k <= 2003; ++k)
+  {
+    uint64_t* value = ht_get_u64(table, k);
+    bool deleted = (k == 1 || k == 450 || k == 896 || (k > 897 && k <= 2000));
+    uint64_t expect = (k == 100 || k == 500 || k == 897) ? k + 1000000 : k;
+    migrated_ok = migrated_ok && (deleted ? value == NULL : value != NULL && *value == expect);
+  }
+  EXPECT(migrated_ok && ht_length(table) == 897, "[ht migration] keys intact once the migration is done");
+  ht_destroy(table);
+
+  // A table reserved for n entries takes all of them without resizing
+  table = ht_create(HT_DEF_SZ);
+  EXPECT(ht_reserve(table, 5000) == 0, "[ht reserve] reserve 5000 entries");
+  capacity = ht_capacity(table);
+  EXPECT(keys_set(&table, 0, 5000) && ht_capacity(table) == capacity && keys_check(table, 0, 5000, true),
+         "[ht reserve] 5000 inserts never resize");
+  ht_destroy(table);
+
+  // Tables with a fixed value size keep their values in slab cells
+  table = ht_create_sized(HT_DEF_SZ, sizeof(uint64_t));
+  uint64_t cell_value = 42;
+  uint32_t short_value = 7;
+  EXPECT(ht_set(&table, "short", &short_value, sizeof(short_value)) == NULL && ht_get(table, "short") == NULL,
+         "[ht slab] value of the wrong size is rejected");
+  EXPECT(ht_set(&table, "cell", &cell_value, sizeof(cell_value)) != NULL, "[ht slab] set a fixed-size value");
+
+  uint64_t* cell = ht_get(table, "cell");
+  cell_value = 43;
+  ht_set(&table, "cell", &cell_value, sizeof(cell_value));
+  EXPECT(cell != NULL && ht_get(table, "cell") == cell && *cell == 43, "[ht slab] overwrite reuses the cell in place");
+
+  EXPECT(ht_delete(table, "cell") != NULL && ht_set(&table, "reuse", &cell_value, sizeof(cell_value)) != NULL &&
+         ht_get(table, "reuse") == cell, "[ht slab] deleted cell goes back on the free list");
+
+  uint64_t filler;
+  bool stable = true;
+  for (int i = 0; i < 2000; ++i)
+  {
+    char key[32];
+    snprintf(key, sizeof key, "filler-%d", i);
+    filler = (uint64_t)i;
+    stable = stable && ht_set(&table, key, &filler, sizeof(filler)) != NULL;
+  }
+  EXPECT(stable && ht_get(table, "reuse") == cell && *cell == 43, "[ht slab] cells stay put across resizes");
+  ht_destroy(table);
+
+  // Integer keyed tables take a fixed value size too
+  table = ht_create_u64(HT_DEF_SZ, 16);
+  uint8_t value16[16] = {1, 2, 3};
+  EXPECT(!ht_set_u64(table, 1, value16, 8) && ht_get_u64(table, 1) == NULL, 
+         "[ht slab] u64 value of the wrong size is rejected");
+  EXPECT(ht_set_u64(table, 1, value16, sizeof(value16)), "[ht slab] u64 set a fixed-size value");
+  uint8_t* cell16 = ht_get_u64(table, 1);
+  value16[0] = 9;
+  EXPECT(ht_set_u64(table, 1, value16, sizeof(value16)) && ht_get_u64(table, 1) == cell16 && cell16[0] == 9,
+         "[ht slab] u64 overwrite reuses the cell in place");
+  EXPECT(ht_delete_u64(table, 1) && ht_set_u64(table, 2, value16, sizeof(value16)) && 
+         ht_get_u64(table, 2) == cell16, "[ht slab] u64 deleted cell goes back on the free list");
+  ht_destroy(table);
+
+  printf("---- END HT TESTS ----\n");
+
+  if (tests_failed > 0)
+  {
+    fprintf(stderr, "One or more tests have failed! Exiting...\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <unistd.h>
 
 int tests_failed = 0;
 
@@ -131,8 +132,118 @@ int main(void)
   {
     printf("serialized payload count: %zu => deserialized payload count: %zu\n", count, res_payload_count);
   }
+
+  // Failures to pack or unpack a part of the frame are reported, not added to its length
+  uint8_t short_buf[sizeof(ot_pkt_frame) + sizeof(ot_pkt_header) + 4];
+  EXPECT(ot_pkt_serialize(o, short_buf, sizeof short_buf) == -1, "(pkt serialization) buffer too small");
+  ot_pkt* empty_pkt = ot_pkt_create();
+  EXPECT(ot_pkt_serialize(empty_pkt, short_buf, sizeof short_buf) == -1, "(pkt serialization) pkt without payloads");
+  ot_pkt_destroy(&empty_pkt);
+
+  uint8_t bad_buf[2048];
+  memcpy(bad_buf, buf, (size_t)ser_bytes);
+  bad_buf[sizeof(ot_pkt_frame) + sizeof(ot_pkt_header) + 1] = 0xff; //<< vlen of the first payload runs past the frame
+  ot_pkt* bad_pkt = ot_pkt_create();
+  EXPECT(ot_pkt_deserialize(bad_pkt, bad_buf, sizeof bad_buf) == -1, "(pkt serialization) truncated payload");
+  ot_pkt_destroy(&bad_pkt);
+
+  // A view over the frame sees the same payloads without copying them
+  ot_pkt_view view;
+  uint32_t view_value = 0;
+  ssize_t view_bytes = ot_pkt_view_parse(&view, buf, sizeof buf);
+  EXPECT(view_bytes == ser_bytes && view.present == OT_PL_BIT(TEST_PAYLOAD_TYPE) &&
+         memcmp(&view.header, &header, sizeof(header)) == 0, "(pkt serialization) view parse test");
+  EXPECT(ot_pkt_view_u32(&view, (ot_pkt_msgtype_t)TEST_PAYLOAD_TYPE, &view_value) &&
+         view_value == TEST_PAYLOAD_VALUE && 
+         ot_pkt_view_get(&view, (ot_pkt_msgtype_t)TEST_PAYLOAD_TYPE)->value > buf &&
+         ot_pkt_view_get(&view, PL_HASH) == NULL, "(pkt serialization) view lookup test");
+
+  // The same pkt built inline serializes to the same frame, and deserialized payloads are stored inline
+  ot_pkt* inline_pkt = ot_pkt_create();
+  inline_pkt->header = header;
+  for (size_t i = 0; i < count; ++i) ot_pkt_put(inline_pkt, TEST_PAYLOAD_TYPE, &TEST_PAYLOAD_VALUE, TEST_PAYLOAD_VLEN);
+  uint8_t inline_buf[2048];
+  EXPECT(ot_pkt_serialize(inline_pkt, inline_buf, sizeof inline_buf) == ser_bytes &&
+         memcmp(inline_buf, buf, (size_t)ser_bytes) == 0 &&
+         deser_res->payload == &deser_res->pl[0] && deser_res->npl == count, "(pkt serialization) inline payloads");
+
+  // Written through a pipe with writev, the iovecs of the pkt make up the same frame
+  uint8_t heads[sizeof(ot_pkt_frame) + 2 * OT_PKT_MAX_PAYLOADS];
+  struct iovec iov[OT_PKT_MAX_IOV];
+  size_t iov_len = 0;
+  int iovcnt = ot_pkt_serialize_iov(inline_pkt, heads, sizeof heads, iov, OT_PKT_MAX_IOV, &iov_len);
+  int pipefd[2] = {-1, -1};
+  uint8_t iov_buf[2048];
+  bool piped = iovcnt > 0 && pipe(pipefd) == 0;
+  piped = piped && writev(pipefd[1], iov, iovcnt) == (ssize_t)iov_len && 
+          read(pipefd[0], iov_buf, sizeof iov_buf) == (ssize_t)iov_len;
+  EXPECT(piped && iov_len == (size_t)ser_bytes && memcmp(iov_buf, buf, iov_len) == 0, 
+         "(pkt serialization) scatter-gather serialization");
+  if (pipefd[0] >= 0) { close(pipefd[0]); close(pipefd[1]); }
+  ot_pkt_destroy(&inline_pkt);
+
+  // Schema-driven encode/decode round trip; CINV may carry the optional hash
+  ot_pkt_fields fields = { .header = header, .state = CINV, .srv_ip = TEST_SRV_IP, .cli_ip = TEST_CLI_IP };
+  ot_pkt_fields decoded;
+  uint8_t fields_buf[128];
+  ssize_t enc_bytes = ot_pkt_encode(&fields, fields_buf, sizeof fields_buf);
+  EXPECT(ot_pkt_decode(&decoded, fields_buf, sizeof fields_buf) == enc_bytes && ot_pkt_validate(&decoded) &&
+         decoded.present == ot_pkt_required(CINV) && decoded.cli_ip == TEST_CLI_IP,
+         "(pkt serialization) schema encode/decode");
+  decoded.present &= ~OT_PL_BIT(PL_CLI_IP);
+  EXPECT(!ot_pkt_validate(&decoded), "(pkt serialization) schema rejects missing payload");
   // End pkt serialization tests
 
+  // Begin pkt framing tests
+  size_t frame_len = (size_t)ser_bytes;
+
+  EXPECT(ot_pkt_frame_len(buf, frame_len) == ser_bytes, "(pkt framing) complete frame");
+  EXPECT(ot_pkt_frame_len(buf, frame_len - 3) == 0, "(pkt framing) incomplete frame");
+
+  memcpy(&buf[frame_len], buf, frame_len); //<< a second frame right behind the first one
+  EXPECT(ot_pkt_frame_len(buf, 2 * frame_len) == ser_bytes &&
+         ot_pkt_frame_len(&buf[frame_len], frame_len) == ser_bytes, "(pkt framing) back-to-back frames");
+
+  // Pkts of pre-v1 peers start right with the header
+  uint8_t legacy[sizeof(ot_pkt_header)];
+  memcpy(legacy, &header, sizeof(header));
+  EXPECT(ot_pkt_frame_len(legacy, sizeof(legacy)) == OT_FRAME_ELEGACY, "(pkt framing) unframed pkt detected");
+
+  // Feed two back-to-back frames to a stream parser in 3-byte chunks, through a buffer that can only
+  // hold a frame and a half
+  ot_pkt_parser parser;
+  uint8_t stream_buf[2048];
+  ot_pkt_parser_init(&parser, stream_buf, frame_len + frame_len / 2);
+
+  size_t fed = 0;
+  size_t frames = 0;
+  bool frames_intact = true;
+  while (fed < 2 * frame_len)
+  {
+    size_t room;
+    uint8_t* dst = ot_pkt_parser_room(&parser, &room);
+    size_t chunk = (2 * frame_len - fed < 3) ? 2 * frame_len - fed : 3;
+    if (chunk > room) chunk = room;
+    memcpy(dst, &buf[fed], chunk);
+    ot_pkt_parser_feed(&parser, chunk);
+    fed += chunk;
+
+    uint8_t* frame;
+    size_t len;
+    while (ot_pkt_parser_peek(&parser, &frame, &len) == 1)
+    {
+      frames_intact = frames_intact && len == frame_len && memcmp(frame, buf, len) == 0;
+      ot_pkt_parser_pop(&parser);
+      ++frames;
+    }
+  }
+  EXPECT(frames == 2 && frames_intact && ot_pkt_parser_buffered(&parser) == 0,
+         "(pkt framing) stream parser over partial reads");
+
+  buf[2] = OT_WIRE_VERSION + 1;
+  EXPECT(ot_pkt_frame_len(buf, frame_len) == OT_FRAME_EVERSION, "(pkt framing) wire version mismatch");
+  // End pkt framing tests
+
   // Begin destructor tests
   ot_pkt_destroy(&o);
   EXPECT(o == NULL, "(pkt destructor) nullity test");
@@ -7,6 +7,7 @@
 
 #include "ot_server.h"
 #include "ot_context.h"
+#include "ot_packet.h"
 #include "testing_utils.h"
 
 #include <stdlib.h>
@@ -67,6 +68,44 @@ int main(void)
   ot_cli_ctx cli_ctx_get_res = ot_srv_get_cli_ctx(srv_ctx_res, TEST_STR_SRV_MAC);
   EXPECT(memcmp(&cli_ctx_get_res, &cli_ctx_res, sizeof(ot_cli_ctx)) == 0, "[ctable] get functionality");
 
+  uint64_t TEST_PACKED_SRV_MAC = ot_mac_pack(TEST_BYTES_SRV_MAC);
+  EXPECT(TEST_PACKED_SRV_MAC == 0xaabbccddeeffULL, "[ctable] mac packing");
+  cli_ctx_get_res = ot_srv_get_cli_ctx_mac(srv_ctx_res, TEST_PACKED_SRV_MAC);
+  EXPECT(memcmp(&cli_ctx_get_res, &cli_ctx_res, sizeof(ot_cli_ctx)) == 0, "[ctable] get by packed mac");
+  EXPECT(ot_srv_del_cli_ctx_mac(srv_ctx_res, TEST_PACKED_SRV_MAC) && 
+         ot_srv_get_cli_ctx(srv_ctx_res, TEST_STR_SRV_MAC).state == UNKN, "[ctable] delete by packed mac");
+
+  // Request handler
+  ot_srv_ctx* handler_ctx = ot_srv_ctx_create(srv_ctx_mdata_res);
+  ot_pkt_fields treq = { .header = TEST_HEADER, .present = ot_pkt_required(TREQ) };
+  treq.state = TREQ;
+  treq.srv_ip = TEST_SRV_IP;
+  treq.cli_ip = TEST_CLI_IP;
+  memcpy(treq.cli_mac, TEST_BYTES_CLI_MAC, 6);
+
+  uint8_t handler_in[256];
+  uint8_t handler_out[256];
+  ot_pkt_fields handler_reply;
+  ssize_t treq_len = ot_pkt_encode(&treq, handler_in, sizeof(handler_in));
+
+  ssize_t handler_res = ot_srv_handle(handler_ctx, handler_in, (size_t)treq_len, handler_out, 
+                                      sizeof(handler_out), curr_time);
+  EXPECT(handler_res > 0 && ot_pkt_decode(&handler_reply, handler_out, (size_t)handler_res) == handler_res &&
+         handler_reply.state == TACK, "[srv handler] treq of a new client is answered with tack");
+  handler_res = ot_srv_handle(handler_ctx, handler_in, (size_t)treq_len, handler_out, sizeof(handler_out), 
+                              curr_time);
+  EXPECT(handler_res > 0 && ot_pkt_decode(&handler_reply, handler_out, (size_t)handler_res) == handler_res &&
+         handler_reply.state == TINV, "[srv handler] repeated treq is answered with tinv");
+  ot_pkt_fields tack = treq;
+  tack.state = TACK;
+  ssize_t tack_len = ot_pkt_encode(&tack, handler_in, sizeof(handler_in));
+  EXPECT(tack_len > 0 && ot_srv_handle(handler_ctx, handler_in, (size_t)tack_len, handler_out, 
+                                       sizeof(handler_out), curr_time) == 0, 
+         "[srv handler] pkt in a reply state is left unanswered");
+  EXPECT(ot_srv_handle(handler_ctx, (const uint8_t*)"garbage", 7, handler_out, sizeof(handler_out), 
+                       curr_time) == 0, "[srv handler] garbage is left unanswered");
+  ot_srv_ctx_destroy(&handler_ctx);
+
   // Destructor tests
   ot_srv_ctx_destroy(&srv_ctx_res);
   EXPECT(srv_ctx_res == NULL, "[srv ctx destructor] nullity test");
@@ -30,6 +30,38 @@
  *    attempts TREN with no preceding TREQ/TACK hdsk. Expects TINV reply
  * - test_unknown_csend:
  *    attempts CSEND with no preceding TREQ/TACK hdsk. Expects CINV reply
+ * - test_keepalive:
+ *    performs the TREQ/TACK hdsk and several CSENDs (valid and invalid) through the client API over 
+ *    one persistent connection. Expects every reply on the same connection
+ * - test_pipeline:
+ *    performs the TREQ/TACK hdsk, then a batch of pipelined CSENDs that mixes valid and invalid 
+ *    credentials and spans several pipeline windows. Expects the CVAL/CINV replies in request order
+ *
+ * Transport tests:
+ * These run against a server the suite forks itself, configured with the transports under test. It
+ * shares the TCP port of the server started by run_tests.sh (both use SO_REUSEPORT), so the transport
+ * tests run last and never use TCP. They are run against a server with a single worker, then against
+ * a sharded server with several workers, so that pkts get forwarded to the shard owning their client,
+ * and last against a server on io_uring.
+ * - test_udp:
+ *    performs the TREQ/TACK hdsk and valid and invalid CSENDs through the client API over UDP, then a
+ *    batch of CSENDs sent as one burst of datagrams. Expects the CVAL/CINV replies matched to their requests
+ * - test_udp_retransmit:
+ *    sends the same TREQ datagram twice under one request id. Expects the cached TACK both times, 
+ *    then TINV for the TREQ under a new request id. After a burst of TREQs under many more request ids
+ *    than the initial size of the reply cache, expects the cached TACK once more
+ * - test_udp_duplicate:
+ *    sends the TREQ datagrams of several clients twice back-to-back, so that in sharded mode the copy
+ *    arrives while the original is forwarded. Expects only TACK replies, for every copy that is not
+ *    dropped and for a later retransmit
+ * - test_unix:
+ *    performs the TREQ/TACK hdsk and valid and invalid CSENDs through the client API over one 
+ *    connection to the unix socket of the server
+ * - test_shm:
+ *    performs the TREQ/TACK hdsk, valid and invalid CSENDs and a batch of CSENDs through a channel of
+ *    the shared memory ring of the server. A CSEND sent while the server is stopped times out, and the
+ *    CSENDs after it must get their own replies, not its late one. Then lets a child process claim every 
+ *    channel and exit without releasing them, and expects a channel of the dead process to be taken over
  */
 
 // 
@@ -37,6 +69,7 @@
 //
 #include "ot_server.h"
 #include "ot_packet.h"
+#include "ot_client.h"
 #include "testing_utils.h"
 
 // 
@@ -50,6 +83,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <assert.h>
 
 // 
@@ -89,6 +123,16 @@ int test_unknown_tren(const int PORT, uint32_t SRV_IP, uint32_t CLI_IP,
 int test_unknown_csend(const int PORT, uint32_t SRV_IP, uint32_t CLI_IP,
                        uint8_t* SRV_MAC, uint8_t* CLI_MAC);
 
+int test_keepalive(uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC);
+int test_pipeline(uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC);
+
+int test_transports(const char* mode, ot_srv_cfg cfg, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* SRV_MAC);
+int test_udp(const char* mode, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC);
+int test_udp_retransmit(const char* mode, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC);
+int test_udp_duplicate(const char* mode, uint32_t SRV_IP, uint32_t CLI_IP);
+int test_unix(const char* mode, const char* path, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC);
+int test_shm(const char* mode, const char* path, pid_t srv_pid, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC);
+
 
 //
 // Internal Packet Builders
@@ -142,6 +186,8 @@ int main(void)
   uint8_t INV_CLI_MAC_CSEND[6] = {0x04,0xee,0xdd,0xcc,0xbb,0xaa};
   uint8_t UNK_CLI_MAC_TREN[6] = {0x05,0xee,0xdd,0xcc,0xbb,0xaa};
   uint8_t UNK_CLI_MAC_CSEND[6] = {0x06,0xee,0xdd,0xcc,0xbb,0xaa};
+  uint8_t KA_CLI_MAC[6] = {0x07,0xee,0xdd,0xcc,0xbb,0xaa};
+  uint8_t PL_CLI_MAC_BATCH[6] = {0x08,0xee,0xdd,0xcc,0xbb,0xaa};
   uint8_t DBG_CLI_MAC[6] = {0x00, 0x00, 0x00, 0xab, 0xab, 0xff};
 
   sleep(2); //<< just in case server hasn't run yet
@@ -150,6 +196,8 @@ int main(void)
   if (test_treq(DEF_PORT, SRV_IP, CLI_IP, SRV_MAC, CLI_MAC_TREQ) != 0) goto check;
   if (test_tren(DEF_PORT, SRV_IP, CLI_IP, SRV_MAC, DBG_CLI_MAC) != 0) goto check;
   if (test_csend(DEF_PORT, SRV_IP, CLI_IP, SRV_MAC, CLI_MAC_CSEND) != 0) goto check;
+  if (test_keepalive(SRV_IP, CLI_IP, KA_CLI_MAC) != 0) goto check;
+  if (test_pipeline(SRV_IP, CLI_IP, PL_CLI_MAC_BATCH) != 0) goto check;
 
   // Error-handling tests
   if (test_invalid_tren(DEF_PORT, SRV_IP, CLI_IP, SRV_MAC, DBG_CLI_MAC) != 0) goto check;
@@ -163,6 +211,24 @@ int main(void)
   if (test_unknown_tren(DEF_PORT, SRV_IP, CLI_IP, SRV_MAC, UNK_CLI_MAC_TREN) != 0) goto check;
   if (test_unknown_csend(DEF_PORT, SRV_IP, CLI_IP, SRV_MAC, UNK_CLI_MAC_CSEND) != 0) goto check;
 
+  // Transport tests
+  ot_srv_cfg tp_cfg = ot_srv_cfg_default();
+  tp_cfg.udp = true;
+  tp_cfg.unix_path = "/tmp/otter_test.sock";
+  tp_cfg.shm_path = "/dev/shm/otter_test";
+  if (test_transports("shared", tp_cfg, SRV_IP, CLI_IP, SRV_MAC) != 0) goto check;
+
+  // Clients of the tests hash to different shards than the workers their pkts land on
+  tp_cfg.nworkers = 4;
+  tp_cfg.sharded = true;
+  if (test_transports("sharded", tp_cfg, SRV_IP, CLI_IP, SRV_MAC) != 0) goto check;
+
+  // Workers fall back to epoll where the kernel lacks io_uring, the tests pass either way
+  tp_cfg.nworkers = 2;
+  tp_cfg.sharded = false;
+  tp_cfg.uring = true;
+  if (test_transports("io_uring", tp_cfg, SRV_IP, CLI_IP, SRV_MAC) != 0) goto check;
+
 check:
   if (tests_failed > 0) 
   {
@@ -809,6 +875,412 @@ int test_unknown_csend(const int PORT, uint32_t SRV_IP, uint32_t CLI_IP,
 
 }
 
+// Returns the local port of a connected socket, 0 on error
+static uint16_t local_port(int sockfd)
+{
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  if (getsockname(sockfd, (struct sockaddr*)&addr, &addrlen) < 0) return 0;
+
+  return ntohs(addr.sin_port);
+}
+
+int test_keepalive(uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC)
+{
+  printf("---- BEGIN KEEPALIVE TESTS ----\n");
+  uint8_t empty_mac[6] = {0};
+
+  ot_pkt_header hd = ot_pkt_header_create(SRV_IP, CLI_IP, empty_mac, CLI_MAC, 0, 0);
+  ot_cli_ctx cc = ot_cli_ctx_create(hd, 0, 0);
+
+  ot_cli_conn* conn = ot_cli_conn_open(&cc);
+  EXPECT(conn != NULL, "[keepalive] connection opened");
+  if (conn == NULL) return -1;
+
+  uint16_t port = local_port(conn->sockfd);
+
+  EXPECT(ot_cli_conn_auth(conn, &cc), "[keepalive] treq/tack hdsk");
+  
+  bool all_valid = true;
+  for (int i = 0; i < 5; ++i)
+  {
+    all_valid = ot_cli_conn_send(conn, cc, "rommelrond", "WowHello") && all_valid;
+  }
+  EXPECT(all_valid, "[keepalive] repeated csend yields cval");
+
+  // A CINV reply must not end the session
+  EXPECT(!ot_cli_conn_send(conn, cc, "nobody", "nothing"), "[keepalive] csend with unknown uname");
+  EXPECT(ot_cli_conn_send(conn, cc, "rommelrond", "WowHello"), "[keepalive] csend after cinv");
+
+  EXPECT(conn->sockfd >= 0 && local_port(conn->sockfd) == port, "[keepalive] single connection reused");
+
+  printf("---- END KEEPALIVE TESTS ----\n");
+
+  ot_cli_conn_close(&conn);
+
+  return 0;
+}
+
+// Checks a batch of CSENDs that spans more than one pipeline window, every third one with credentials
+// unknown to the server. Returns true if every reply came back and matches its request.
+static bool batch_check(ot_cli_conn* conn, ot_cli_ctx cc)
+{
+  const size_t n = CLI_PIPELINE_DEPTH + 8;
+  const char* unames[CLI_PIPELINE_DEPTH + 8];
+  const char* psks[CLI_PIPELINE_DEPTH + 8];
+  bool results[CLI_PIPELINE_DEPTH + 8];
+  for (size_t i = 0; i < n; ++i)
+  {
+    unames[i] = (i % 3 == 2) ? "nobody" : "rommelrond";
+    psks[i] = (i % 3 == 2) ? "nothing" : "WowHello";
+    results[i] = (i % 3 == 2); //<< the opposite of what is expected
+  }
+
+  bool matched = ot_cli_conn_send_batch(conn, cc, unames, psks, n, results);
+  for (size_t i = 0; i < n; ++i)
+  {
+    matched = matched && (results[i] == (i % 3 != 2));
+  }
+
+  return matched;
+}
+
+int test_pipeline(uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC)
+{
+  printf("---- BEGIN PIPELINE TESTS ----\n");
+  uint8_t empty_mac[6] = {0};
+
+  ot_pkt_header hd = ot_pkt_header_create(SRV_IP, CLI_IP, empty_mac, CLI_MAC, 0, 0);
+  ot_cli_ctx cc = ot_cli_ctx_create(hd, 0, 0);
+
+  ot_cli_conn* conn = ot_cli_conn_open(&cc);
+  EXPECT(conn != NULL, "[pipeline] connection opened");
+  if (conn == NULL) return -1;
+
+  uint16_t port = local_port(conn->sockfd);
+
+  EXPECT(ot_cli_conn_auth(conn, &cc), "[pipeline] treq/tack hdsk");
+
+  EXPECT(batch_check(conn, cc), "[pipeline] cval/cinv replies to a batch arrive in request order");
+
+  // The connection goes on as usual after a batch
+  EXPECT(ot_cli_conn_send(conn, cc, "rommelrond", "WowHello"), "[pipeline] csend after batch");
+  EXPECT(conn->sockfd >= 0 && local_port(conn->sockfd) == port, "[pipeline] single connection reused");
+
+  printf("---- END PIPELINE TESTS ----\n");
+
+  ot_cli_conn_close(&conn);
+
+  return 0;
+}
+
+#define TEST_OTFILE "tests/files/test.ot" //<< relative to the repo root, where run_tests.sh runs from
+
+// Forks a server running with cfg and gives it a second to come up. Returns its pid, or -1.
+static pid_t test_srv_spawn(ot_srv_cfg cfg, uint32_t SRV_IP, uint8_t* SRV_MAC)
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    // The server logs every pkt, keep that out of the test output
+    if (freopen("/dev/null", "w", stdout) == NULL || freopen("/dev/null", "w", stderr) == NULL) _exit(1);
+    ot_srv_run_cfg(SRV_IP, SRV_MAC, TEST_OTFILE, cfg);
+    _exit(1);
+  }
+
+  sleep(1);
+  return pid;
+}
+
+static void test_srv_stop(pid_t pid, ot_srv_cfg cfg)
+{
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  
+  // Killed servers do not get to clean up after themselves
+  if (cfg.unix_path != NULL) unlink(cfg.unix_path);
+  if (cfg.shm_path != NULL) unlink(cfg.shm_path);
+}
+
+int test_transports(const char* mode, ot_srv_cfg cfg, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* SRV_MAC)
+{
+  printf("---- BEGIN TRANSPORT TESTS (%s) ----\n", mode);
+
+  // Every server starts out with an empty ctable, so the MACs are the same for every mode
+  uint8_t UDP_CLI_MAC[6] = {0x10,0xee,0xdd,0xcc,0xbb,0xaa};
+  uint8_t RTX_CLI_MAC[6] = {0x11,0xee,0xdd,0xcc,0xbb,0xaa};
+  uint8_t UNIX_CLI_MAC[6] = {0x12,0xee,0xdd,0xcc,0xbb,0xaa};
+  uint8_t SHM_CLI_MAC[6] = {0x13,0xee,0xdd,0xcc,0xbb,0xaa};
+
+  pid_t pid = test_srv_spawn(cfg, SRV_IP, SRV_MAC);
+  EXPECT(pid > 0, "[transport] server started");
+  if (pid <= 0) return -1;
+
+  int res = 0;
+  if (res == 0 && cfg.udp) res = test_udp(mode, SRV_IP, CLI_IP, UDP_CLI_MAC);
+  if (res == 0 && cfg.udp) res = test_udp_retransmit(mode, SRV_IP, CLI_IP, RTX_CLI_MAC);
+  if (res == 0 && cfg.udp) res = test_udp_duplicate(mode, SRV_IP, CLI_IP);
+  if (res == 0 && cfg.unix_path) res = test_unix(mode, cfg.unix_path, SRV_IP, CLI_IP, UNIX_CLI_MAC);
+  if (res == 0 && cfg.shm_path) res = test_shm(mode, cfg.shm_path, pid, SRV_IP, CLI_IP, SHM_CLI_MAC);
+
+  test_srv_stop(pid, cfg);
+
+  printf("---- END TRANSPORT TESTS (%s) ----\n", mode);
+
+  return res;
+}
+
+int test_udp(const char* mode, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC)
+{
+  uint8_t empty_mac[6] = {0};
+  char msg[128];
+
+  ot_pkt_header hd = ot_pkt_header_create(SRV_IP, CLI_IP, empty_mac, CLI_MAC, 0, 0);
+  ot_cli_ctx cc = ot_cli_ctx_create(hd, 0, 0);
+
+  ot_cli_conn* conn = ot_cli_conn_open_udp(&cc);
+  snprintf(msg, sizeof msg, "[udp %s] socket opened", mode);
+  EXPECT(conn != NULL, msg);
+  if (conn == NULL) return -1;
+
+  snprintf(msg, sizeof msg, "[udp %s] treq/tack hdsk", mode);
+  EXPECT(ot_cli_conn_auth(conn, &cc), msg);
+  snprintf(msg, sizeof msg, "[udp %s] csend yields cval", mode);
+  EXPECT(ot_cli_conn_send(conn, cc, "rommelrond", "WowHello"), msg);
+  snprintf(msg, sizeof msg, "[udp %s] csend with unknown uname yields cinv", mode);
+  EXPECT(!ot_cli_conn_send(conn, cc, "nobody", "nothing"), msg);
+
+  // A batch goes out as a burst of datagrams, which the server drains and answers in batches of its own
+  snprintf(msg, sizeof msg, "[udp %s] batch of csends matched to their replies", mode);
+  EXPECT(batch_check(conn, cc), msg);
+
+  ot_cli_conn_close(&conn);
+
+  return 0;
+}
+
+// Opens a UDP socket connected to the server that gives up on a reply after timeout_ms. Returns -1 on error.
+static int test_udp_open(uint32_t SRV_IP, int timeout_ms)
+{
+  int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in serv_addr = { .sin_family = AF_INET, .sin_port = htons(DEF_PORT), 
+                                   .sin_addr.s_addr = SRV_IP };
+  struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+  if (sockfd >= 0 && connect(sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) == 0 &&
+      setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0) return sockfd;
+
+  if (sockfd >= 0) close(sockfd);
+  return -1;
+}
+
+// Sends a TREQ datagram under request id, returns false on error
+static bool test_udp_treq_send(int sockfd, uint32_t id, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* cli_mac)
+{
+  uint8_t empty_mac[6] = {0};
+  ot_pkt_fields treq = { .header = ot_pkt_header_create(SRV_IP, CLI_IP, empty_mac, cli_mac, 0, 0), 
+                         .state = TREQ, .srv_ip = SRV_IP, .cli_ip = CLI_IP };
+  memcpy(treq.cli_mac, cli_mac, 6);
+
+  uint8_t dgram[OT_UDP_ID_SIZE + MAX_RECV_SIZE];
+  id = htonl(id);
+  memcpy(dgram, &id, sizeof(id));
+  ssize_t len = ot_pkt_encode(&treq, &dgram[OT_UDP_ID_SIZE], sizeof(dgram) - OT_UDP_ID_SIZE);
+
+  return len >= 0 && send(sockfd, dgram, OT_UDP_ID_SIZE + (size_t)len, 0) >= 0;
+}
+
+// Waits for the reply to request id. Returns the state of the reply, or UNKN if none arrives.
+static ot_cli_state_t test_udp_reply(int sockfd, uint32_t id)
+{
+  uint8_t dgram[OT_UDP_ID_SIZE + MAX_RECV_SIZE];
+  id = htonl(id);
+
+  ssize_t bytes_received = recv(sockfd, dgram, sizeof(dgram), 0);
+  if (bytes_received <= OT_UDP_ID_SIZE || memcmp(dgram, &id, sizeof(id)) != 0) return UNKN;
+
+  ot_pkt_fields reply;
+  size_t reply_len = (size_t)bytes_received - OT_UDP_ID_SIZE;
+  if (ot_pkt_decode(&reply, &dgram[OT_UDP_ID_SIZE], reply_len) != (ssize_t)reply_len) return UNKN;
+
+  return (ot_cli_state_t)reply.state;
+}
+
+// Sends a TREQ datagram under request id and waits for its reply. Returns the state of the reply, or UNKN.
+static ot_cli_state_t test_udp_treq(int sockfd, uint32_t id, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* cli_mac)
+{
+  if (!test_udp_treq_send(sockfd, id, SRV_IP, CLI_IP, cli_mac)) return UNKN;
+
+  return test_udp_reply(sockfd, id);
+}
+
+int test_udp_retransmit(const char* mode, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC)
+{
+  char msg[128];
+
+  int sockfd = test_udp_open(SRV_IP, 1000);
+  snprintf(msg, sizeof msg, "[udp %s] raw socket opened", mode);
+  EXPECT(sockfd >= 0, msg);
+  if (sockfd < 0) return -1;
+
+  // Handling the TREQ a second time would tether an existing client and yield TINV
+  snprintf(msg, sizeof msg, "[udp %s] treq yields tack", mode);
+  EXPECT(test_udp_treq(sockfd, 0x07ae0001, SRV_IP, CLI_IP, CLI_MAC) == TACK, msg);
+  snprintf(msg, sizeof msg, "[udp %s] retransmitted treq is answered from the reply cache", mode);
+  EXPECT(test_udp_treq(sockfd, 0x07ae0001, SRV_IP, CLI_IP, CLI_MAC) == TACK, msg);
+  snprintf(msg, sizeof msg, "[udp %s] treq under a new request id yields tinv", mode);
+  EXPECT(test_udp_treq(sockfd, 0x07ae0002, SRV_IP, CLI_IP, CLI_MAC) == TINV, msg);
+
+  // The requests of a burst must not push the TACK out of the cache while its client may still retry
+  bool burst = true;
+  for (uint32_t id = 0x07ae1000; id < 0x07ae1000 + 4 * SRV_UDP_CACHE_SIZE; ++id)
+  {
+    burst = burst && test_udp_treq(sockfd, id, SRV_IP, CLI_IP, CLI_MAC) == TINV;
+  }
+  snprintf(msg, sizeof msg, "[udp %s] burst of treqs under new request ids yields tinv", mode);
+  EXPECT(burst, msg);
+  snprintf(msg, sizeof msg, "[udp %s] treq retransmitted after a burst is answered from the reply cache", mode);
+  EXPECT(test_udp_treq(sockfd, 0x07ae0001, SRV_IP, CLI_IP, CLI_MAC) == TACK, msg);
+
+  close(sockfd);
+
+  return 0;
+}
+
+int test_udp_duplicate(const char* mode, uint32_t SRV_IP, uint32_t CLI_IP)
+{
+  char msg[128];
+
+  int sockfd = test_udp_open(SRV_IP, 200);
+  snprintf(msg, sizeof msg, "[udp %s] raw socket opened", mode);
+  EXPECT(sockfd >= 0, msg);
+  if (sockfd < 0) return -1;
+
+  // Datagrams of one socket land on one worker, the clients hash to shards of other workers as well
+  bool sent = true;
+  bool answered = true;
+  bool acked = true;
+  for (uint8_t i = 0; i < 8; ++i)
+  {
+    uint8_t cli_mac[6] = {0x20 + i, 0xee, 0xdd, 0xcc, 0xbb, 0xaa};
+    uint32_t id = 0x07af0000 + i;
+    sent = sent && test_udp_treq_send(sockfd, id, SRV_IP, CLI_IP, cli_mac) && 
+           test_udp_treq_send(sockfd, id, SRV_IP, CLI_IP, cli_mac);
+
+    // A copy that arrives while the original is forwarded goes unanswered
+    int nreplies = 0;
+    ot_cli_state_t state;
+    while ((state = test_udp_reply(sockfd, id)) != UNKN)
+    {
+      acked = acked && state == TACK;
+      ++nreplies;
+    }
+    answered = answered && nreplies > 0;
+    acked = acked && test_udp_treq(sockfd, id, SRV_IP, CLI_IP, cli_mac) == TACK;
+  }
+  snprintf(msg, sizeof msg, "[udp %s] treqs sent twice back-to-back", mode);
+  EXPECT(sent, msg);
+  snprintf(msg, sizeof msg, "[udp %s] treqs sent twice are answered", mode);
+  EXPECT(answered, msg);
+  snprintf(msg, sizeof msg, "[udp %s] treqs sent twice yield tack only, even when retransmitted later", mode);
+  EXPECT(acked, msg);
+
+  close(sockfd);
+
+  return 0;
+}
+
+int test_unix(const char* mode, const char* path, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC)
+{
+  uint8_t empty_mac[6] = {0};
+  char msg[128];
+
+  ot_pkt_header hd = ot_pkt_header_create(SRV_IP, CLI_IP, empty_mac, CLI_MAC, 0, 0);
+  ot_cli_ctx cc = ot_cli_ctx_create(hd, 0, 0);
+
+  ot_cli_conn* conn = ot_cli_conn_open_unix(path);
+  snprintf(msg, sizeof msg, "[unix %s] connection opened", mode);
+  EXPECT(conn != NULL, msg);
+  if (conn == NULL) return -1;
+
+  int sockfd = conn->sockfd;
+
+  snprintf(msg, sizeof msg, "[unix %s] treq/tack hdsk", mode);
+  EXPECT(ot_cli_conn_auth(conn, &cc), msg);
+  snprintf(msg, sizeof msg, "[unix %s] csend yields cval", mode);
+  EXPECT(ot_cli_conn_send(conn, cc, "rommelrond", "WowHello"), msg);
+  snprintf(msg, sizeof msg, "[unix %s] csend with unknown uname yields cinv", mode);
+  EXPECT(!ot_cli_conn_send(conn, cc, "nobody", "nothing"), msg);
+  snprintf(msg, sizeof msg, "[unix %s] csend after cinv", mode);
+  EXPECT(ot_cli_conn_send(conn, cc, "bonjour", "bonjor"), msg);
+  snprintf(msg, sizeof msg, "[unix %s] single connection reused", mode);
+  EXPECT(conn->sockfd == sockfd, msg);
+
+  ot_cli_conn_close(&conn);
+
+  return 0;
+}
+
+int test_shm(const char* mode, const char* path, pid_t srv_pid, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* CLI_MAC)
+{
+  uint8_t empty_mac[6] = {0};
+  char msg[128];
+
+  ot_pkt_header hd = ot_pkt_header_create(SRV_IP, CLI_IP, empty_mac, CLI_MAC, 0, 0);
+  ot_cli_ctx cc = ot_cli_ctx_create(hd, 0, 0);
+
+  ot_cli_conn* conn = ot_cli_conn_open_shm(path);
+  snprintf(msg, sizeof msg, "[shm %s] channel claimed", mode);
+  EXPECT(conn != NULL, msg);
+  if (conn == NULL) return -1;
+
+  snprintf(msg, sizeof msg, "[shm %s] treq/tack hdsk", mode);
+  EXPECT(ot_cli_conn_auth(conn, &cc), msg);
+  snprintf(msg, sizeof msg, "[shm %s] csend yields cval", mode);
+  EXPECT(ot_cli_conn_send(conn, cc, "rommelrond", "WowHello"), msg);
+  snprintf(msg, sizeof msg, "[shm %s] csend with unknown uname yields cinv", mode);
+  EXPECT(!ot_cli_conn_send(conn, cc, "nobody", "nothing"), msg);
+
+  // The CVAL to a CSEND that timed out arrives late and must not answer the CSENDs after it
+  kill(srv_pid, SIGSTOP);
+  bool timed_out = !ot_cli_conn_send(conn, cc, "rommelrond", "WowHello");
+  kill(srv_pid, SIGCONT);
+  snprintf(msg, sizeof msg, "[shm %s] csend to a stopped server times out", mode);
+  EXPECT(timed_out, msg);
+  snprintf(msg, sizeof msg, "[shm %s] csend after a timeout gets its own cinv", mode);
+  EXPECT(!ot_cli_conn_send(conn, cc, "nobody", "nothing"), msg);
+  snprintf(msg, sizeof msg, "[shm %s] csend after a timeout gets its own cval", mode);
+  EXPECT(ot_cli_conn_send(conn, cc, "rommelrond", "WowHello"), msg);
+
+  // A batch keeps several requests outstanding in the ring of the channel
+  snprintf(msg, sizeof msg, "[shm %s] batch of csends answered in order", mode);
+  EXPECT(batch_check(conn, cc), msg);
+
+  ot_cli_conn_close(&conn);
+
+  // A client that dies holding every channel must not lock others out of the ring
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    int claimed = 0;
+    for (; claimed < SRV_SHM_CHANNELS && ot_cli_conn_open_shm(path) != NULL; ++claimed);
+    _exit(claimed == SRV_SHM_CHANNELS ? 0 : 1);
+  }
+
+  int status = -1;
+  bool crashed = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  snprintf(msg, sizeof msg, "[shm %s] child claimed every channel and died", mode);
+  EXPECT(crashed, msg);
+
+  conn = ot_cli_conn_open_shm(path);
+  snprintf(msg, sizeof msg, "[shm %s] channel of a dead client taken over", mode);
+  EXPECT(conn != NULL && ot_cli_conn_send(conn, cc, "rommelrond", "WowHello"), msg);
+  ot_cli_conn_close(&conn);
+
+  return 0;
+}
+
 static int test_treq_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, uint32_t CLI_IP, uint8_t* srv_mac, uint8_t* cli_mac) 
 {
   // Build TREQ header 
@@ -858,7 +1330,7 @@ static int test_treq_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, u
 
   // Serialize TREQ pkt
   ssize_t bytes_serialized = 0;
-  uint8_t buf[2048] = {0xff}; //<< pre-set with 0xFF terminator
+  uint8_t buf[2048] = {0};
   if ( (bytes_serialized = ot_pkt_serialize(treq_pkt, buf, sizeof buf)) < 0) 
   {
     ++tests_failed;
@@ -899,10 +1371,8 @@ static int test_treq_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, u
     return -1;
   } 
 
-  memset(&buf[bytes_received], 0xff, sizeof(buf) - bytes_received);
-
   // Finally, deserialize reply
-  if (ot_pkt_deserialize(*reply_pkt, buf, sizeof buf) < 0) 
+  if (ot_pkt_deserialize(*reply_pkt, buf, (size_t)bytes_received) < 0) 
   {
     printf("deserialization failed\n");
     printf("FAILED\n");
@@ -964,7 +1434,7 @@ static int test_tren_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, u
 
   // Serialize TREN pkt
   ssize_t bytes_serialized = 0;
-  uint8_t buf[2048] = {0xff}; //<< pre-set with 0xFF terminator
+  uint8_t buf[2048] = {0};
   if ( (bytes_serialized = ot_pkt_serialize(tren_pkt, buf, sizeof buf)) < 0) 
   {
     ++tests_failed;
@@ -994,8 +1464,10 @@ static int test_tren_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, u
 
   // Send the serialized TREN to server
   send(sockfd, buf, bytes_serialized, 0);
+
+  ssize_t bytes_received;
   // Wait for reply
-  if (read(sockfd, buf, sizeof buf) < 0) 
+  if ((bytes_received = read(sockfd, buf, sizeof buf)) < 0) 
   {
     perror("read failed");
     ++tests_failed;
@@ -1003,7 +1475,7 @@ static int test_tren_send(ot_pkt** reply_pkt, const int PORT, uint32_t SRV_IP, u
   } 
 
   // Finally, deserialize reply
-  if (ot_pkt_deserialize(*reply_pkt, buf, sizeof buf) < 0) 
+  if (ot_pkt_deserialize(*reply_pkt, buf, (size_t)bytes_received) < 0) 
   {
     ++tests_failed;
     return -1;
@@ -1063,7 +1535,7 @@ static int test_csend_send(ot_pkt** reply_pkt, const char* uname, const char* ps
 
   // Serialize CSEND pkt
   ssize_t bytes_serialized = 0;
-  uint8_t buf[2048] = {0xff}; //<< pre-set with 0xFF terminator
+  uint8_t buf[2048] = {0};
   if ( (bytes_serialized = ot_pkt_serialize(csend_pkt, buf, sizeof buf)) < 0) 
   {
     ++tests_failed;
@@ -1092,8 +1564,10 @@ static int test_csend_send(ot_pkt** reply_pkt, const char* uname, const char* ps
 
   // Send the serialized CSEND to server
   send(sockfd, buf, bytes_serialized, 0);
+
+  ssize_t bytes_received;
   // Wait for reply
-  if (read(sockfd, buf, sizeof buf) < 0) 
+  if ((bytes_received = read(sockfd, buf, sizeof buf)) < 0) 
   {
     perror("read failed");
     ++tests_failed;
@@ -1101,7 +1575,7 @@ static int test_csend_send(ot_pkt** reply_pkt, const char* uname, const char* ps
   } 
 
   // Finally, deserialize reply
-  if (ot_pkt_deserialize(*reply_pkt, buf, sizeof buf) < 0) 
+  if (ot_pkt_deserialize(*reply_pkt, buf, (size_t)bytes_received) < 0) 
   {
     ++tests_failed;
     return -1;